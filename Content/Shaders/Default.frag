@@ -1,8 +1,12 @@
-#version 330 core
+#version 430 core
 
-// Light count
+// Light count, point lights come from the cluster grid
 #define DirectionalLightCount 1
-#define PointLightCount 9
+
+// Must match LightClusterer
+#define GRID_X 16
+#define GRID_Y 9
+#define GRID_Z 24
 
 in VS_OUT 
 {
@@ -10,11 +14,13 @@ in VS_OUT
     vec3 normal;
     vec2 texCoords;
     vec4 fragPosLightSpace;
+    vec4 tangent;
 } fs_in;
 
+in vec2 lightmapCoords;
+
 layout (location = 0) out vec4 FragColor;
-layout (location = 1) out vec4 FragNormal;
-layout (location = 2) out vec4 FragDepth;
+layout (location = 1) out vec2 FragNormal;
 
 struct DirectionalLight 
 {
@@ -27,70 +33,244 @@ struct DirectionalLight
 
 struct PointLight 
 {
-    vec3 position;
-    vec3 color;
-
-    float intensity;
-    float range;
+    vec4 positionRange;
+    vec4 colorIntensity;
+    vec4 shadow;
 };  
 
+layout (std430, binding = 8) readonly buffer Lights
+{
+    PointLight pointLights[];
+};
+
+layout (std430, binding = 9) readonly buffer LightGrid
+{
+    uvec2 lightGrid[];
+};
+
+layout (std430, binding = 10) readonly buffer LightIndices
+{
+    uint lightIndices[];
+};
+
+// Point light cube shadows, faces are tiles in one atlas
+struct PointShadow
+{
+    mat4 faceMatrices[6];
+    vec4 faceTiles[6];
+};
+
+layout (std430, binding = 12) readonly buffer PointShadows
+{
+    PointShadow pointShadows[];
+};
+
+uniform sampler2DShadow pointShadowAtlas;
+
+float PointShadowCalculation(PointLight light, vec3 position, vec3 normal)
+{
+    int index = int(light.shadow.x);
+    if (index < 0)
+        return 0.0;
+
+    // Face by major axis, same order as the atlas, +X -X +Y -Y +Z -Z
+    vec3 toFragment = position - light.positionRange.xyz;
+    vec3 absolute = abs(toFragment);
+    int face;
+    if (absolute.x >= absolute.y && absolute.x >= absolute.z)
+        face = toFragment.x > 0.0 ? 0 : 1;
+    else if (absolute.y >= absolute.z)
+        face = toFragment.y > 0.0 ? 2 : 3;
+    else
+        face = toFragment.z > 0.0 ? 4 : 5;
+
+    // Offset along the normal by about a texel, a face is twice the major axis distance across
+    vec4 tile = pointShadows[index].faceTiles[face];
+    float texelWorldSize = 2.0 * max(absolute.x, max(absolute.y, absolute.z)) / tile.w;
+    vec4 clip = pointShadows[index].faceMatrices[face] * vec4(position + normal * texelWorldSize * 1.5, 1.0);
+    vec3 projCoords = clip.xyz / clip.w * 0.5 + 0.5;
+
+    // Bilinear taps stay inside the tile
+    float halfTexel = 0.5 * tile.z / tile.w;
+    vec2 uv = tile.xy + clamp(projCoords.xy * tile.z, vec2(halfTexel), vec2(tile.z - halfTexel));
+
+    return 1.0 - texture(pointShadowAtlas, vec3(uv, projCoords.z - 0.0005));
+}
+
 uniform DirectionalLight directionalLights[DirectionalLightCount];
-uniform PointLight pointLights[PointLightCount];
+
+// Cluster lookup
+uniform mat4 view;
+uniform vec2 clusterScreenSize;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
 
 uniform sampler2D albedoMap;
 uniform sampler2D normalMap;
 uniform sampler2D roughnessMap;
 
+// Baked diffuse irradiance for static entities
+uniform bool isLightmapped = false;
+uniform sampler2D lightmap;
+
 // Shadows
-uniform sampler2D shadowMap;
+#define CascadeCount 4
+uniform sampler2DShadow shadowMap;
+uniform mat4 cascadeMatrices[CascadeCount];
+uniform float cascadeSplits[CascadeCount];
+
+// Cheapest first, in depth compares: 0 bilinear tap (4), 1 tent of four gathers (16), 2 Poisson 8 (32), 3 Poisson 16 (64), 4 EVSM
+uniform int shadowKernel;
+uniform float shadowFilterRadius;
+uniform float shadowBias;
+uniform float shadowSlopeBias;
+
+// Blurred EVSM moments, same atlas layout as the shadow map
+uniform sampler2D shadowMoments;
+uniform vec2 shadowExponents;
+uniform float shadowBleedReduction;
+
+const vec2 PoissonDisk[16] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+    vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+    vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790));
 
 uniform float shininess;
 
 uniform vec3 cameraPosition;
 uniform samplerCube skybox;
 
-float ShadowCalculation(vec4 fragPosLight)
+// Upper bound on the lit fraction from the mean and variance of the occluder depth
+float ChebyshevUpperBound(vec2 moments, float mean, float minVariance)
+{
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = mean - moments.x;
+    float pMax = variance / (variance + d * d);
+
+    return mean <= moments.x ? 1.0 : pMax;
+}
+
+float EVSMLookup(vec2 uv, vec2 gradX, vec2 gradY, float depth)
+{
+    vec4 moments = textureGrad(shadowMoments, uv, gradX, gradY);
+
+    depth = depth * 2.0 - 1.0;
+    float positive = exp(shadowExponents.x * depth);
+    float negative = -exp(-shadowExponents.y * depth);
+
+    // Minimum variance scaled by the warp's slope
+    float positiveVariance = 0.0001 * pow(shadowExponents.x * positive, 2.0);
+    float negativeVariance = 0.0001 * pow(shadowExponents.y * negative, 2.0);
+    float lit = min(ChebyshevUpperBound(moments.xy, positive, positiveVariance), ChebyshevUpperBound(moments.zw, negative, negativeVariance));
+
+    // Cut off the low tail where light bleeds through overlapping occluders
+    return clamp((lit - shadowBleedReduction) / (1.0 - shadowBleedReduction), 0.0, 1.0);
+}
+
+float ShadowCalculation(vec3 position)
 {
-    // perform perspective divide
-    vec3 projCoords = fs_in.fragPosLightSpace.xyz / fs_in.fragPosLightSpace.w;
+    // Derivatives before any early out, cascade matrices are orthographic so these map straight to the atlas
+    vec3 positionDx = dFdx(position);
+    vec3 positionDy = dFdy(position);
+
+    // Pick the cascade by view depth, nothing past the last split is shadowed
+    float viewDepth = (view * vec4(position, 1.0)).z;
+    int cascade = 0;
+    while (cascade < CascadeCount && viewDepth > cascadeSplits[cascade])
+    {
+        cascade++;
+    }
+    if (cascade == CascadeCount)
+    {
+        return 0.0;
+    }
+
+    vec4 fragPosLight = cascadeMatrices[cascade] * vec4(position, 1.0);
+    vec3 projCoords = fragPosLight.xyz / fragPosLight.w;
     // transform to [0,1] range
     projCoords = projCoords * 0.5 + 0.5;
-    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
+
+    // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
+    if(projCoords.z > 1.0)
+        return 0.0;
+
     // get depth of current fragment from light's perspective
     float currentDepth = projCoords.z;
-    // calculate bias (based on depth map resolution and slope)
+    // calculate bias (based on depth map resolution and slope), larger cascades have larger texels
     vec3 normal = normalize(fs_in.normal);
     vec3 lightDir = normalize(-directionalLights[0].direction);
-    float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
-    // check whether current frag pos is in shadow
-    // float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
-    // PCF
-    float shadow = 0.0;
+    float bias = max(shadowSlopeBias * (1.0 - dot(normal, lightDir)), shadowBias) * (1.0 + cascade);
+
+    // Cascades are laid out as a 2x2 atlas, keep taps inside this cascade's quadrant
     vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x)
+    vec2 quadrant = vec2(cascade % 2, cascade / 2) * 0.5;
+    vec2 quadrantMin = quadrant + texelSize;
+    vec2 quadrantMax = quadrant + 0.5 - texelSize;
+    vec2 uv = quadrant + projCoords.xy * 0.5;
+
+    // Compares are done by the sampler, every tap is already a bilinear 2x2 PCF
+    float reference = currentDepth - bias;
+    float lit = 0.0;
+    if (shadowKernel == 0)
+    {
+        lit = texture(shadowMap, vec3(clamp(uv, quadrantMin, quadrantMax), reference));
+    }
+    else if (shadowKernel == 1)
     {
-        for(int y = -1; y <= 1; ++y)
+        // Tent over 3x3 texels, the 4x4 block it touches is four gathers with the bilinear fraction on the edge texels
+        vec2 texel = uv / texelSize - 0.5;
+        vec2 base = floor(texel);
+        vec2 f = texel - base;
+        vec4 weightX = vec4(1.0 - f.x, 1.0, 1.0, f.x);
+        vec4 weightY = vec4(1.0 - f.y, 1.0, 1.0, f.y);
+        for (int i = 0; i < 4; i++)
         {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
-            shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;        
-        }    
+            // Gather returns (x0 y1, x1 y1, x1 y0, x0 y0) around the texel corner it is centered on
+            ivec2 block = ivec2(i % 2, i / 2) * 2;
+            vec2 corner = (base + vec2(block)) * texelSize;
+            vec4 taps = textureGather(shadowMap, clamp(corner, quadrantMin, quadrantMax), reference);
+            vec2 x = vec2(weightX[block.x], weightX[block.x + 1]);
+            vec2 y = vec2(weightY[block.y], weightY[block.y + 1]);
+            lit += dot(taps, vec4(x.x * y.y, x.y * y.y, x.y * y.x, x.x * y.x));
+        }
+        lit /= 9.0;
     }
-    shadow /= 9.0;
-    
-    // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
-    if(projCoords.z > 1.0)
-        shadow = 0.0;
-        
-    return shadow;
+    else if (shadowKernel == 4)
+    {
+        // Quarter scale, [-1,1] to [0,1] and then into the quadrant
+        vec2 gradX = (mat3(cascadeMatrices[cascade]) * positionDx).xy * 0.25;
+        vec2 gradY = (mat3(cascadeMatrices[cascade]) * positionDy).xy * 0.25;
+        lit = EVSMLookup(clamp(uv, quadrantMin, quadrantMax), gradX, gradY, reference);
+    }
+    else
+    {
+        // Poisson disk rotated per pixel, the noise turns banding into grain
+        int tapCount = shadowKernel == 2 ? 8 : 16;
+        float angle = 6.283185 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+        mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+        for (int i = 0; i < tapCount; i++)
+        {
+            // The 8 tap kernel uses every other sample so it still covers the whole disk
+            vec2 offset = rotation * PoissonDisk[shadowKernel == 2 ? i * 2 : i] * shadowFilterRadius * texelSize;
+            lit += texture(shadowMap, vec3(clamp(uv + offset, quadrantMin, quadrantMax), reference));
+        }
+        lit /= float(tapCount);
+    }
+
+    return 1.0 - lit;
 }
 
 vec3 ComputeDirectionalLight(DirectionalLight light, vec3 norm, vec3 viewDir, vec3 diffuseColor, float specularStrength, float shadow)
 {
     vec3 lightDir = normalize(-light.direction);
 
-    // Ambient
-    vec3 ambient = 0.15 * light.color;
+    // Constant ambient, the lightmap's bounce and sky light replace it
+    vec3 ambient = isLightmapped ? vec3(0.0) : 0.15 * light.color;
 
     // Diffuse
     float diffuse = max(dot(norm, lightDir), 0.0);
@@ -102,9 +282,19 @@ vec3 ComputeDirectionalLight(DirectionalLight light, vec3 norm, vec3 viewDir, ve
     return (ambient + (1 - shadow) * diffuse * diffuseColor + specular * specularStrength) * light.intensity * light.color; 
 }
 
+// Offset and count of the lights touching this fragment's cluster
+uvec2 GetCluster()
+{
+    float viewDepth = (view * vec4(fs_in.position, 1.0)).z;
+    uint slice = min(uint(max(log(viewDepth) * clusterSliceScale + clusterSliceBias, 0.0)), uint(GRID_Z - 1));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterScreenSize * vec2(GRID_X, GRID_Y)), uvec2(GRID_X - 1, GRID_Y - 1));
+
+    return lightGrid[tile.x + GRID_X * (tile.y + GRID_Y * slice)];
+}
+
 vec3 ComputePointLight(PointLight light, vec3 norm, vec3 viewDir, vec3 diffuseColor, float specularStrength)
 {	
-    vec3 lightDir = normalize(light.position - fs_in.position);
+    vec3 lightDir = normalize(light.positionRange.xyz - fs_in.position);
 
     // No ambient for now
 
@@ -116,19 +306,20 @@ vec3 ComputePointLight(PointLight light, vec3 norm, vec3 viewDir, vec3 diffuseCo
     float specular = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
 
     // Attenuation
-    float distance = length(light.position - fs_in.position);
-    float attenuation = clamp(1.0f - (distance * distance / (light.range * light.range)), 0.0, 1.0); 
+    float distance = length(light.positionRange.xyz - fs_in.position);
+    float attenuation = clamp(1.0f - (distance * distance / (light.positionRange.w * light.positionRange.w)), 0.0, 1.0); 
 
-	return (diffuse * diffuseColor + specular * specularStrength) * attenuation * light.intensity * light.color;
+	return (diffuse * diffuseColor + specular * specularStrength) * attenuation * light.colorIntensity.w * light.colorIntensity.rgb;
 }
 
-float near = 0.1; 
-float far  = 10.0; 
-
-float LinearizeDepth(float depth) 
+// Octahedral normal remapped to [0, 1] for the RG16 target
+vec2 EncodeNormal(vec3 n)
 {
-    float z = depth * 2.0 - 1.0; // back to NDC 
-    return (2.0 * near * far) / (far + near - z * (far - near));	
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    vec2 encoded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+
+    return encoded * 0.5 + 0.5;
 }
 
 void main()
@@ -141,24 +332,34 @@ void main()
     float specularStrength = texture(roughnessMap, fs_in.texCoords).r; // using roughness as specular
 
     // calculate shadow
-    float shadow = ShadowCalculation(fs_in.fragPosLightSpace);  
+    float shadow = ShadowCalculation(fs_in.position);  
+
+    // The lightmap already holds direct diffuse, lights only add specular
+    vec3 lightDiffuseColor = isLightmapped ? vec3(0.0) : diffuseColor;
 
     // Directional lighting
-    vec3 result = ComputeDirectionalLight(directionalLights[0], norm, viewDir, diffuseColor, specularStrength, shadow);
+    vec3 result = ComputeDirectionalLight(directionalLights[0], norm, viewDir, lightDiffuseColor, specularStrength, shadow);
 
     // Point lights
-    for(int i = 0; i < PointLightCount; i++)
+    uvec2 cluster = GetCluster();
+    for(uint i = 0; i < cluster.y; i++)
 	{
-		result += ComputePointLight(pointLights[i], norm, viewDir, diffuseColor, specularStrength);    
+		PointLight light = pointLights[lightIndices[cluster.x + i]];
+		result += ComputePointLight(light, norm, viewDir, lightDiffuseColor, specularStrength) * (1.0 - PointShadowCalculation(light, fs_in.position, normalize(fs_in.normal)));
 	}
 
+    if (isLightmapped)
+    {
+        // Blinn-Phong diffuse is irradiance times color, no 1 / pi like the PBR shader
+        result += diffuseColor * texture(lightmap, lightmapCoords).rgb;
+    }
+
     // Spot lights
     //result += SpotLight(spotLight, norm, viewDir);    
 
     // Default
     FragColor = vec4(result, 1.0);
-    FragNormal = vec4(norm, 1.0);
-    FragDepth = vec4(result, 1.0);// vec4(vec3(LinearizeDepth(gl_FragCoord.z) / far), 1.0);
+    FragNormal = EncodeNormal(norm);
 
     // Environment
     //vec3 I = normalize(position - cameraPosition);
@@ -2,6 +2,13 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
 layout (location = 2) in vec3 aNormal;
+layout (location = 3) in vec4 aTangent;
+layout (location = 4) in vec2 aLightmapCoords;
+
+// Constant attributes set by the mesh, dequantizes packed positions and is identity otherwise
+// Offset w is set when the normal is octahedral encoded
+layout (location = 5) in vec4 aPositionScale;
+layout (location = 6) in vec4 aPositionOffset;
 
 out VS_OUT 
 {
@@ -9,27 +16,53 @@ out VS_OUT
     vec3 normal;
     vec2 texCoords;
     vec4 fragPosLightSpace;
+    vec4 tangent;
 } vs_out;
 
+// Outside the block so fragment shaders without baked lighting don't have to declare it
+out vec2 lightmapCoords;
+
+// Depth pre-pass computes the same position in Depth.vert
+invariant gl_Position;
+
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 uniform mat4 lightSpaceMatrix;
 
+vec3 DecodeOctahedral(vec2 encoded)
+{
+    // Unfold the lower half of the octahedron
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (normal.z < 0.0)
+    {
+        normal.xy = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+    }
+
+    return normalize(normal);
+}
+
 void main()
 {
+    vec3 position = aPositionOffset.xyz + aPos * aPositionScale.xyz;
+    vec3 normal = aPositionOffset.w > 0.5 ? DecodeOctahedral(aNormal.xy) : aNormal;
+
     // Set world space position
-    vs_out.position = vec3(model * vec4(aPos, 1.0));
+    vs_out.position = vec3(model * vec4(position, 1.0));
 
     // Set world space normal
-    vs_out.normal = transpose(inverse(mat3(model))) * aNormal;
+    vs_out.normal = transpose(inverse(mat3(model))) * normal;
+
+    // Tangent follows the surface, sign passes through untouched
+    vs_out.tangent = vec4(mat3(model) * aTangent.xyz, aTangent.w);
 
     // Set tex coords
     vs_out.texCoords = aTexCoords;
+    lightmapCoords = aLightmapCoords;
 
     // Light spcae
     vs_out.fragPosLightSpace = lightSpaceMatrix * vec4(vs_out.position, 1.0);
 
     // Move to screen space 
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -1,8 +1,12 @@
-#version 330 core
+#version 430 core
 
-// Light count
+// Light count, point lights come from the cluster grid
 #define DirectionalLightCount 1
-#define PointLightCount 9
+
+// Must match LightClusterer
+#define GRID_X 16
+#define GRID_Y 9
+#define GRID_Z 24
 
 in VS_OUT 
 {
@@ -10,11 +14,13 @@ in VS_OUT
     vec3 normal;
     vec2 texCoords;
     vec4 fragPosLightSpace;
+    vec4 tangent;
 } fs_in;
 
+in vec2 lightmapCoords;
+
 layout (location = 0) out vec4 FragColor;
-layout (location = 1) out vec4 FragNormal;
-layout (location = 2) out vec4 FragDepth;
+layout (location = 1) out vec2 FragNormal;
 
 struct DirectionalLight 
 {
@@ -26,13 +32,70 @@ struct DirectionalLight
 
 struct PointLight 
 {
-    vec3 position;
-    vec3 color;
-
-    float intensity;
-    float range;
+    vec4 positionRange;
+    vec4 colorIntensity;
+    vec4 shadow;
 }; 
 
+layout (std430, binding = 8) readonly buffer Lights
+{
+    PointLight pointLights[];
+};
+
+layout (std430, binding = 9) readonly buffer LightGrid
+{
+    uvec2 lightGrid[];
+};
+
+layout (std430, binding = 10) readonly buffer LightIndices
+{
+    uint lightIndices[];
+};
+
+// Point light cube shadows, faces are tiles in one atlas
+struct PointShadow
+{
+    mat4 faceMatrices[6];
+    vec4 faceTiles[6];
+};
+
+layout (std430, binding = 12) readonly buffer PointShadows
+{
+    PointShadow pointShadows[];
+};
+
+uniform sampler2DShadow pointShadowAtlas;
+
+float PointShadowCalculation(PointLight light, vec3 position, vec3 normal)
+{
+    int index = int(light.shadow.x);
+    if (index < 0)
+        return 0.0;
+
+    // Face by major axis, same order as the atlas, +X -X +Y -Y +Z -Z
+    vec3 toFragment = position - light.positionRange.xyz;
+    vec3 absolute = abs(toFragment);
+    int face;
+    if (absolute.x >= absolute.y && absolute.x >= absolute.z)
+        face = toFragment.x > 0.0 ? 0 : 1;
+    else if (absolute.y >= absolute.z)
+        face = toFragment.y > 0.0 ? 2 : 3;
+    else
+        face = toFragment.z > 0.0 ? 4 : 5;
+
+    // Offset along the normal by about a texel, a face is twice the major axis distance across
+    vec4 tile = pointShadows[index].faceTiles[face];
+    float texelWorldSize = 2.0 * max(absolute.x, max(absolute.y, absolute.z)) / tile.w;
+    vec4 clip = pointShadows[index].faceMatrices[face] * vec4(position + normal * texelWorldSize * 1.5, 1.0);
+    vec3 projCoords = clip.xyz / clip.w * 0.5 + 0.5;
+
+    // Bilinear taps stay inside the tile
+    float halfTexel = 0.5 * tile.z / tile.w;
+    vec2 uv = tile.xy + clamp(projCoords.xy * tile.z, vec2(halfTexel), vec2(tile.z - halfTexel));
+
+    return 1.0 - texture(pointShadowAtlas, vec3(uv, projCoords.z - 0.0005));
+}
+
 uniform vec3 camPos;
 
 // PBR textures
@@ -42,33 +105,220 @@ uniform sampler2D metallicMap;
 uniform sampler2D roughnessMap;
 
 // IBL
-uniform samplerCube irradianceMap;
 uniform samplerCube specularMap;
 uniform sampler2D BRDFLUT;
+
+// Baked diffuse irradiance for static entities
+uniform bool isLightmapped = false;
+uniform sampler2D lightmap;
+
+// L2 SH irradiance probes, the nine coefficients sit side by side along x
+uniform bool isProbeLit = false;
+uniform sampler3D probeVolume;
+uniform vec3 probeVolumeMin;
+uniform vec3 probeVolumeSize;
+uniform vec3 probeResolution;
 //uniform int totalMipLevels;
 
 // Lighting
-uniform PointLight pointLights[PointLightCount];
 uniform DirectionalLight directionalLights[DirectionalLightCount];
 
+// Cluster lookup
+uniform mat4 view;
+uniform vec2 clusterScreenSize;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
+
+// Shadows
+#define CascadeCount 4
+uniform sampler2DShadow shadowMap;
+uniform mat4 cascadeMatrices[CascadeCount];
+uniform float cascadeSplits[CascadeCount];
+
+// Cheapest first, in depth compares: 0 bilinear tap (4), 1 tent of four gathers (16), 2 Poisson 8 (32), 3 Poisson 16 (64), 4 EVSM
+uniform int shadowKernel;
+uniform float shadowFilterRadius;
+uniform float shadowBias;
+uniform float shadowSlopeBias;
+
+// Blurred EVSM moments, same atlas layout as the shadow map
+uniform sampler2D shadowMoments;
+uniform vec2 shadowExponents;
+uniform float shadowBleedReduction;
+
+const vec2 PoissonDisk[16] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+    vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+    vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790));
+
+// Upper bound on the lit fraction from the mean and variance of the occluder depth
+float ChebyshevUpperBound(vec2 moments, float mean, float minVariance)
+{
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = mean - moments.x;
+    float pMax = variance / (variance + d * d);
+
+    return mean <= moments.x ? 1.0 : pMax;
+}
+
+float EVSMLookup(vec2 uv, vec2 gradX, vec2 gradY, float depth)
+{
+    vec4 moments = textureGrad(shadowMoments, uv, gradX, gradY);
+
+    depth = depth * 2.0 - 1.0;
+    float positive = exp(shadowExponents.x * depth);
+    float negative = -exp(-shadowExponents.y * depth);
+
+    // Minimum variance scaled by the warp's slope
+    float positiveVariance = 0.0001 * pow(shadowExponents.x * positive, 2.0);
+    float negativeVariance = 0.0001 * pow(shadowExponents.y * negative, 2.0);
+    float lit = min(ChebyshevUpperBound(moments.xy, positive, positiveVariance), ChebyshevUpperBound(moments.zw, negative, negativeVariance));
+
+    // Cut off the low tail where light bleeds through overlapping occluders
+    return clamp((lit - shadowBleedReduction) / (1.0 - shadowBleedReduction), 0.0, 1.0);
+}
+
+float ShadowCalculation(vec3 position, vec3 normal)
+{
+    // Derivatives before any early out, cascade matrices are orthographic so these map straight to the atlas
+    vec3 positionDx = dFdx(position);
+    vec3 positionDy = dFdy(position);
+
+    // Pick the cascade by view depth, nothing past the last split is shadowed
+    float viewDepth = (view * vec4(position, 1.0)).z;
+    int cascade = 0;
+    while (cascade < CascadeCount && viewDepth > cascadeSplits[cascade])
+    {
+        cascade++;
+    }
+    if (cascade == CascadeCount)
+    {
+        return 0.0;
+    }
+
+    vec4 fragPosLight = cascadeMatrices[cascade] * vec4(position, 1.0);
+    vec3 projCoords = fragPosLight.xyz / fragPosLight.w;
+    // transform to [0,1] range
+    projCoords = projCoords * 0.5 + 0.5;
+
+    // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
+    if(projCoords.z > 1.0)
+        return 0.0;
+
+    // get depth of current fragment from light's perspective
+    float currentDepth = projCoords.z;
+    // calculate bias (based on depth map resolution and slope), larger cascades have larger texels
+    vec3 lightDir = normalize(-directionalLights[0].direction);
+    float bias = max(shadowSlopeBias * (1.0 - dot(normal, lightDir)), shadowBias) * (1.0 + cascade);
+
+    // Cascades are laid out as a 2x2 atlas, keep taps inside this cascade's quadrant
+    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
+    vec2 quadrant = vec2(cascade % 2, cascade / 2) * 0.5;
+    vec2 quadrantMin = quadrant + texelSize;
+    vec2 quadrantMax = quadrant + 0.5 - texelSize;
+    vec2 uv = quadrant + projCoords.xy * 0.5;
+
+    // Compares are done by the sampler, every tap is already a bilinear 2x2 PCF
+    float reference = currentDepth - bias;
+    float lit = 0.0;
+    if (shadowKernel == 0)
+    {
+        lit = texture(shadowMap, vec3(clamp(uv, quadrantMin, quadrantMax), reference));
+    }
+    else if (shadowKernel == 1)
+    {
+        // Tent over 3x3 texels, the 4x4 block it touches is four gathers with the bilinear fraction on the edge texels
+        vec2 texel = uv / texelSize - 0.5;
+        vec2 base = floor(texel);
+        vec2 f = texel - base;
+        vec4 weightX = vec4(1.0 - f.x, 1.0, 1.0, f.x);
+        vec4 weightY = vec4(1.0 - f.y, 1.0, 1.0, f.y);
+        for (int i = 0; i < 4; i++)
+        {
+            // Gather returns (x0 y1, x1 y1, x1 y0, x0 y0) around the texel corner it is centered on
+            ivec2 block = ivec2(i % 2, i / 2) * 2;
+            vec2 corner = (base + vec2(block)) * texelSize;
+            vec4 taps = textureGather(shadowMap, clamp(corner, quadrantMin, quadrantMax), reference);
+            vec2 x = vec2(weightX[block.x], weightX[block.x + 1]);
+            vec2 y = vec2(weightY[block.y], weightY[block.y + 1]);
+            lit += dot(taps, vec4(x.x * y.y, x.y * y.y, x.y * y.x, x.x * y.x));
+        }
+        lit /= 9.0;
+    }
+    else if (shadowKernel == 4)
+    {
+        // Quarter scale, [-1,1] to [0,1] and then into the quadrant
+        vec2 gradX = (mat3(cascadeMatrices[cascade]) * positionDx).xy * 0.25;
+        vec2 gradY = (mat3(cascadeMatrices[cascade]) * positionDy).xy * 0.25;
+        lit = EVSMLookup(clamp(uv, quadrantMin, quadrantMax), gradX, gradY, reference);
+    }
+    else
+    {
+        // Poisson disk rotated per pixel, the noise turns banding into grain
+        int tapCount = shadowKernel == 2 ? 8 : 16;
+        float angle = 6.283185 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+        mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+        for (int i = 0; i < tapCount; i++)
+        {
+            // The 8 tap kernel uses every other sample so it still covers the whole disk
+            vec2 offset = rotation * PoissonDisk[shadowKernel == 2 ? i * 2 : i] * shadowFilterRadius * texelSize;
+            lit += texture(shadowMap, vec3(clamp(uv + offset, quadrantMin, quadrantMax), reference));
+        }
+        lit /= float(tapCount);
+    }
+
+    return 1.0 - lit;
+}
+
+// Crossfade with the lite material
+uniform float ditherFade = 1.0;
+uniform bool isDitherInverted = false;
+
 const float PI = 3.14159265359;
 
-// Trick to get tangent-normals to world-space
+// Ordered 4x4 threshold, complementary halves are drawn by the two shading LODs
+float BayerThreshold()
+{
+    const float bayer[16] = float[](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+}
+
+// Tangent-normals to world-space with the vertex tangent frame
 vec3 GetNormalFromMap()
 {
     vec3 tangentNormal = texture(normalMap, fs_in.texCoords).xyz * 2.0 - 1.0;
 
-    vec3 Q1 = dFdx(fs_in.position);
-    vec3 Q2 = dFdy(fs_in.position);
-    vec2 st1 = dFdx(fs_in.texCoords);
-    vec2 st2 = dFdy(fs_in.texCoords);
-
+    // Tangent goes through the model matrix and the normal through its inverse transpose, so a scaled entity bends them apart
     vec3 N = normalize(fs_in.normal);
-    vec3 T = normalize(Q1*st2.t - Q2*st1.t);
-    vec3 B = -normalize(cross(N, T));
-    mat3 TBN = mat3(T, B, N);
+    vec3 T = normalize(fs_in.tangent.xyz - N * dot(N, fs_in.tangent.xyz));
+    vec3 B = fs_in.tangent.w * cross(N, T);
 
-    return normalize(TBN * tangentNormal);
+    return normalize(mat3(T, B, N) * tangentNormal);
+}
+
+// Offset and count of the lights touching this fragment's cluster
+uvec2 GetCluster()
+{
+    float viewDepth = (view * vec4(fs_in.position, 1.0)).z;
+    uint slice = min(uint(max(log(viewDepth) * clusterSliceScale + clusterSliceBias, 0.0)), uint(GRID_Z - 1));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterScreenSize * vec2(GRID_X, GRID_Y)), uvec2(GRID_X - 1, GRID_Y - 1));
+
+    return lightGrid[tile.x + GRID_X * (tile.y + GRID_Y * slice)];
+}
+
+// Inverse square falloff windowed to reach zero at the range
+float Attenuation(float distance, float range)
+{
+    float ratio = distance / range;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+
+    return window * window / max(distance * distance, 0.0001);
 }
 
 float DistributionGGX(vec3 N, vec3 H, float roughness)
@@ -116,17 +366,66 @@ vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
     return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
 }  
 
-float near = 0.1; 
-float far  = 10.0; 
+// Octahedral normal remapped to [0, 1] for the RG16 target
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    vec2 encoded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+
+    return encoded * 0.5 + 0.5;
+}
+
+// Sky diffuse irradiance as L2 SH, already cosine convolved and divided by pi
+layout (std140) uniform SkyLight
+{
+    vec4 skyIrradiance[9];
+};
 
-float LinearizeDepth(float depth) 
+vec3 SkyIrradiance(vec3 N)
 {
-    float z = depth * 2.0 - 1.0; // back to NDC 
-    return (2.0 * near * far) / (far + near - z * (far - near));	
+    vec3 irradiance = skyIrradiance[0].rgb * 0.282095
+        + (skyIrradiance[1].rgb * N.y + skyIrradiance[2].rgb * N.z + skyIrradiance[3].rgb * N.x) * 0.488603
+        + (skyIrradiance[4].rgb * N.x * N.y + skyIrradiance[5].rgb * N.y * N.z + skyIrradiance[7].rgb * N.x * N.z) * 1.092548
+        + skyIrradiance[6].rgb * 0.315392 * (3.0 * N.z * N.z - 1.0)
+        + skyIrradiance[8].rgb * 0.546274 * (N.x * N.x - N.y * N.y);
+
+    return max(irradiance, vec3(0.0));
+}
+
+vec3 ProbeIrradiance(vec3 position, vec3 N)
+{
+    // Probes sit on texel centers, clamping half a texel in keeps the filter inside one coefficient's block
+    vec3 cell = clamp((position - probeVolumeMin) / probeVolumeSize * (probeResolution - 1.0) + 0.5, vec3(0.5), probeResolution - 0.5);
+
+    float basis[9];
+    basis[0] = 0.282095;
+    basis[1] = 0.488603 * N.y;
+    basis[2] = 0.488603 * N.z;
+    basis[3] = 0.488603 * N.x;
+    basis[4] = 1.092548 * N.x * N.y;
+    basis[5] = 1.092548 * N.y * N.z;
+    basis[6] = 0.315392 * (3.0 * N.z * N.z - 1.0);
+    basis[7] = 1.092548 * N.x * N.z;
+    basis[8] = 0.546274 * (N.x * N.x - N.y * N.y);
+
+    vec3 irradiance = vec3(0.0);
+    for (int i = 0; i < 9; i++)
+    {
+        vec3 uvw = vec3(cell.x + i * probeResolution.x, cell.y, cell.z) / vec3(probeResolution.x * 9.0, probeResolution.yz);
+        irradiance += texture(probeVolume, uvw).rgb * basis[i];
+    }
+
+    return max(irradiance, vec3(0.0));
 }
 
 void main()
 {		
+    if ((BayerThreshold() < ditherFade) == isDitherInverted)
+    {
+        discard;
+    }
+
     // Sample each PBR texture
     vec3 albedo = pow(texture(albedoMap, fs_in.texCoords).rgb, vec3(2.2));
     float metallic = texture(metallicMap, fs_in.texCoords).r;
@@ -142,16 +441,22 @@ void main()
     vec3 F0 = vec3(0.04); 
     F0 = mix(F0, albedo, metallic);
 	           
+    // The lightmap already holds direct diffuse, lights only add specular
+    float directDiffuse = isLightmapped ? 0.0 : 1.0;
+
     // Reflectance equation
     vec3 Lo = vec3(0.0);
-    for(int i = 0; i < PointLightCount; ++i) 
+    uvec2 cluster = GetCluster();
+    for(uint c = 0; c < cluster.y; ++c) 
     {
+        PointLight light = pointLights[lightIndices[cluster.x + c]];
+
         // Calculate per-light radiance
-        vec3 L = normalize(pointLights[i].position - fs_in.position);
+        vec3 L = normalize(light.positionRange.xyz - fs_in.position);
         vec3 H = normalize(V + L);
-        float distance = length(pointLights[i].position - fs_in.position);
-        float attenuation = 1.0 / (distance * distance);
-        vec3 radiance = pointLights[i].color * attenuation;        
+        float distance = length(light.positionRange.xyz - fs_in.position);
+        float attenuation = Attenuation(distance, light.positionRange.w);
+        vec3 radiance = light.colorIntensity.rgb * attenuation * (1.0 - PointShadowCalculation(light, fs_in.position, normalize(fs_in.normal)));
         
         // Cook-Torrance BRDF
         float NDF = DistributionGGX(N, H, roughness);   
@@ -177,7 +482,7 @@ void main()
         float NdotL = max(dot(N, L), 0.0);   
         
         // add to outgoing radiance Lo
-        Lo += (kD * albedo / PI + specular) * radiance * NdotL; 
+        Lo += (kD * albedo / PI * directDiffuse + specular) * radiance * NdotL; 
     }   
 
     for(int i = 0; i < DirectionalLightCount; ++i) 
@@ -186,8 +491,12 @@ void main()
         vec3 L = normalize(-directionalLights[i].direction);
         vec3 H = normalize(V + L);
         
-        // No attenuation
-        vec3 radiance = directionalLights[i].color;    
+        // No attenuation, only the first light casts the cascades
+        vec3 radiance = directionalLights[i].color * directionalLights[i].intensity;
+        if (i == 0)
+        {
+            radiance *= 1.0 - ShadowCalculation(fs_in.position, normalize(fs_in.normal));
+        }
         
         // Cook-Torrance BRDF
         float NDF = DistributionGGX(N, H, roughness);   
@@ -213,7 +522,7 @@ void main()
         float NdotL = max(dot(N, L), 0.0);   
         
         // Add to outgoing radiance Lo
-        Lo += (kD * albedo / PI + specular) * radiance * NdotL; 
+        Lo += (kD * albedo / PI * directDiffuse + specular) * radiance * NdotL; 
     }
 
     // Ambient lighting (IBL)
@@ -223,7 +532,20 @@ void main()
     vec3 kD = 1.0 - kS;
     kD *= 1.0 - metallic;	  
     
-    vec3 irradiance = texture(irradianceMap, N).rgb;
+    // Diffuse ambient is irradiance over pi, like the sky SH
+    vec3 irradiance;
+    if (isLightmapped)
+    {
+        irradiance = texture(lightmap, lightmapCoords).rgb / PI;
+    }
+    else if (isProbeLit)
+    {
+        irradiance = ProbeIrradiance(fs_in.position, N) / PI;
+    }
+    else
+    {
+        irradiance = SkyIrradiance(N);
+    }
     vec3 diffuse = irradiance * albedo;
 
     // sample both the pre-filter map and the BRDF lut and combine them together as per the Split-Sum approximation to get the IBL specular part.
@@ -242,8 +564,7 @@ void main()
     color = pow(color, vec3(1.0/2.2)); 
 
     FragColor = vec4(color, 1.0);
-    FragNormal = vec4(N, 1.0);
-    FragDepth = vec4(vec3(LinearizeDepth(gl_FragCoord.z) / far), 1.0);
-    //FragColor = vec4(texture(irradianceMap, N).rgb, 1.0); // Debug irradiance
+    FragNormal = EncodeNormal(N);
+    //FragColor = vec4(SkyIrradiance(N), 1.0); // Debug irradiance
     //FragColor = vec4(textureLod(specularMap, R,  roughness * MAX_REFLECTION_LOD).rgb, 1.0); // debug specular
 } 
\ No newline at end of file
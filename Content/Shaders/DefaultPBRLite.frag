@@ -0,0 +1,166 @@
+#version 330 core
+
+// Light count, the renderer uploads the strongest lights at the entity first
+#define DirectionalLightCount 1
+#define PointLightCount 2
+
+in VS_OUT 
+{
+    vec3 position;
+    vec3 normal;
+    vec2 texCoords;
+    vec4 fragPosLightSpace;
+    vec4 tangent;
+} fs_in;
+
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec2 FragNormal;
+
+struct DirectionalLight 
+{
+    vec3 direction;
+    vec3 color;
+
+    float intensity;
+};  
+
+struct PointLight 
+{
+    vec3 position;
+    vec3 color;
+
+    float intensity;
+    float range;
+}; 
+
+uniform vec3 camPos;
+
+// PBR textures, no normal map at this distance
+uniform sampler2D albedoMap;
+uniform sampler2D metallicMap;
+uniform sampler2D roughnessMap;
+
+// Ambient comes from irradiance alone
+// Sky diffuse irradiance as L2 SH, already cosine convolved and divided by pi
+layout (std140) uniform SkyLight
+{
+    vec4 skyIrradiance[9];
+};
+
+vec3 SkyIrradiance(vec3 N)
+{
+    vec3 irradiance = skyIrradiance[0].rgb * 0.282095
+        + (skyIrradiance[1].rgb * N.y + skyIrradiance[2].rgb * N.z + skyIrradiance[3].rgb * N.x) * 0.488603
+        + (skyIrradiance[4].rgb * N.x * N.y + skyIrradiance[5].rgb * N.y * N.z + skyIrradiance[7].rgb * N.x * N.z) * 1.092548
+        + skyIrradiance[6].rgb * 0.315392 * (3.0 * N.z * N.z - 1.0)
+        + skyIrradiance[8].rgb * 0.546274 * (N.x * N.x - N.y * N.y);
+
+    return max(irradiance, vec3(0.0));
+}
+
+// Lighting
+uniform PointLight pointLights[PointLightCount];
+uniform DirectionalLight directionalLights[DirectionalLightCount];
+
+// Crossfade with the full material
+uniform float ditherFade = 1.0;
+uniform bool isDitherInverted = false;
+
+const float PI = 3.14159265359;
+
+// Ordered 4x4 threshold, complementary halves are drawn by the two shading LODs
+float BayerThreshold()
+{
+    const float bayer[16] = float[](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+}
+
+// Blinn-Phong normalized for roughness, cheaper than the full Cook-Torrance terms
+vec3 Shade(vec3 N, vec3 V, vec3 L, vec3 radiance, vec3 albedo, vec3 F0, float metallic, float roughness)
+{
+    vec3 H = normalize(V + L);
+    float NdotL = max(dot(N, L), 0.0);
+
+    float a = max(roughness * roughness, 0.002);
+    float power = 2.0 / (a * a) - 2.0;
+    float specular = (power + 8.0) / (8.0 * PI) * pow(max(dot(N, H), 0.0), power);
+
+    vec3 F = F0 + (1.0 - F0) * pow(1.0 - max(dot(H, V), 0.0), 5.0);
+    vec3 kD = (vec3(1.0) - F) * (1.0 - metallic);
+
+    return (kD * albedo / PI + F * specular) * radiance * NdotL;
+}
+
+// Analytic fit of the split sum BRDF, replaces the specular map and LUT lookups
+vec3 EnvironmentBRDF(vec3 F0, float roughness, float NdotV)
+{
+    const vec4 c0 = vec4(-1.0, -0.0275, -0.572, 0.022);
+    const vec4 c1 = vec4(1.0, 0.0425, 1.04, -0.04);
+    vec4 r = roughness * c0 + c1;
+    float a004 = min(r.x * r.x, exp2(-9.28 * NdotV)) * r.x + r.y;
+    vec2 AB = vec2(-1.04, 1.04) * a004 + r.zw;
+    return F0 * AB.x + AB.y;
+}
+
+// Octahedral normal remapped to [0, 1] for the RG16 target
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    vec2 encoded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+
+    return encoded * 0.5 + 0.5;
+}
+
+void main()
+{
+    if ((BayerThreshold() < ditherFade) == isDitherInverted)
+    {
+        discard;
+    }
+
+    // Sample each PBR texture
+    vec3 albedo = pow(texture(albedoMap, fs_in.texCoords).rgb, vec3(2.2));
+    float metallic = texture(metallicMap, fs_in.texCoords).r;
+    float roughness = texture(roughnessMap, fs_in.texCoords).r;
+
+    // Vertex normal only
+    vec3 N = normalize(fs_in.normal);
+    vec3 V = normalize(camPos - fs_in.position);
+    float NdotV = max(dot(N, V), 0.0);
+
+    vec3 F0 = mix(vec3(0.04), albedo, metallic);
+
+    vec3 Lo = vec3(0.0);
+    for(int i = 0; i < PointLightCount; ++i) 
+    {
+        vec3 toLight = pointLights[i].position - fs_in.position;
+        float distance = length(toLight);
+        float ratio = distance / pointLights[i].range;
+        float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+        vec3 radiance = pointLights[i].color * window * window / max(distance * distance, 0.0001);
+
+        Lo += Shade(N, V, toLight / distance, radiance, albedo, F0, metallic, roughness);
+    }
+
+    for(int i = 0; i < DirectionalLightCount; ++i) 
+    {
+        Lo += Shade(N, V, normalize(-directionalLights[i].direction), directionalLights[i].color * directionalLights[i].intensity, albedo, F0, metallic, roughness);
+    }
+
+    // Pre-integrated ambient, irradiance stands in for the blurred reflection too
+    vec3 irradiance = SkyIrradiance(N);
+    vec3 specular = EnvironmentBRDF(F0, roughness, NdotV);
+    vec3 kD = (vec3(1.0) - specular) * (1.0 - metallic);
+
+    vec3 color = irradiance * (kD * albedo + specular) + Lo;
+
+    // HDR tonemapping
+    color = color / (color + vec3(1.0));
+    // Gamma correct
+    color = pow(color, vec3(1.0/2.2)); 
+
+    FragColor = vec4(color, 1.0);
+    FragNormal = EncodeNormal(N);
+}
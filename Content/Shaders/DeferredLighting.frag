@@ -0,0 +1,420 @@
+#version 430 core
+
+// Light count, point lights come from the cluster grid
+#define DirectionalLightCount 1
+
+// Must match LightClusterer
+#define GRID_X 16
+#define GRID_Y 9
+#define GRID_Z 24
+
+in vec2 TexCoords;
+
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec2 FragNormal;
+
+struct DirectionalLight 
+{
+    vec3 direction;
+    vec3 color;
+
+    float intensity;
+};  
+
+struct PointLight 
+{
+    vec4 positionRange;
+    vec4 colorIntensity;
+    vec4 shadow;
+}; 
+
+layout (std430, binding = 8) readonly buffer Lights
+{
+    PointLight pointLights[];
+};
+
+layout (std430, binding = 9) readonly buffer LightGrid
+{
+    uvec2 lightGrid[];
+};
+
+layout (std430, binding = 10) readonly buffer LightIndices
+{
+    uint lightIndices[];
+};
+
+// Point light cube shadows, faces are tiles in one atlas
+struct PointShadow
+{
+    mat4 faceMatrices[6];
+    vec4 faceTiles[6];
+};
+
+layout (std430, binding = 12) readonly buffer PointShadows
+{
+    PointShadow pointShadows[];
+};
+
+uniform sampler2DShadow pointShadowAtlas;
+
+float PointShadowCalculation(PointLight light, vec3 position, vec3 normal)
+{
+    int index = int(light.shadow.x);
+    if (index < 0)
+        return 0.0;
+
+    // Face by major axis, same order as the atlas, +X -X +Y -Y +Z -Z
+    vec3 toFragment = position - light.positionRange.xyz;
+    vec3 absolute = abs(toFragment);
+    int face;
+    if (absolute.x >= absolute.y && absolute.x >= absolute.z)
+        face = toFragment.x > 0.0 ? 0 : 1;
+    else if (absolute.y >= absolute.z)
+        face = toFragment.y > 0.0 ? 2 : 3;
+    else
+        face = toFragment.z > 0.0 ? 4 : 5;
+
+    // Offset along the normal by about a texel, a face is twice the major axis distance across
+    vec4 tile = pointShadows[index].faceTiles[face];
+    float texelWorldSize = 2.0 * max(absolute.x, max(absolute.y, absolute.z)) / tile.w;
+    vec4 clip = pointShadows[index].faceMatrices[face] * vec4(position + normal * texelWorldSize * 1.5, 1.0);
+    vec3 projCoords = clip.xyz / clip.w * 0.5 + 0.5;
+
+    // Bilinear taps stay inside the tile
+    float halfTexel = 0.5 * tile.z / tile.w;
+    vec2 uv = tile.xy + clamp(projCoords.xy * tile.z, vec2(halfTexel), vec2(tile.z - halfTexel));
+
+    return 1.0 - texture(pointShadowAtlas, vec3(uv, projCoords.z - 0.0005));
+}
+
+// G-buffer
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform sampler2D gIrradiance; // rgb ambient diffuse over pi, a 1 when lightmapped
+
+// IBL
+uniform samplerCube specularMap;
+uniform sampler2D BRDFLUT;
+
+uniform vec3 camPos;
+uniform mat4 inverseViewProjection;
+uniform DirectionalLight directionalLights[DirectionalLightCount];
+
+// Cluster lookup
+uniform mat4 view;
+uniform vec2 clusterScreenSize;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
+
+// Shadows
+#define CascadeCount 4
+uniform sampler2DShadow shadowMap;
+uniform mat4 cascadeMatrices[CascadeCount];
+uniform float cascadeSplits[CascadeCount];
+
+// Cheapest first, in depth compares: 0 bilinear tap (4), 1 tent of four gathers (16), 2 Poisson 8 (32), 3 Poisson 16 (64), 4 EVSM
+uniform int shadowKernel;
+uniform float shadowFilterRadius;
+uniform float shadowBias;
+uniform float shadowSlopeBias;
+
+// Blurred EVSM moments, same atlas layout as the shadow map
+uniform sampler2D shadowMoments;
+uniform vec2 shadowExponents;
+uniform float shadowBleedReduction;
+
+const vec2 PoissonDisk[16] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+    vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+    vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790));
+
+// Upper bound on the lit fraction from the mean and variance of the occluder depth
+float ChebyshevUpperBound(vec2 moments, float mean, float minVariance)
+{
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = mean - moments.x;
+    float pMax = variance / (variance + d * d);
+
+    return mean <= moments.x ? 1.0 : pMax;
+}
+
+float EVSMLookup(vec2 uv, vec2 gradX, vec2 gradY, float depth)
+{
+    vec4 moments = textureGrad(shadowMoments, uv, gradX, gradY);
+
+    depth = depth * 2.0 - 1.0;
+    float positive = exp(shadowExponents.x * depth);
+    float negative = -exp(-shadowExponents.y * depth);
+
+    // Minimum variance scaled by the warp's slope
+    float positiveVariance = 0.0001 * pow(shadowExponents.x * positive, 2.0);
+    float negativeVariance = 0.0001 * pow(shadowExponents.y * negative, 2.0);
+    float lit = min(ChebyshevUpperBound(moments.xy, positive, positiveVariance), ChebyshevUpperBound(moments.zw, negative, negativeVariance));
+
+    // Cut off the low tail where light bleeds through overlapping occluders
+    return clamp((lit - shadowBleedReduction) / (1.0 - shadowBleedReduction), 0.0, 1.0);
+}
+
+float ShadowCalculation(vec3 position, vec3 normal)
+{
+    // Derivatives before any early out, cascade matrices are orthographic so these map straight to the atlas
+    vec3 positionDx = dFdx(position);
+    vec3 positionDy = dFdy(position);
+
+    // Pick the cascade by view depth, nothing past the last split is shadowed
+    float viewDepth = (view * vec4(position, 1.0)).z;
+    int cascade = 0;
+    while (cascade < CascadeCount && viewDepth > cascadeSplits[cascade])
+    {
+        cascade++;
+    }
+    if (cascade == CascadeCount)
+    {
+        return 0.0;
+    }
+
+    vec4 fragPosLight = cascadeMatrices[cascade] * vec4(position, 1.0);
+    vec3 projCoords = fragPosLight.xyz / fragPosLight.w;
+    // transform to [0,1] range
+    projCoords = projCoords * 0.5 + 0.5;
+
+    // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
+    if(projCoords.z > 1.0)
+        return 0.0;
+
+    // get depth of current fragment from light's perspective
+    float currentDepth = projCoords.z;
+    // calculate bias (based on depth map resolution and slope), larger cascades have larger texels
+    vec3 lightDir = normalize(-directionalLights[0].direction);
+    float bias = max(shadowSlopeBias * (1.0 - dot(normal, lightDir)), shadowBias) * (1.0 + cascade);
+
+    // Cascades are laid out as a 2x2 atlas, keep taps inside this cascade's quadrant
+    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
+    vec2 quadrant = vec2(cascade % 2, cascade / 2) * 0.5;
+    vec2 quadrantMin = quadrant + texelSize;
+    vec2 quadrantMax = quadrant + 0.5 - texelSize;
+    vec2 uv = quadrant + projCoords.xy * 0.5;
+
+    // Compares are done by the sampler, every tap is already a bilinear 2x2 PCF
+    float reference = currentDepth - bias;
+    float lit = 0.0;
+    if (shadowKernel == 0)
+    {
+        lit = texture(shadowMap, vec3(clamp(uv, quadrantMin, quadrantMax), reference));
+    }
+    else if (shadowKernel == 1)
+    {
+        // Tent over 3x3 texels, the 4x4 block it touches is four gathers with the bilinear fraction on the edge texels
+        vec2 texel = uv / texelSize - 0.5;
+        vec2 base = floor(texel);
+        vec2 f = texel - base;
+        vec4 weightX = vec4(1.0 - f.x, 1.0, 1.0, f.x);
+        vec4 weightY = vec4(1.0 - f.y, 1.0, 1.0, f.y);
+        for (int i = 0; i < 4; i++)
+        {
+            // Gather returns (x0 y1, x1 y1, x1 y0, x0 y0) around the texel corner it is centered on
+            ivec2 block = ivec2(i % 2, i / 2) * 2;
+            vec2 corner = (base + vec2(block)) * texelSize;
+            vec4 taps = textureGather(shadowMap, clamp(corner, quadrantMin, quadrantMax), reference);
+            vec2 x = vec2(weightX[block.x], weightX[block.x + 1]);
+            vec2 y = vec2(weightY[block.y], weightY[block.y + 1]);
+            lit += dot(taps, vec4(x.x * y.y, x.y * y.y, x.y * y.x, x.x * y.x));
+        }
+        lit /= 9.0;
+    }
+    else if (shadowKernel == 4)
+    {
+        // Quarter scale, [-1,1] to [0,1] and then into the quadrant
+        vec2 gradX = (mat3(cascadeMatrices[cascade]) * positionDx).xy * 0.25;
+        vec2 gradY = (mat3(cascadeMatrices[cascade]) * positionDy).xy * 0.25;
+        lit = EVSMLookup(clamp(uv, quadrantMin, quadrantMax), gradX, gradY, reference);
+    }
+    else
+    {
+        // Poisson disk rotated per pixel, the noise turns banding into grain
+        int tapCount = shadowKernel == 2 ? 8 : 16;
+        float angle = 6.283185 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+        mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+        for (int i = 0; i < tapCount; i++)
+        {
+            // The 8 tap kernel uses every other sample so it still covers the whole disk
+            vec2 offset = rotation * PoissonDisk[shadowKernel == 2 ? i * 2 : i] * shadowFilterRadius * texelSize;
+            lit += texture(shadowMap, vec3(clamp(uv + offset, quadrantMin, quadrantMax), reference));
+        }
+        lit /= float(tapCount);
+    }
+
+    return 1.0 - lit;
+}
+
+const float PI = 3.14159265359;
+
+// Offset and count of the lights touching this pixel's cluster
+uvec2 GetCluster(vec3 position)
+{
+    float viewDepth = (view * vec4(position, 1.0)).z;
+    uint slice = min(uint(max(log(viewDepth) * clusterSliceScale + clusterSliceBias, 0.0)), uint(GRID_Z - 1));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterScreenSize * vec2(GRID_X, GRID_Y)), uvec2(GRID_X - 1, GRID_Y - 1));
+
+    return lightGrid[tile.x + GRID_X * (tile.y + GRID_Y * slice)];
+}
+
+// Inverse square falloff windowed to reach zero at the range
+float Attenuation(float distance, float range)
+{
+    float ratio = distance / range;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+
+    return window * window / max(distance * distance, 0.0001);
+}
+
+float DistributionGGX(vec3 N, vec3 H, float roughness)
+{
+    float a = roughness*roughness;
+    float a2 = a*a;
+    float NdotH = max(dot(N, H), 0.0);
+    float NdotH2 = NdotH*NdotH;
+
+    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+    return a2 / (PI * denom * denom);
+}
+
+float GeometrySchlickGGX(float NdotV, float roughness)
+{
+    float r = (roughness + 1.0);
+    float k = (r*r) / 8.0;
+
+    return NdotV / (NdotV * (1.0 - k) + k);
+}
+
+float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
+{
+    return GeometrySchlickGGX(max(dot(N, V), 0.0), roughness) * GeometrySchlickGGX(max(dot(N, L), 0.0), roughness);
+}
+
+vec3 fresnelSchlick(float cosTheta, vec3 F0)
+{
+    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+
+vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
+{
+    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}  
+
+// Cook-Torrance for a single light, directDiffuse is zero where a lightmap already holds it
+vec3 Shade(vec3 N, vec3 V, vec3 L, vec3 radiance, vec3 albedo, vec3 F0, float metallic, float roughness, float directDiffuse)
+{
+    vec3 H = normalize(V + L);
+
+    float NDF = DistributionGGX(N, H, roughness);   
+    float G = GeometrySmith(N, V, L, roughness);      
+    vec3 F = fresnelSchlick(max(dot(H, V), 0.0), F0);
+
+    vec3 specular = NDF * G * F / (4 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + 0.0001);
+    vec3 kD = (vec3(1.0) - F) * (1.0 - metallic);
+
+    return (kD * albedo / PI * directDiffuse + specular) * radiance * max(dot(N, L), 0.0);
+}
+
+// Octahedral normal remapped to [0, 1] for the RG16 target
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    vec2 encoded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+
+    return encoded * 0.5 + 0.5;
+}
+
+vec3 DecodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+
+    return normalize(n);
+}
+
+void main()
+{
+    // Nothing was drawn here, leave it for the sky
+    float depth = texture(gDepth, TexCoords).r;
+    if (depth >= 1.0)
+    {
+        discard;
+    }
+
+    vec4 surface = texture(gNormal, TexCoords);
+
+    vec3 albedo = pow(texture(gAlbedo, TexCoords).rgb, vec3(2.2));
+    vec3 N = DecodeNormal(surface.rg);
+    float roughness = surface.b;
+    float metallic = surface.a;
+
+    // World position from depth
+    vec4 world = inverseViewProjection * vec4(vec3(TexCoords, depth) * 2.0 - 1.0, 1.0);
+    vec3 position = world.xyz / world.w;
+
+    vec3 V = normalize(camPos - position);
+    vec3 R = reflect(-V, N); 
+    vec3 F0 = mix(vec3(0.04), albedo, metallic);
+
+    vec4 irradiance = texture(gIrradiance, TexCoords);
+    float directDiffuse = 1.0 - irradiance.a;
+
+    vec3 Lo = vec3(0.0);
+
+    uvec2 cluster = GetCluster(position);
+    for(uint c = 0; c < cluster.y; ++c) 
+    {
+        PointLight light = pointLights[lightIndices[cluster.x + c]];
+
+        vec3 toLight = light.positionRange.xyz - position;
+        float distance = length(toLight);
+        vec3 radiance = light.colorIntensity.rgb * Attenuation(distance, light.positionRange.w) * (1.0 - PointShadowCalculation(light, position, N));
+
+        Lo += Shade(N, V, toLight / distance, radiance, albedo, F0, metallic, roughness, directDiffuse);
+    }
+
+    for(int i = 0; i < DirectionalLightCount; ++i) 
+    {
+        // Only the first light casts the cascades
+        vec3 radiance = directionalLights[i].color * directionalLights[i].intensity;
+        if (i == 0)
+        {
+            radiance *= 1.0 - ShadowCalculation(position, N);
+        }
+        Lo += Shade(N, V, normalize(-directionalLights[i].direction), radiance, albedo, F0, metallic, roughness, directDiffuse);
+    }
+
+    // Ambient lighting (IBL)
+    vec3 F = fresnelSchlickRoughness(max(dot(N, V), 0.0), F0, roughness);
+    vec3 kD = (1.0 - F) * (1.0 - metallic);
+
+    vec3 diffuse = irradiance.rgb * albedo;
+
+    const float MAX_REFLECTION_LOD = 4.0;
+    vec3 specularColor = textureLod(specularMap, R,  roughness * MAX_REFLECTION_LOD).rgb;    
+    vec2 brdf  = texture(BRDFLUT, vec2(max(dot(N, V), 0.0), roughness)).rg;
+    vec3 specular = specularColor * (F * brdf.x + brdf.y);
+
+    vec3 color = kD * diffuse + specular + Lo;
+
+    // HDR tonemapping
+    color = color / (color + vec3(1.0));
+    // Gamma correct
+    color = pow(color, vec3(1.0/2.2)); 
+
+    FragColor = vec4(color, 1.0);
+    FragNormal = EncodeNormal(N);
+}
@@ -0,0 +1,6 @@
+#version 330 core
+
+// Depth only, nothing written here so early depth testing stays on
+void main()
+{
+}
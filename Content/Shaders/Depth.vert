@@ -0,0 +1,20 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// Set by the mesh before drawing
+layout (location = 5) in vec4 aPositionScale;
+layout (location = 6) in vec4 aPositionOffset;
+
+// Must match Default.vert exactly so the color pass can test GL_LEQUAL against this depth
+invariant gl_Position;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    vec3 position = aPositionOffset.xyz + aPos * aPositionScale.xyz;
+
+    gl_Position = projection * view * model * vec4(position, 1.0);
+}
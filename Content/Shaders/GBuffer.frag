@@ -0,0 +1,123 @@
+#version 330 core
+
+in VS_OUT 
+{
+    vec3 position;
+    vec3 normal;
+    vec2 texCoords;
+    vec4 fragPosLightSpace;
+    vec4 tangent;
+} fs_in;
+
+in vec2 lightmapCoords;
+
+// Surface only, lighting happens once per pixel afterwards
+layout (location = 0) out vec4 GAlbedo; // rgb albedo
+layout (location = 1) out vec4 GNormal; // rg octahedral normal, b roughness, a metallic
+layout (location = 2) out vec4 GIrradiance; // rgb diffuse ambient over pi, a 1 when lightmapped
+
+uniform sampler2D albedoMap;
+uniform sampler2D normalMap;
+uniform sampler2D roughnessMap;
+uniform sampler2D metallicMap;
+
+// Baked diffuse irradiance for static entities
+uniform bool isLightmapped = false;
+uniform sampler2D lightmap;
+
+// L2 SH irradiance probes, the nine coefficients sit side by side along x
+uniform bool isProbeLit = false;
+uniform sampler3D probeVolume;
+uniform vec3 probeVolumeMin;
+uniform vec3 probeVolumeSize;
+uniform vec3 probeResolution;
+
+const float PI = 3.14159265359;
+
+// Sky diffuse irradiance as L2 SH, already cosine convolved and divided by pi
+layout (std140) uniform SkyLight
+{
+    vec4 skyIrradiance[9];
+};
+
+vec3 SkyIrradiance(vec3 N)
+{
+    vec3 irradiance = skyIrradiance[0].rgb * 0.282095
+        + (skyIrradiance[1].rgb * N.y + skyIrradiance[2].rgb * N.z + skyIrradiance[3].rgb * N.x) * 0.488603
+        + (skyIrradiance[4].rgb * N.x * N.y + skyIrradiance[5].rgb * N.y * N.z + skyIrradiance[7].rgb * N.x * N.z) * 1.092548
+        + skyIrradiance[6].rgb * 0.315392 * (3.0 * N.z * N.z - 1.0)
+        + skyIrradiance[8].rgb * 0.546274 * (N.x * N.x - N.y * N.y);
+
+    return max(irradiance, vec3(0.0));
+}
+
+vec3 ProbeIrradiance(vec3 position, vec3 N)
+{
+    // Probes sit on texel centers, clamping half a texel in keeps the filter inside one coefficient's block
+    vec3 cell = clamp((position - probeVolumeMin) / probeVolumeSize * (probeResolution - 1.0) + 0.5, vec3(0.5), probeResolution - 0.5);
+
+    float basis[9];
+    basis[0] = 0.282095;
+    basis[1] = 0.488603 * N.y;
+    basis[2] = 0.488603 * N.z;
+    basis[3] = 0.488603 * N.x;
+    basis[4] = 1.092548 * N.x * N.y;
+    basis[5] = 1.092548 * N.y * N.z;
+    basis[6] = 0.315392 * (3.0 * N.z * N.z - 1.0);
+    basis[7] = 1.092548 * N.x * N.z;
+    basis[8] = 0.546274 * (N.x * N.x - N.y * N.y);
+
+    vec3 irradiance = vec3(0.0);
+    for (int i = 0; i < 9; i++)
+    {
+        vec3 uvw = vec3(cell.x + i * probeResolution.x, cell.y, cell.z) / vec3(probeResolution.x * 9.0, probeResolution.yz);
+        irradiance += texture(probeVolume, uvw).rgb * basis[i];
+    }
+
+    return max(irradiance, vec3(0.0));
+}
+
+// Tangent-normals to world-space with the vertex tangent frame
+vec3 GetNormalFromMap()
+{
+    vec3 tangentNormal = texture(normalMap, fs_in.texCoords).xyz * 2.0 - 1.0;
+
+    // Same basis as the forward PBR path, Gram-Schmidt the tangent back onto the interpolated normal
+    vec3 N = normalize(fs_in.normal);
+    vec3 T = normalize(fs_in.tangent.xyz - N * dot(N, fs_in.tangent.xyz));
+    vec3 B = fs_in.tangent.w * cross(N, T);
+
+    return normalize(mat3(T, B, N) * tangentNormal);
+}
+
+// Octahedral normal remapped to [0, 1] for the RG16 target
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    vec2 encoded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+
+    return encoded * 0.5 + 0.5;
+}
+
+void main()
+{
+    // Albedo stays gamma encoded, 8 bits are enough that way
+    vec3 N = GetNormalFromMap();
+    GAlbedo = vec4(texture(albedoMap, fs_in.texCoords).rgb, 1.0);
+    GNormal = vec4(EncodeNormal(N), texture(roughnessMap, fs_in.texCoords).r, texture(metallicMap, fs_in.texCoords).r);
+
+    // Same ambient choice as the forward PBR shader
+    if (isLightmapped)
+    {
+        GIrradiance = vec4(texture(lightmap, lightmapCoords).rgb / PI, 1.0);
+    }
+    else if (isProbeLit)
+    {
+        GIrradiance = vec4(ProbeIrradiance(fs_in.position, N) / PI, 0.0);
+    }
+    else
+    {
+        GIrradiance = vec4(SkyIrradiance(N), 0.0);
+    }
+}
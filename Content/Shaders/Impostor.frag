@@ -0,0 +1,123 @@
+#version 330 core
+
+in vec3 objectPosition;
+in vec3 worldPosition;
+flat in vec3 viewDirection;
+flat in mat3 rotation;
+flat in float radius;
+flat in int atlasIndex;
+
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec2 FragNormal;
+
+uniform sampler2DArray atlas;
+uniform int frameCount;
+// Padding around each frame's content as a fraction of the frame
+uniform float frameInset;
+uniform vec3 camPos;
+uniform vec3 lightDirection;
+uniform vec3 lightColor;
+uniform mat4 view;
+uniform mat4 projection;
+
+// Sky diffuse irradiance as L2 SH, already cosine convolved and divided by pi
+layout (std140) uniform SkyLight
+{
+    vec4 skyIrradiance[9];
+};
+
+vec3 SkyIrradiance(vec3 N)
+{
+    vec3 irradiance = skyIrradiance[0].rgb * 0.282095
+        + (skyIrradiance[1].rgb * N.y + skyIrradiance[2].rgb * N.z + skyIrradiance[3].rgb * N.x) * 0.488603
+        + (skyIrradiance[4].rgb * N.x * N.y + skyIrradiance[5].rgb * N.y * N.z + skyIrradiance[7].rgb * N.x * N.z) * 1.092548
+        + skyIrradiance[6].rgb * 0.315392 * (3.0 * N.z * N.z - 1.0)
+        + skyIrradiance[8].rgb * 0.546274 * (N.x * N.x - N.y * N.y);
+
+    return max(irradiance, vec3(0.0));
+}
+
+const float PI = 3.14159265359;
+
+vec2 EncodeOctahedral(vec3 direction)
+{
+    direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+    vec2 encoded = direction.xy;
+    if (direction.z < 0.0)
+    {
+        encoded = (1.0 - abs(direction.yx)) * vec2(direction.x >= 0.0 ? 1.0 : -1.0, direction.y >= 0.0 ? 1.0 : -1.0);
+    }
+
+    return encoded;
+}
+
+vec3 DecodeOctahedral(vec2 encoded)
+{
+    vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (direction.z < 0.0)
+    {
+        direction.xy = (1.0 - abs(direction.yx)) * vec2(direction.x >= 0.0 ? 1.0 : -1.0, direction.y >= 0.0 ? 1.0 : -1.0);
+    }
+
+    return normalize(direction);
+}
+
+void main()
+{
+    // Four nearest frames on the octahedral grid
+    vec2 grid = (EncodeOctahedral(viewDirection) * 0.5 + 0.5) * float(frameCount) - 0.5;
+    vec2 baseFrame = floor(grid);
+    vec2 blend = grid - baseFrame;
+
+    vec4 albedo = vec4(0.0);
+    vec4 normal = vec4(0.0);
+    float depth = 0.0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        vec2 offset = vec2(i & 1, i >> 1);
+        vec2 frame = clamp(baseFrame + offset, vec2(0.0), vec2(frameCount - 1));
+        float weight = (offset.x > 0.5 ? blend.x : 1.0 - blend.x) * (offset.y > 0.5 ? blend.y : 1.0 - blend.y);
+
+        // Same camera basis the frame was baked with
+        vec3 direction = DecodeOctahedral((frame + 0.5) / float(frameCount) * 2.0 - 1.0);
+        vec3 up = abs(direction.y) > 0.99 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+        vec3 right = normalize(cross(up, -direction));
+        up = cross(-direction, right);
+
+        vec2 frameUV = vec2(dot(objectPosition, right), dot(objectPosition, up)) / radius * 0.5 + 0.5;
+        vec3 uv = vec3((frame + frameInset + clamp(frameUV, 0.0, 1.0) * (1.0 - 2.0 * frameInset)) / float(frameCount), 0.0);
+
+        uv.z = float(atlasIndex * 3);
+        albedo += texture(atlas, uv) * weight;
+        uv.z += 1.0;
+        normal += texture(atlas, uv) * weight;
+        uv.z += 1.0;
+        depth += texture(atlas, uv).r * weight;
+    }
+
+    // Outside the silhouette in most frames
+    if (albedo.a < 0.5)
+        discard;
+
+    albedo.rgb = pow(albedo.rgb / albedo.a, vec3(2.2));
+    vec3 N = normalize(rotation * (normal.xyz / normal.a * 2.0 - 1.0));
+
+    // Push the fragment back to where the surface was baked so impostors intersect properly
+    vec3 cameraForward = normalize(worldPosition - camPos);
+    vec3 surfacePosition = worldPosition + cameraForward * (depth / albedo.a * 2.0 - 1.0) * radius;
+    vec4 clip = projection * view * vec4(surfacePosition, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    // Cheap lighting, diffuse from the sun and the sky SH
+    vec3 diffuse = albedo.rgb / PI * lightColor * max(dot(N, -lightDirection), 0.0);
+    vec3 ambient = SkyIrradiance(N) * albedo.rgb;
+    vec3 color = diffuse + ambient;
+
+    // HDR tonemapping and gamma, same as the PBR shader
+    color = color / (color + vec3(1.0));
+    color = pow(color, vec3(1.0/2.2)); 
+
+    FragColor = vec4(color, 1.0);
+    FragNormal = EncodeOctahedral(N) * 0.5 + 0.5;
+}
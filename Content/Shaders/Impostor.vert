@@ -0,0 +1,37 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;
+
+// Per instance
+layout (location = 1) in vec4 aCenterRadius;
+layout (location = 2) in vec4 aRotation0;
+layout (location = 3) in vec4 aRotation1;
+layout (location = 4) in vec4 aRotation2;
+
+out vec3 objectPosition;
+out vec3 worldPosition;
+flat out vec3 viewDirection;
+flat out mat3 rotation;
+flat out float radius;
+flat out int atlasIndex;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 camPos;
+
+void main()
+{
+    rotation = mat3(aRotation0.xyz, aRotation1.xyz, aRotation2.xyz);
+    radius = aCenterRadius.w;
+    atlasIndex = int(aRotation0.w + 0.5);
+
+    // Camera aligned quad around the bounding sphere
+    vec3 cameraRight = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 cameraUp = vec3(view[0][1], view[1][1], view[2][1]);
+    worldPosition = aCenterRadius.xyz + (cameraRight * aCorner.x + cameraUp * aCorner.y) * radius;
+
+    // Frames are picked in object space
+    viewDirection = transpose(rotation) * normalize(camPos - aCenterRadius.xyz);
+    objectPosition = transpose(rotation) * (worldPosition - aCenterRadius.xyz);
+
+    gl_Position = projection * view * vec4(worldPosition, 1.0);
+}
@@ -0,0 +1,35 @@
+#version 330 core
+
+in VS_OUT 
+{
+    vec3 position;
+    vec3 normal;
+    vec2 texCoords;
+    vec4 fragPosLightSpace;
+    vec4 tangent;
+} fs_in;
+
+// One atlas layer each
+layout (location = 0) out vec4 Albedo;
+layout (location = 1) out vec4 Normal;
+layout (location = 2) out vec4 Depth;
+
+uniform sampler2D albedoMap;
+uniform sampler2D normalMap;
+
+void main()
+{
+    // Object space normal with the normal map applied
+    vec3 tangentNormal = texture(normalMap, fs_in.texCoords).xyz * 2.0 - 1.0;
+    // Bake model is translation only, but interpolation still pulls the averaged vertex tangent off the normal
+    vec3 N = normalize(fs_in.normal);
+    vec3 T = normalize(fs_in.tangent.xyz - N * dot(N, fs_in.tangent.xyz));
+    vec3 B = fs_in.tangent.w * cross(N, T);
+    vec3 normal = normalize(mat3(T, B, N) * tangentNormal);
+
+    Albedo = vec4(texture(albedoMap, fs_in.texCoords).rgb, 1.0);
+    Normal = vec4(normal * 0.5 + 0.5, 1.0);
+
+    // Ortho depth is already linear across the bounding sphere
+    Depth = vec4(gl_FragCoord.z, 0.0, 0.0, 1.0);
+}
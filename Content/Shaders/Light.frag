@@ -1,13 +1,11 @@
 #version 330 core
 layout (location = 0) out vec4 FragColor;
-layout (location = 1) out vec4 FragNormal;
-layout (location = 2) out vec4 FragDepth;
+layout (location = 1) out vec2 FragNormal;
 
-uniform vec3 color;
+in vec3 color;
 
 void main()
 {
     FragColor = vec4(color, 1.0);
-    FragNormal = vec4(0, 0, 0, 1);
-    FragDepth = vec4(0, 0, 0, 1);
+    FragNormal = vec2(0.0);
 }
\ No newline at end of file
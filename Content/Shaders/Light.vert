@@ -1,11 +1,37 @@
-#version 330 core
+#version 430 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 model;
+// Set by the mesh before drawing
+layout (location = 5) in vec4 aPositionScale;
+layout (location = 6) in vec4 aPositionOffset;
+
+struct PointLight
+{
+    vec4 positionRange;
+    vec4 colorIntensity;
+    vec4 shadow;
+};
+
+// One instance per light
+layout (std430, binding = 8) readonly buffer Lights
+{
+    PointLight pointLights[];
+};
+
+out vec3 color;
+
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-} 
\ No newline at end of file
+    PointLight light = pointLights[gl_InstanceID];
+
+    // Scale based on range
+    vec3 position = aPositionOffset.xyz + aPos * aPositionScale.xyz;
+    position = light.positionRange.xyz + position * (light.positionRange.w / 10.0);
+
+    color = light.colorIntensity.rgb * light.colorIntensity.w;
+
+    gl_Position = projection * view * vec4(position, 1.0);
+} 
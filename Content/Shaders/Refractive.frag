@@ -6,6 +6,7 @@ in VS_OUT
     vec3 normal;
     vec2 texCoords;
     vec4 fragPosLightSpace;
+    vec4 tangent;
 } fs_in;
 
 out vec4 FragColor;
@@ -0,0 +1,41 @@
+#version 430 core
+in vec2 TexCoords;
+
+const int CASCADE_COUNT = 4;
+
+uniform sampler2D staticDepthMap;
+
+// Cascade clip space to static clip space, both are orthographic along the light
+uniform mat4 cascadeToStatic[CASCADE_COUNT];
+uniform int cascadeSize;
+
+void main()
+{
+	// Cascades sit in a 2x2 atlas, find ours and where in it this texel is
+	ivec2 quadrant = ivec2(gl_FragCoord.xy) / cascadeSize;
+	int cascade = quadrant.y * 2 + quadrant.x;
+	vec2 ndc = (gl_FragCoord.xy / cascadeSize - vec2(quadrant)) * 2.0 - 1.0;
+
+	// Ends of the texel's light ray in the static map
+	vec3 nearPoint = (cascadeToStatic[cascade] * vec4(ndc, -1.0, 1.0)).xyz;
+	vec3 farPoint = (cascadeToStatic[cascade] * vec4(ndc, 1.0, 1.0)).xyz;
+
+	vec2 uv = nearPoint.xy * 0.5 + 0.5;
+	if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0))))
+	{
+		gl_FragDepth = 1.0;
+		return;
+	}
+
+	// Nothing static along this ray
+	float staticDepth = texture(staticDepthMap, uv).r;
+	if (staticDepth >= 1.0)
+	{
+		gl_FragDepth = 1.0;
+		return;
+	}
+
+	// Position of the static caster along the ray is the cascade's window depth
+	float t = (staticDepth * 2.0 - 1.0 - nearPoint.z) / (farPoint.z - nearPoint.z);
+	gl_FragDepth = clamp(t, 0.0, 1.0);
+}
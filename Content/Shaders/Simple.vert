@@ -1,10 +1,16 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
+// Dequantization from the mesh, identity for float vertices
+layout (location = 5) in vec4 aPositionScale;
+layout (location = 6) in vec4 aPositionOffset;
+
 uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    vec3 position = aPositionOffset.xyz + aPos * aPositionScale.xyz;
+
+    gl_Position = lightSpaceMatrix * model * vec4(position, 1.0);
 }  
\ No newline at end of file
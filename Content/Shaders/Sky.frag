@@ -1,7 +1,6 @@
 #version 330 core
 layout (location = 0) out vec4 FragColor;
-layout (location = 1) out vec4 FragNormal;
-layout (location = 2) out vec4 FragDepth;
+layout (location = 1) out vec2 FragNormal;
 
 in vec3 position;
 
@@ -16,6 +15,5 @@ void main()
     //envColor = pow(envColor,vec3(1.0/2.2));
 
     FragColor = vec4(envColor, 1.0);
-    FragNormal = vec4(0, 0, 0, 1);
-    FragDepth = vec4(0, 0, 0, 1);
+    FragNormal = vec2(0.0);
 }
\ No newline at end of file
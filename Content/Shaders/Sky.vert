@@ -1,6 +1,10 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
+// Set by the mesh, scale and offset of packed positions
+layout (location = 5) in vec4 aPositionScale;
+layout (location = 6) in vec4 aPositionOffset;
+
 out vec3 position;
 
 uniform mat4 projection;
@@ -8,8 +12,10 @@ uniform mat4 view;
 
 void main()
 {
-    position = vec3(aPos.x, aPos.z, aPos.y);
-    vec4 clipPos = projection * view * vec4(aPos, 1.0);
+    vec3 localPosition = aPositionOffset.xyz + aPos * aPositionScale.xyz;
+
+    position = vec3(localPosition.x, localPosition.z, localPosition.y);
+    vec4 clipPos = projection * view * vec4(localPosition, 1.0);
 
     // Set z to w so sky vertex is on far clip plane
     gl_Position = clipPos.xyww;
@@ -0,0 +1,183 @@
+// Headless checks for the quadric simplifier behind Mesh::GenerateLODs
+// Makes no GL calls, build it on its own from the repo root with
+//   g++ -std=c++17 -O2 -Iinclude -Isrc Tests/MeshSimplifierTest.cpp src/MeshSimplifier.cpp
+// Returns non zero on a failed check
+
+#include <iostream>
+#include <cmath>
+#include <string>
+
+#include "MeshSimplifier.h"
+
+int failures = 0;
+
+void Check(bool condition, const std::string& message)
+{
+	if (!condition)
+	{
+		std::cout << "ERROR::MESH_SIMPLIFIER_TEST::" << message << std::endl;
+		failures++;
+	}
+}
+
+// Flat grid in xz with an open border
+void BuildGrid(int size, std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+	for (int z = 0; z <= size; z++)
+	{
+		for (int x = 0; x <= size; x++)
+		{
+			Vertex vertex = {};
+			vertex.position = glm::vec3(x, 0.0f, z);
+			vertex.texCoords = glm::vec2(x, z) / (float)size;
+			vertex.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+			vertices.push_back(vertex);
+		}
+	}
+
+	for (int z = 0; z < size; z++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			GLuint i = z * (size + 1) + x;
+			GLuint row = size + 1;
+			indices.insert(indices.end(), { i, i + row, i + 1, i + 1, i + row, i + row + 1 });
+		}
+	}
+}
+
+// UV sphere with seam and pole copies, finely tessellated so there is plenty to remove
+void BuildSphere(int sectorCount, int stackCount, std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+	const float PI = 3.14159265359f;
+
+	for (int i = 0; i <= stackCount; i++)
+	{
+		float stackAngle = PI / 2 - i * PI / stackCount;
+		for (int j = 0; j <= sectorCount; j++)
+		{
+			float sectorAngle = j * 2 * PI / sectorCount;
+			Vertex vertex = {};
+			vertex.position = glm::vec3(cosf(stackAngle) * cosf(sectorAngle), cosf(stackAngle) * sinf(sectorAngle), sinf(stackAngle));
+			vertex.texCoords = glm::vec2((float)j / sectorCount, (float)i / stackCount);
+			vertex.normal = vertex.position;
+			vertices.push_back(vertex);
+		}
+	}
+
+	for (int i = 0; i < stackCount; i++)
+	{
+		for (int j = 0; j < sectorCount; j++)
+		{
+			GLuint k1 = i * (sectorCount + 1) + j;
+			GLuint k2 = k1 + sectorCount + 1;
+			if (i != 0)
+			{
+				indices.insert(indices.end(), { k1, k2, k1 + 1 });
+			}
+			if (i != stackCount - 1)
+			{
+				indices.insert(indices.end(), { k1 + 1, k2, k2 + 1 });
+			}
+		}
+	}
+}
+
+// Indices in range and no triangle turned against the surface
+void CheckResult(const std::string& name, const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+{
+	Check(!indices.empty() && indices.size() % 3 == 0, name + "::EMPTY_OR_PARTIAL");
+
+	for (GLuint index : indices)
+	{
+		if (index >= vertices.size())
+		{
+			Check(false, name + "::INDEX_OUT_OF_RANGE");
+			return;
+		}
+	}
+
+	int facing[3] = {};
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const Vertex& v0 = vertices[indices[i]];
+		const Vertex& v1 = vertices[indices[i + 1]];
+		const Vertex& v2 = vertices[indices[i + 2]];
+
+		glm::vec3 normal = glm::cross(v1.position - v0.position, v2.position - v0.position);
+		float side = glm::dot(normal, v0.normal + v1.normal + v2.normal);
+		facing[side > 0.0f ? 0 : (side < 0.0f ? 1 : 2)]++;
+	}
+
+	// Both generators wind every triangle the same way relative to its normals, so all should still agree
+	Check(facing[1] == 0, name + "::FLIPPED_TRIANGLES " + std::to_string(facing[1]));
+	Check(facing[2] == 0, name + "::DEGENERATE_TRIANGLES " + std::to_string(facing[2]));
+}
+
+int main()
+{
+	// Planar interior collapses for free, the border must survive untouched
+	{
+		std::vector<Vertex> vertices;
+		std::vector<GLuint> indices;
+		BuildGrid(32, vertices, indices);
+
+		std::vector<Vertex> outVertices;
+		std::vector<GLuint> outIndices;
+		MeshSimplifier(vertices, indices).Simplify(indices.size() / 8, outVertices, outIndices);
+		CheckResult("GRID", outVertices, outIndices);
+		Check(outIndices.size() <= indices.size() / 8, "GRID::TARGET_NOT_REACHED " + std::to_string(outIndices.size() / 3));
+
+		int borderCount = 0;
+		for (Vertex& vertex : outVertices)
+		{
+			glm::vec3 p = vertex.position;
+			borderCount += p.x == 0.0f || p.x == 32.0f || p.z == 0.0f || p.z == 32.0f;
+		}
+		Check(borderCount == 32 * 4, "GRID::BORDER_MOVED " + std::to_string(borderCount));
+
+		std::cout << "Grid: " << indices.size() / 3 << " -> " << outIndices.size() / 3 << " triangles" << std::endl;
+	}
+
+	// A LOD chain continues from the previous result and keeps shrinking
+	{
+		std::vector<Vertex> vertices;
+		std::vector<GLuint> indices;
+		BuildSphere(64, 64, vertices, indices);
+
+		MeshSimplifier simplifier(vertices, indices);
+		size_t previousCount = indices.size();
+		std::cout << "Sphere: " << indices.size() / 3;
+
+		for (int lod = 1; lod < 3; lod++)
+		{
+			std::vector<Vertex> outVertices;
+			std::vector<GLuint> outIndices;
+			simplifier.Simplify(previousCount / 3 / 4 * 3, outVertices, outIndices);
+
+			CheckResult("SPHERE_LOD" + std::to_string(lod), outVertices, outIndices);
+			Check(outIndices.size() < previousCount, "SPHERE_LOD" + std::to_string(lod) + "::NOT_SIMPLER");
+
+			// Collapses only move onto existing vertices, so everything stays on the sphere
+			for (Vertex& vertex : outVertices)
+			{
+				if (fabsf(glm::length(vertex.position) - 1.0f) > 1e-4f)
+				{
+					Check(false, "SPHERE_LOD" + std::to_string(lod) + "::VERTEX_OFF_SURFACE");
+					break;
+				}
+			}
+
+			previousCount = outIndices.size();
+			std::cout << " -> " << outIndices.size() / 3;
+		}
+		std::cout << " triangles" << std::endl;
+	}
+
+	if (failures == 0)
+	{
+		std::cout << "All simplifier checks passed" << std::endl;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+// Headless check that OcclusionRasterizer gives the same depth for any thread count and never hides a visible box
+// The rasterizer makes no GL calls, build it on its own from the repo root with
+//   g++ -std=c++17 -O2 -Iinclude -Isrc Tests/OcclusionRasterizerTest.cpp src/OcclusionRasterizer.cpp -pthread
+// Returns non zero on a mismatch
+
+#include <iostream>
+#include <random>
+#include <cstring>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "OcclusionRasterizer.h"
+
+const std::vector<GLuint> BOX_INDICES = {
+	0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5,
+	0, 4, 5, 0, 5, 1, 2, 3, 7, 2, 7, 6,
+	0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3 };
+
+void AddBox(OcclusionRasterizer& rasterizer, glm::vec3 center, glm::vec3 extent, glm::mat4 viewProjection)
+{
+	std::vector<Vertex> vertices(8);
+	for (int v = 0; v < 8; v++)
+	{
+		vertices[v].position = center + extent * glm::vec3((v & 1) ? 1.0f : -1.0f, (v & 2) ? 1.0f : -1.0f, (v & 4) ? 1.0f : -1.0f);
+	}
+
+	rasterizer.AddOccluder(vertices, BOX_INDICES, (GLuint)BOX_INDICES.size(), viewProjection);
+}
+
+// Random boxes in front of the camera, some past the screen edges
+void AddScene(OcclusionRasterizer& rasterizer, glm::mat4 viewProjection)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-20.0f, 20.0f);
+	std::uniform_real_distribution<float> size(0.3f, 3.0f);
+
+	for (int i = 0; i < 60; i++)
+	{
+		glm::vec3 center(position(random), position(random) * 0.5f, position(random) + 25.0f);
+		glm::vec3 extent(size(random), size(random), size(random));
+		AddBox(rasterizer, center, extent, viewProjection);
+	}
+}
+
+// Queries behind a single wall, returns the number of wrong answers
+int CheckVisibility(glm::mat4 viewProjection)
+{
+	const int WIDTH = 256;
+	const int HEIGHT = 128;
+	int failures = 0;
+
+	auto expect = [&](const char* name, bool isVisible, bool expected)
+	{
+		if (isVisible != expected)
+		{
+			std::cout << "ERROR::OCCLUSION_RASTERIZER_TEST::" << name << " expected " << (expected ? "visible" : "hidden") << std::endl;
+			failures++;
+		}
+	};
+
+	OcclusionRasterizer rasterizer(WIDTH, HEIGHT, 4);
+	glm::vec3 wallCenter(0.0f, 0.0f, 10.0f);
+	glm::vec3 wallExtent(4.0f, 3.0f, 0.5f);
+	AddBox(rasterizer, wallCenter, wallExtent, viewProjection);
+	rasterizer.Render();
+
+	// Well inside the wall's silhouette, the face diagonals must not leave a crack
+	expect("FULLY_HIDDEN", rasterizer.IsVisible({ glm::vec3(-1.0f, -1.0f, 19.0f), glm::vec3(1.0f, 1.0f, 21.0f) }, viewProjection), false);
+
+	// Half of it sticks out past the right edge
+	expect("PARTIALLY_VISIBLE", rasterizer.IsVisible({ glm::vec3(8.0f, -1.0f, 19.0f), glm::vec3(10.0f, 1.0f, 21.0f) }, viewProjection), true);
+
+	// Corners behind the camera can't be projected, so it has to count as visible
+	expect("STRADDLES_NEAR_PLANE", rasterizer.IsVisible({ glm::vec3(-0.5f, -0.5f, -1.0f), glm::vec3(0.5f, 0.5f, 30.0f) }, viewProjection), true);
+
+	// Pokes out past the wall's right silhouette by a quarter pixel at its nearest face
+	// Point sampling would fill that pixel with the wall whenever its center is covered
+	glm::vec4 edge = viewProjection * glm::vec4(wallCenter.x + wallExtent.x, 0.0f, wallCenter.z - wallExtent.z, 1.0f);
+	float silhouette = (edge.x / edge.w * 0.5f + 0.5f) * WIDTH;
+	float targetNdc = (silhouette + 0.25f) / WIDTH * 2.0f - 1.0f;
+	float right = targetNdc * 19.0f / viewProjection[0][0];
+	expect("SUBPIXEL_SLIVER", rasterizer.IsVisible({ glm::vec3(right - 2.0f, -1.0f, 19.0f), glm::vec3(right, 1.0f, 21.0f) }, viewProjection), true);
+
+	return failures;
+}
+
+int main()
+{
+	glm::mat4 projection = glm::perspectiveLH(glm::radians(60.0f), 2.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAtLH(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 viewProjection = projection * view;
+
+	// Odd sizes so bands and SSE groups don't divide evenly
+	int sizes[][2] = { { 256, 128 }, { 257, 131 }, { 61, 7 } };
+	unsigned int threadCounts[] = { 1, 2, 3, 4, 7, 16, 64 };
+	int failures = 0;
+
+	for (auto& size : sizes)
+	{
+		OcclusionRasterizer reference(size[0], size[1], 1);
+		AddScene(reference, viewProjection);
+		reference.Render();
+		const std::vector<float>& expected = reference.GetDepthBuffer();
+
+		for (unsigned int threadCount : threadCounts)
+		{
+			OcclusionRasterizer rasterizer(size[0], size[1], threadCount);
+
+			// Several frames so the worker pool is reused
+			for (int frame = 0; frame < 3; frame++)
+			{
+				rasterizer.Clear();
+				AddScene(rasterizer, viewProjection);
+				rasterizer.Render();
+
+				const std::vector<float>& depth = rasterizer.GetDepthBuffer();
+				if (depth.size() != expected.size() || memcmp(depth.data(), expected.data(), depth.size() * sizeof(float)) != 0)
+				{
+					std::cout << "ERROR::OCCLUSION_RASTERIZER_TEST::DEPTH_MISMATCH " << size[0] << "x" << size[1]
+						<< " threads " << threadCount << " frame " << frame << std::endl;
+					failures++;
+				}
+			}
+		}
+
+		// Make sure the scene actually covers something
+		int covered = 0;
+		for (float depth : expected)
+		{
+			covered += depth < 1.0f;
+		}
+		std::cout << size[0] << "x" << size[1] << ": " << covered << " of " << expected.size() << " texels covered" << std::endl;
+	}
+
+	failures += CheckVisibility(viewProjection);
+
+	if (failures == 0)
+	{
+		std::cout << "Depth matches for every thread count and every visibility query is conservative" << std::endl;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -22,6 +22,8 @@ public:
 	Transform* GetTransform() { return &transform; }
 	float GetSpeed() { return speed; }
 	float GetSensitivity() { return sensitivity; }
+	float GetNear() { return near; }
+	float GetFar() { return far; }
 
 	// Setters
 	void SetSpeed(float newSpeed) { speed = newSpeed; }
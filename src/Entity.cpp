@@ -12,9 +12,78 @@ Entity::~Entity()
 	delete transform;
 }
 
-void Entity::Draw(Camera* camera)
+void Entity::Draw(Camera* camera, bool isLight)
 {
 	// Sets shader program as active and sets uniforms before drawing
 	//material->PrepareMaterial(transform, camera);
-	mesh->Draw();
-}
\ No newline at end of file
+	if (isLight)
+	{
+		// Depth only, position stream is enough
+		mesh->DrawDepth(shadowLOD);
+	}
+	else
+	{
+		mesh->Draw(cameraLOD);
+	}
+}
+
+void Entity::DrawDepth()
+{
+	mesh->DrawDepth(cameraLOD);
+}
+
+void Entity::SelectLOD(float screenSize, bool isLight)
+{
+	int& lod = isLight ? shadowLOD : cameraLOD;
+	lod = mesh->SelectLOD(screenSize, lod);
+}
+
+void Entity::SelectShadingLOD(float screenSize, float threshold, float fadeStep)
+{
+	if (!material->GetLiteShader())
+	{
+		return;
+	}
+
+	// Hysteresis band so objects sitting on the threshold don't keep restarting the fade
+	if (isShadingLite && screenSize > threshold * (1.0f + SHADING_HYSTERESIS))
+	{
+		isShadingLite = false;
+	}
+	else if (!isShadingLite && screenSize < threshold * (1.0f - SHADING_HYSTERESIS))
+	{
+		isShadingLite = true;
+	}
+
+	shadingFade = glm::clamp(shadingFade + (isShadingLite ? -fadeStep : fadeStep), 0.0f, 1.0f);
+}
+
+AABB Entity::GetWorldAABB()
+{
+	glm::mat4 model = transform->GetModelMatrix();
+	AABB local = mesh->GetAABB();
+
+	// Transform box center and extents, extents use absolute matrix so box stays axis aligned
+	glm::vec3 center = glm::vec3(model * glm::vec4((local.min + local.max) * 0.5f, 1.0f));
+	glm::vec3 extents = (local.max - local.min) * 0.5f;
+
+	glm::mat3 absolute = glm::mat3(model);
+	for (int i = 0; i < 3; i++)
+	{
+		absolute[i] = glm::abs(absolute[i]);
+	}
+	extents = absolute * extents;
+
+	return { center - extents, center + extents };
+}
+
+BoundingSphere Entity::GetWorldBoundingSphere()
+{
+	glm::mat4 model = transform->GetModelMatrix();
+	BoundingSphere local = mesh->GetBoundingSphere();
+
+	// Scale radius by the largest axis scale
+	float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+	return { glm::vec3(model * glm::vec4(local.center, 1.0f)), local.radius * scale };
+}
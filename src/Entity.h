@@ -9,19 +9,53 @@ public:
 	Entity(Mesh* mesh, Material* material);
 	~Entity();
 
-	// Per frame
-	void Draw(Camera* camera);
+	// Per frame, shadow and camera passes keep their own LOD
+	void Draw(Camera* camera, bool isLight = false);
+
+	// Camera LOD with the position only stream, for depth pre-passes
+	void DrawDepth();
+	void SelectLOD(float screenSize, bool isLight);
+
+	// Shading LOD, fades toward the lite material below the threshold, step is the fade per frame
+	void SelectShadingLOD(float screenSize, float threshold, float fadeStep);
 
 	// Getters
 	Mesh* GetMesh() { return mesh; }
 	Transform* GetTransform() { return transform; }
 	Material* GetMaterial() { return material; }
+	int GetLOD(bool isLight) { return isLight ? shadowLOD : cameraLOD; }
+	float GetShadingFade() { return shadingFade; }
+	GLuint GetLightmap() { return lightmap; }
+
+	// Setters
+	void SetLightmap(GLuint texture) { lightmap = texture; }
+
+	// World space bounds
+	AABB GetWorldAABB();
+	BoundingSphere GetWorldBoundingSphere();
 
 	//bool hasOutline = true;
 
+	// Large simple entities that get drawn into the software occlusion buffer
+	bool isOccluder = false;
+
+	// Static casters are cached in the shadow map, anything animated has to clear this
+	bool isStatic = true;
+
 private:
 	Mesh* mesh;
 	Transform* transform;
 	Material* material;
+
+	// Baked diffuse irradiance, owned by the renderer, 0 when not baked
+	GLuint lightmap = 0;
+
+	int cameraLOD = 0;
+	int shadowLOD = 0;
+
+	// 1 is the full material, 0 the lite one, anything between is mid crossfade
+	bool isShadingLite = false;
+	float shadingFade = 1.0f;
+	const float SHADING_HYSTERESIS = 0.15f;
 };
 
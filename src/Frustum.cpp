@@ -0,0 +1,118 @@
+#include "Frustum.h"
+
+Frustum::Frustum()
+{
+	// Planes that contain everything until extracted
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] = glm::vec4(0, 0, 0, 1);
+	}
+}
+
+void Frustum::ExtractPlanes(glm::mat4 viewProjection)
+{
+	// glm is column major, so grab rows
+	glm::vec4 row0 = glm::vec4(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	glm::vec4 row1 = glm::vec4(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	glm::vec4 row2 = glm::vec4(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	glm::vec4 row3 = glm::vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	// Clip space is -w <= x, y, z <= w
+	planes[0] = row3 + row0; // Left
+	planes[1] = row3 - row0; // Right
+	planes[2] = row3 + row1; // Bottom
+	planes[3] = row3 - row1; // Top
+	planes[4] = row3 + row2; // Near
+	planes[5] = row3 - row2; // Far
+
+	// Normalize so distances are in world units
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+bool Frustum::IsSphereVisible(BoundingSphere sphere)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (glm::dot(glm::vec3(planes[i]), sphere.center) + planes[i].w < -sphere.radius)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Frustum::IsAABBVisible(AABB aabb)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		// Test the corner furthest along the plane normal
+		glm::vec3 positive = glm::vec3(
+			planes[i].x >= 0 ? aabb.max.x : aabb.min.x,
+			planes[i].y >= 0 ? aabb.max.y : aabb.min.y,
+			planes[i].z >= 0 ? aabb.max.z : aabb.min.z);
+
+		if (glm::dot(glm::vec3(planes[i]), positive) + planes[i].w < 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Frustum::CullSpheres(const std::vector<BoundingSphere>& spheres, std::vector<unsigned char>& results)
+{
+	results.resize(spheres.size());
+
+	// Splat planes once
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int i = 0; i < 6; i++)
+	{
+		planeX[i] = _mm_set1_ps(planes[i].x);
+		planeY[i] = _mm_set1_ps(planes[i].y);
+		planeZ[i] = _mm_set1_ps(planes[i].z);
+		planeW[i] = _mm_set1_ps(planes[i].w);
+	}
+
+	size_t count = spheres.size();
+	size_t i = 0;
+
+	// Four spheres per iteration
+	for (; i + 4 <= count; i += 4)
+	{
+		const BoundingSphere* s = &spheres[i];
+
+		// Transpose to SoA
+		__m128 x = _mm_setr_ps(s[0].center.x, s[1].center.x, s[2].center.x, s[3].center.x);
+		__m128 y = _mm_setr_ps(s[0].center.y, s[1].center.y, s[2].center.y, s[3].center.y);
+		__m128 z = _mm_setr_ps(s[0].center.z, s[1].center.z, s[2].center.z, s[3].center.z);
+		__m128 negativeRadius = _mm_setr_ps(-s[0].radius, -s[1].radius, -s[2].radius, -s[3].radius);
+
+		// Start all visible, and out any sphere fully behind a plane
+		__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(x, planeX[p]), _mm_mul_ps(y, planeY[p])),
+				_mm_add_ps(_mm_mul_ps(z, planeZ[p]), planeW[p]));
+
+			visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		int mask = _mm_movemask_ps(visible);
+		results[i] = mask & 1;
+		results[i + 1] = (mask >> 1) & 1;
+		results[i + 2] = (mask >> 2) & 1;
+		results[i + 3] = (mask >> 3) & 1;
+	}
+
+	// Leftovers
+	for (; i < count; i++)
+	{
+		results[i] = IsSphereVisible(spheres[i]) ? 1 : 0;
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+
+#include <emmintrin.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+class Frustum
+{
+public:
+	Frustum();
+
+	// Extract the six planes from a view projection matrix, works for perspective and orthographic
+	void ExtractPlanes(glm::mat4 viewProjection);
+
+	// Single tests
+	bool IsSphereVisible(BoundingSphere sphere);
+	bool IsAABBVisible(AABB aabb);
+
+	// Tests spheres four at a time with SSE, writes 1 for visible and 0 for culled
+	void CullSpheres(const std::vector<BoundingSphere>& spheres, std::vector<unsigned char>& results);
+
+	// Getters
+	glm::vec4 GetPlane(unsigned int index) { return planes[index]; }
+
+private:
+	// Left, right, bottom, top, near, far, xyz is the normal pointing inwards and w is the distance
+	glm::vec4 planes[6];
+};
@@ -0,0 +1,237 @@
+#include "ImpostorRenderer.h"
+
+ImpostorRenderer::ImpostorRenderer(Shader* bakeShader, Shader* drawShader, int maxAtlases, int frameCount, int frameSize)
+{
+	this->bakeShader = bakeShader;
+	this->drawShader = drawShader;
+	this->maxAtlases = maxAtlases;
+	this->frameCount = frameCount;
+	this->frameSize = frameSize;
+
+	int atlasSize = frameCount * frameSize;
+
+	// Albedo, normal and depth layers per atlas
+	glGenTextures(1, &atlasTexture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, atlasTexture);
+	int levelCount = 1;
+	while ((atlasSize >> levelCount) > 0)
+	{
+		levelCount++;
+	}
+
+	// Bilinear at level L reaches 2^(L-1) texels past the frame content, stop before it crosses the padding
+	int sampledLevel = 0;
+	while (sampledLevel + 1 < levelCount && (1 << sampledLevel) <= FRAME_PADDING)
+	{
+		sampledLevel++;
+	}
+
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, levelCount, GL_RGBA8, atlasSize, atlasSize, maxAtlases * 3);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, sampledLevel);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glGenFramebuffers(1, &bakeFBO);
+	glGenRenderbuffers(1, &bakeRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, bakeRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasSize, atlasSize);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	// Unit quad corners
+	float corners[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+
+	glGenVertexArrays(1, &quadVAO);
+	glGenBuffers(1, &quadVBO);
+	glGenBuffers(1, &instanceVBO);
+
+	glBindVertexArray(quadVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+
+	// Center and rotation per instance
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	for (int i = 0; i < 4; i++)
+	{
+		glEnableVertexAttribArray(1 + i);
+		glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), (void*)(i * sizeof(glm::vec4)));
+		glVertexAttribDivisor(1 + i, 1);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+ImpostorRenderer::~ImpostorRenderer()
+{
+	glDeleteTextures(1, &atlasTexture);
+	glDeleteFramebuffers(1, &bakeFBO);
+	glDeleteRenderbuffers(1, &bakeRBO);
+	glDeleteVertexArrays(1, &quadVAO);
+	glDeleteBuffers(1, &quadVBO);
+	glDeleteBuffers(1, &instanceVBO);
+}
+
+glm::vec3 ImpostorRenderer::GetFrameDirection(int x, int y)
+{
+	// Frame centers on the full octahedron
+	glm::vec2 encoded = (glm::vec2(x, y) + 0.5f) / (float)frameCount * 2.0f - 1.0f;
+	glm::vec3 direction = glm::vec3(encoded, 1.0f - fabsf(encoded.x) - fabsf(encoded.y));
+
+	if (direction.z < 0.0f)
+	{
+		glm::vec2 folded = (1.0f - glm::abs(glm::vec2(direction.y, direction.x))) * glm::vec2(direction.x >= 0.0f ? 1.0f : -1.0f, direction.y >= 0.0f ? 1.0f : -1.0f);
+		direction.x = folded.x;
+		direction.y = folded.y;
+	}
+
+	return glm::normalize(direction);
+}
+
+void ImpostorRenderer::Bake(Mesh* mesh, Material* material)
+{
+	std::pair<Mesh*, Material*> key = { mesh, material };
+	if (atlasIndices.count(key) || (int)atlasIndices.size() >= maxAtlases)
+	{
+		return;
+	}
+
+	int atlasIndex = atlasIndices.size();
+	atlasIndices[key] = atlasIndex;
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, bakeFBO);
+	for (int i = 0; i < 3; i++)
+	{
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, atlasTexture, 0, atlasIndex * 3 + i);
+	}
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, bakeRBO);
+
+	GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, attachments);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR::FRAMEBUFFER::Impostor framebuffer is not complete!" << std::endl;
+	}
+
+	// Zero alpha marks empty texels
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+
+	BoundingSphere sphere = mesh->GetBoundingSphere();
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), -sphere.center);
+
+	// Ortho box from the eye on the sphere to the far side, depth is then linear across the diameter
+	glm::mat4 projection = glm::orthoLH(-sphere.radius, sphere.radius, -sphere.radius, sphere.radius, 0.0f, 2.0f * sphere.radius);
+
+	bakeShader->Use();
+	bakeShader->SetMat4("model", model);
+	bakeShader->SetMat4("projection", projection);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, material->GetAlbedo() ? material->GetAlbedo()->ID : 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, material->GetNormal() ? material->GetNormal()->ID : 0);
+
+	for (int y = 0; y < frameCount; y++)
+	{
+		for (int x = 0; x < frameCount; x++)
+		{
+			glm::vec3 direction = GetFrameDirection(x, y);
+			glm::vec3 up = fabsf(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+			bakeShader->SetMat4("view", glm::lookAtLH(direction * sphere.radius, glm::vec3(0.0f), up));
+
+			// Empty border around each frame keeps the mips from averaging in the neighbours
+			glViewport(x * frameSize + FRAME_PADDING, y * frameSize + FRAME_PADDING, frameSize - 2 * FRAME_PADDING, frameSize - 2 * FRAME_PADDING);
+			mesh->Draw();
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// Empty texels have zero alpha in every layer, so the averaged mips stay premultiplied
+	glBindTexture(GL_TEXTURE_2D_ARRAY, atlasTexture);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+bool ImpostorRenderer::Add(Entity* entity)
+{
+	auto atlas = atlasIndices.find({ entity->GetMesh(), entity->GetMaterial() });
+	if (atlas == atlasIndices.end())
+	{
+		return false;
+	}
+
+	glm::mat4 model = entity->GetTransform()->GetModelMatrix();
+	glm::vec3 axisScales = glm::vec3(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])));
+	if (glm::min(axisScales.x, glm::min(axisScales.y, axisScales.z)) < glm::max(axisScales.x, glm::max(axisScales.y, axisScales.z)) * SCALE_TOLERANCE)
+	{
+		return false;
+	}
+
+	BoundingSphere sphere = entity->GetWorldBoundingSphere();
+
+	ImpostorInstance instance;
+	instance.centerRadius = glm::vec4(sphere.center, sphere.radius);
+	for (int i = 0; i < 3; i++)
+	{
+		instance.rotation[i] = glm::vec4(glm::normalize(glm::vec3(model[i])), 0.0f);
+	}
+	instance.rotation[0].w = (float)atlas->second;
+
+	instances.push_back(instance);
+
+	return true;
+}
+
+void ImpostorRenderer::Draw(Camera* camera, Sky* sky, glm::vec3 lightDirection, glm::vec3 lightColor)
+{
+	instanceCount = instances.size();
+	if (instances.empty())
+	{
+		return;
+	}
+
+	// Grow only
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	if (instances.size() > instanceCapacity)
+	{
+		instanceCapacity = instances.size() * 2;
+		glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(ImpostorInstance), nullptr, GL_DYNAMIC_DRAW);
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(ImpostorInstance), &instances[0]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	drawShader->Use();
+	drawShader->SetMat4("view", camera->GetViewMatrix());
+	drawShader->SetMat4("projection", camera->GetProjectionMatrix());
+	drawShader->SetVec3("camPos", camera->GetTransform()->GetPosition());
+	drawShader->SetInt("frameCount", frameCount);
+	drawShader->SetFloat("frameInset", (float)FRAME_PADDING / frameSize);
+	drawShader->SetVec3("lightDirection", lightDirection);
+	drawShader->SetVec3("lightColor", lightColor);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, atlasTexture);
+	sky->BindIrradiance();
+
+	// Billboards always face the camera
+	glDisable(GL_CULL_FACE);
+	glBindVertexArray(quadVAO);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instances.size());
+	glBindVertexArray(0);
+	glEnable(GL_CULL_FACE);
+
+	instances.clear();
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <map>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Entity.h"
+#include "Shader.h"
+#include "Sky.h"
+
+// Per billboard data, read as instanced attributes
+struct ImpostorInstance
+{
+	glm::vec4 centerRadius;
+
+	// Rotation columns without scale, w of the first is the atlas index
+	glm::vec4 rotation[3];
+};
+
+// Octahedral impostors for distant entities
+// Each mesh and material pair is baked from frameCount x frameCount directions over the whole sphere,
+// albedo, normal and depth go into three layers of one texture array so every impostor is a single instanced draw
+class ImpostorRenderer
+{
+public:
+	ImpostorRenderer(Shader* bakeShader, Shader* drawShader, int maxAtlases, int frameCount = 8, int frameSize = 64);
+	~ImpostorRenderer();
+
+	// Render the pair into the next free atlas, does nothing if it is already baked or there is no room
+	void Bake(Mesh* mesh, Material* material);
+
+	// Queue an entity for this frame, false if its pair has no atlas or it is scaled unevenly
+	bool Add(Entity* entity);
+
+	// Draw and clear everything queued
+	void Draw(Camera* camera, Sky* sky, glm::vec3 lightDirection, glm::vec3 lightColor);
+
+	// Getters
+	unsigned int GetInstanceCount() { return instanceCount; }
+
+private:
+	Shader* bakeShader;
+	Shader* drawShader;
+
+	int maxAtlases;
+	int frameCount;
+	int frameSize;
+
+	// Three layers per atlas
+	GLuint atlasTexture;
+	GLuint bakeFBO;
+	GLuint bakeRBO;
+	std::map<std::pair<Mesh*, Material*>, int> atlasIndices;
+
+	// Instanced quad
+	GLuint quadVAO;
+	GLuint quadVBO;
+	GLuint instanceVBO;
+	GLuint instanceCapacity = 0;
+	std::vector<ImpostorInstance> instances;
+	unsigned int instanceCount = 0;
+
+	// Atlases are baked unscaled and instances only carry rotation and radius, so axis scales must match this closely
+	const float SCALE_TOLERANCE = 0.99f;
+
+	// Empty texels around each frame, also caps the mip level the draw samples
+	const int FRAME_PADDING = 4;
+
+	// Must match the shader so frames line up
+	glm::vec3 GetFrameDirection(int x, int y);
+};
@@ -0,0 +1,100 @@
+#include "LightClusterer.h"
+#include "Scene.h"
+
+LightClusterer::LightClusterer(Shader* clusterShader)
+{
+	this->clusterShader = clusterShader;
+
+	GLuint clusterCount = GRID_X * GRID_Y * GRID_Z;
+
+	glGenBuffers(1, &lightSSBO);
+	glGenBuffers(1, &gridSSBO);
+	glGenBuffers(1, &indexSSBO);
+	glGenBuffers(1, &counterSSBO);
+
+	// Offset and count per cluster
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gridSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, clusterCount * 2 * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+
+	// Sized for every cluster being full so the compute pass never has to check
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, clusterCount * MAX_LIGHTS_PER_CLUSTER * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+LightClusterer::~LightClusterer()
+{
+	glDeleteBuffers(1, &lightSSBO);
+	glDeleteBuffers(1, &gridSSBO);
+	glDeleteBuffers(1, &indexSSBO);
+	glDeleteBuffers(1, &counterSSBO);
+}
+
+void LightClusterer::Build(const std::vector<PointLight*>& pointLights, const std::vector<int>& shadowIndices, Camera* camera, int width, int height)
+{
+	lightCount = pointLights.size();
+
+	lights.resize(lightCount);
+	for (GLuint i = 0; i < lightCount; i++)
+	{
+		lights[i].positionRange = glm::vec4(pointLights[i]->position, pointLights[i]->range);
+		lights[i].colorIntensity = glm::vec4(pointLights[i]->color, pointLights[i]->intensity);
+		lights[i].shadow = glm::vec4((float)shadowIndices[i], 0.0f, 0.0f, 0.0f);
+	}
+
+	// Grow the light buffer, never shrinks
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightSSBO);
+	if (lightCount > capacity)
+	{
+		capacity = std::max(lightCount, capacity * 2);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(ClusterLight), nullptr, GL_DYNAMIC_DRAW);
+	}
+	if (lightCount > 0)
+	{
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lightCount * sizeof(ClusterLight), lights.data());
+	}
+
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterSSBO);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	float near = camera->GetNear();
+	float far = camera->GetFar();
+	sliceScale = GRID_Z / log(far / near);
+	sliceBias = -GRID_Z * log(near) / log(far / near);
+	screenSize = glm::vec2(width, height);
+
+	clusterShader->Use();
+	clusterShader->SetMat4("view", camera->GetViewMatrix());
+	clusterShader->SetMat4("inverseProjection", glm::inverse(camera->GetProjectionMatrix()));
+	clusterShader->SetFloat("near", near);
+	clusterShader->SetFloat("far", far);
+	clusterShader->SetUInt("lightCount", lightCount);
+
+	Bind();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, counterSSBO);
+
+	// One invocation per cluster
+	clusterShader->Dispatch(GRID_X * GRID_Y * GRID_Z, 1, 1, 128);
+
+	// Grid and indices are read by fragment shaders
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void LightClusterer::Bind()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, lightSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, gridSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, indexSSBO);
+}
+
+void LightClusterer::SetUniforms(Shader* shader)
+{
+	shader->SetVec2("clusterScreenSize", screenSize);
+	shader->SetFloat("clusterSliceScale", sliceScale);
+	shader->SetFloat("clusterSliceBias", sliceBias);
+}
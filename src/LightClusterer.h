@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "Shader.h"
+
+struct PointLight;
+
+// Point light as the shaders read it
+struct ClusterLight
+{
+	glm::vec4 positionRange;
+	glm::vec4 colorIntensity;
+
+	// x is the point shadow index, -1 without one
+	glm::vec4 shadow;
+};
+
+// Clustered light culling
+// The view frustum is split into a froxel grid with exponential depth slices and a compute pass bins point lights into it by range
+class LightClusterer
+{
+public:
+	LightClusterer(Shader* clusterShader);
+	~LightClusterer();
+
+	// Upload the lights and bin them against this frame's camera
+	void Build(const std::vector<PointLight*>& pointLights, const std::vector<int>& shadowIndices, Camera* camera, int width, int height);
+
+	// Bind the light, grid and index buffers for shading
+	void Bind();
+
+	// Cluster lookup uniforms for a shading program
+	void SetUniforms(Shader* shader);
+
+	// Getters
+	GLuint GetLightCount() { return lightCount; }
+
+	// Grid resolution, x and y split the screen and z the view depth
+	static const GLuint GRID_X = 16;
+	static const GLuint GRID_Y = 9;
+	static const GLuint GRID_Z = 24;
+	static const GLuint MAX_LIGHTS_PER_CLUSTER = 128;
+
+private:
+	Shader* clusterShader;
+
+	// Buffers
+	GLuint lightSSBO;
+	GLuint gridSSBO;
+	GLuint indexSSBO;
+	GLuint counterSSBO;
+	GLuint capacity = 0;
+	GLuint lightCount = 0;
+
+	std::vector<ClusterLight> lights;
+
+	// Depth slice lookup, slice = log(depth) * scale + bias
+	float sliceScale = 0.0f;
+	float sliceBias = 0.0f;
+	glm::vec2 screenSize;
+};
@@ -0,0 +1,578 @@
+#include "LightmapBaker.h"
+
+LightmapBaker::LightmapBaker()
+{
+	nextRow = 0;
+	finishedRows = 0;
+	isCancelled = false;
+}
+
+LightmapBaker::~LightmapBaker()
+{
+	isCancelled = true;
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+int LightmapBaker::AddObject(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, MeshLOD lod, const glm::mat4& model, glm::vec3 albedo, bool isPBR)
+{
+	int index = objects.size();
+	objects.push_back(BakeObject());
+	BakeObject& object = objects.back();
+
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	for (GLuint i = 0; i < lod.vertexCount; i++)
+	{
+		const Vertex& vertex = vertices[lod.baseVertex + i];
+		object.positions.push_back(glm::vec3(model * glm::vec4(vertex.position, 1.0f)));
+		object.normals.push_back(glm::normalize(normalMatrix * vertex.normal));
+		object.lightmapCoords.push_back(vertex.lightmapCoords);
+	}
+
+	object.indices.assign(indices.begin() + lod.firstIndex, indices.begin() + lod.firstIndex + lod.indexCount);
+	object.albedo = albedo;
+	object.isPBR = isPBR;
+
+	rayTracer.AddMesh(vertices, indices, lod, model, index);
+
+	return index;
+}
+
+void LightmapBaker::AddPointLight(glm::vec3 position, glm::vec3 color, float intensity, float range)
+{
+	pointLights.push_back({ position, color, intensity, range });
+}
+
+void LightmapBaker::SetDirectionalLight(glm::vec3 direction, glm::vec3 color, float intensity)
+{
+	// Every shader scales the directional light the same way
+	lightDirection = glm::normalize(direction);
+	lightColor = color * intensity;
+}
+
+void LightmapBaker::SetProbeVolume(AABB bounds, glm::ivec3 resolution)
+{
+	probeBounds = bounds;
+	probeResolution = glm::max(resolution, glm::ivec3(2));
+}
+
+void LightmapBaker::LoadEnvironment(const std::vector<std::string>& facePaths)
+{
+	for (size_t face = 0; face < 6 && face < facePaths.size(); face++)
+	{
+		int width, height, nrComponents;
+		unsigned char* data = stbi_load(facePaths[face].c_str(), &width, &height, &nrComponents, 3);
+		if (!data)
+		{
+			std::cout << "ERROR::LIGHTMAP::Environment face failed to load at path: " << facePaths[face] << std::endl;
+			environmentSize = 0;
+			return;
+		}
+
+		environmentSize = width;
+		environment[face].resize(width * height);
+		for (int i = 0; i < width * height; i++)
+		{
+			environment[face][i] = glm::vec3(data[i * 3], data[i * 3 + 1], data[i * 3 + 2]) / 255.0f;
+		}
+
+		stbi_image_free(data);
+	}
+}
+
+void LightmapBaker::Start(unsigned int threadCount)
+{
+	rayTracer.Build();
+
+	// Size each map by world surface area so texel density is roughly even across objects
+	rows.clear();
+	for (size_t o = 0; o < objects.size(); o++)
+	{
+		BakeObject& object = objects[o];
+
+		float area = 0.0f;
+		for (size_t i = 0; i + 2 < object.indices.size(); i += 3)
+		{
+			glm::vec3 a = object.positions[object.indices[i]];
+			glm::vec3 b = object.positions[object.indices[i + 1]];
+			glm::vec3 c = object.positions[object.indices[i + 2]];
+			area += glm::length(glm::cross(b - a, c - a)) * 0.5f;
+		}
+
+		object.resolution = MIN_RESOLUTION;
+		while (object.resolution < MAX_RESOLUTION && object.resolution < sqrtf(area) * texelsPerUnit)
+		{
+			object.resolution *= 2;
+		}
+
+		object.lightmap.assign(object.resolution * object.resolution, glm::vec3(0.0f));
+		RasterizeTexels(object);
+
+		for (int y = 0; y < object.resolution; y++)
+		{
+			rows.push_back({ (int)o, y });
+		}
+	}
+
+	// Probes go one grid row at a time as well
+	int probeCount = probeResolution.x * probeResolution.y * probeResolution.z;
+	probes.assign(probeCount, SphericalHarmonics());
+	probeValidity.assign(probeCount, 1);
+	for (int row = 0; probeCount > 0 && row < probeResolution.y * probeResolution.z; row++)
+	{
+		rows.push_back({ -1, row });
+	}
+
+	nextRow = 0;
+	finishedRows = 0;
+	isCancelled = false;
+
+	if (threadCount == 0)
+	{
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	std::cout << "Baking " << objects.size() << " lightmaps and " << probeCount << " probes on " << threadCount << " threads" << std::endl;
+
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		workers.emplace_back(&LightmapBaker::Work, this);
+	}
+}
+
+void LightmapBaker::Finish()
+{
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+	workers.clear();
+
+	if (!isCancelled)
+	{
+		for (BakeObject& object : objects)
+		{
+			Dilate(object);
+		}
+		FillInvalidProbes();
+	}
+}
+
+void LightmapBaker::Bake(unsigned int threadCount)
+{
+	Start(threadCount);
+	Finish();
+}
+
+void LightmapBaker::RasterizeTexels(BakeObject& object)
+{
+	int resolution = object.resolution;
+	object.texelPositions.assign(resolution * resolution, glm::vec3(0.0f));
+	object.texelNormals.assign(resolution * resolution, glm::vec3(0.0f));
+	object.coverage.assign(resolution * resolution, 0);
+
+	auto edge = [](glm::vec2 a, glm::vec2 b, glm::vec2 p) { return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x); };
+
+	for (size_t i = 0; i + 2 < object.indices.size(); i += 3)
+	{
+		GLuint i0 = object.indices[i];
+		GLuint i1 = object.indices[i + 1];
+		GLuint i2 = object.indices[i + 2];
+
+		// Texel space, centers are at half coordinates
+		glm::vec2 a = object.lightmapCoords[i0] * (float)resolution;
+		glm::vec2 b = object.lightmapCoords[i1] * (float)resolution;
+		glm::vec2 c = object.lightmapCoords[i2] * (float)resolution;
+
+		float area = edge(a, b, c);
+		if (fabsf(area) < 1e-8f)
+		{
+			continue;
+		}
+
+		glm::ivec2 minTexel = glm::clamp(glm::ivec2(glm::floor(glm::min(a, glm::min(b, c)))), glm::ivec2(0), glm::ivec2(resolution - 1));
+		glm::ivec2 maxTexel = glm::clamp(glm::ivec2(glm::ceil(glm::max(a, glm::max(b, c)))), glm::ivec2(0), glm::ivec2(resolution - 1));
+
+		for (int y = minTexel.y; y <= maxTexel.y; y++)
+		{
+			for (int x = minTexel.x; x <= maxTexel.x; x++)
+			{
+				glm::vec2 p = glm::vec2(x + 0.5f, y + 0.5f);
+				float w0 = edge(b, c, p) / area;
+				float w1 = edge(c, a, p) / area;
+				float w2 = 1.0f - w0 - w1;
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+				{
+					continue;
+				}
+
+				int texel = y * resolution + x;
+				object.texelPositions[texel] = object.positions[i0] * w0 + object.positions[i1] * w1 + object.positions[i2] * w2;
+				object.texelNormals[texel] = glm::normalize(object.normals[i0] * w0 + object.normals[i1] * w1 + object.normals[i2] * w2);
+				object.coverage[texel] = 1;
+			}
+		}
+	}
+}
+
+void LightmapBaker::Work()
+{
+	std::mt19937 random;
+
+	while (!isCancelled)
+	{
+		int row = nextRow++;
+		if (row >= (int)rows.size())
+		{
+			break;
+		}
+
+		// Seeded by row so the result doesn't depend on the thread count
+		random.seed(row);
+
+		if (rows[row].first < 0)
+		{
+			int start = rows[row].second * probeResolution.x;
+			for (int probe = start; probe < start + probeResolution.x; probe++)
+			{
+				glm::ivec3 cell = glm::ivec3(probe % probeResolution.x, (probe / probeResolution.x) % probeResolution.y, probe / (probeResolution.x * probeResolution.y));
+				glm::vec3 position = probeBounds.min + (probeBounds.max - probeBounds.min) * glm::vec3(cell) / glm::vec3(probeResolution - 1);
+				probes[probe] = BakeProbe(position, probeValidity[probe], random);
+			}
+
+			finishedRows++;
+			continue;
+		}
+
+		BakeObject& object = objects[rows[row].first];
+		int start = rows[row].second * object.resolution;
+		for (int texel = start; texel < start + object.resolution; texel++)
+		{
+			if (object.coverage[texel])
+			{
+				object.lightmap[texel] = BakeTexel(object.texelPositions[texel], object.texelNormals[texel], object.isPBR, random);
+			}
+		}
+
+		finishedRows++;
+	}
+}
+
+glm::vec3 LightmapBaker::BakeTexel(glm::vec3 position, glm::vec3 normal, bool isPBR, std::mt19937& random)
+{
+	glm::vec3 origin = position + normal * RAY_OFFSET;
+	glm::vec3 radiance = glm::vec3(0.0f);
+
+	// Gather rays from one texel are close to coherent, so they are traced four at a time
+	RayPacket packet;
+	RayHit hits[4];
+	glm::vec3 directions[4];
+	int packetCount = (samplesPerTexel + 3) / 4;
+
+	for (int p = 0; p < packetCount; p++)
+	{
+		for (int lane = 0; lane < 4; lane++)
+		{
+			directions[lane] = SampleHemisphere(normal, random);
+			packet.originX[lane] = origin.x;
+			packet.originY[lane] = origin.y;
+			packet.originZ[lane] = origin.z;
+			packet.directionX[lane] = directions[lane].x;
+			packet.directionY[lane] = directions[lane].y;
+			packet.directionZ[lane] = directions[lane].z;
+			packet.maxDistance[lane] = FLT_MAX;
+		}
+
+		rayTracer.IntersectPacket(packet, hits);
+
+		for (int lane = 0; lane < 4; lane++)
+		{
+			radiance += IncomingRadiance(origin, directions[lane], hits[lane], 0, random);
+		}
+	}
+
+	// Samples are cosine weighted, so irradiance is pi times their mean
+	return DirectIrradiance(position, normal, isPBR) + radiance * (PI / (packetCount * 4));
+}
+
+SphericalHarmonics LightmapBaker::BakeProbe(glm::vec3 position, unsigned char& isValid, std::mt19937& random)
+{
+	SphericalHarmonics radiance;
+	int backfaces = 0;
+
+	RayPacket packet;
+	RayHit hits[4];
+	glm::vec3 directions[4];
+	int packetCount = (samplesPerProbe + 3) / 4;
+	float weight = 4.0f * PI / (packetCount * 4);
+
+	for (int p = 0; p < packetCount; p++)
+	{
+		for (int lane = 0; lane < 4; lane++)
+		{
+			directions[lane] = SampleSphere(random);
+			packet.originX[lane] = position.x;
+			packet.originY[lane] = position.y;
+			packet.originZ[lane] = position.z;
+			packet.directionX[lane] = directions[lane].x;
+			packet.directionY[lane] = directions[lane].y;
+			packet.directionZ[lane] = directions[lane].z;
+			packet.maxDistance[lane] = FLT_MAX;
+		}
+
+		rayTracer.IntersectPacket(packet, hits);
+
+		for (int lane = 0; lane < 4; lane++)
+		{
+			// Seeing the inside of a surface, contributes nothing
+			if (hits[lane].triangle >= 0)
+			{
+				const RayTriangle& triangle = rayTracer.GetTriangle(hits[lane].triangle);
+				if (glm::dot(glm::cross(triangle.edge1, triangle.edge2), directions[lane]) > 0.0f)
+				{
+					backfaces++;
+					continue;
+				}
+			}
+
+			radiance.AddSample(directions[lane], IncomingRadiance(position, directions[lane], hits[lane], 0, random), weight);
+		}
+	}
+
+	isValid = backfaces < PROBE_BACKFACE_LIMIT * packetCount * 4;
+
+	radiance.ConvolveCosine();
+	return radiance;
+}
+
+glm::vec3 LightmapBaker::DirectIrradiance(glm::vec3 position, glm::vec3 normal, bool isPBR)
+{
+	glm::vec3 irradiance = glm::vec3(0.0f);
+	glm::vec3 origin = position + normal * RAY_OFFSET;
+
+	float NdotL = glm::dot(normal, -lightDirection);
+	if (NdotL > 0.0f && !rayTracer.IsOccluded(origin, -lightDirection, FLT_MAX))
+	{
+		irradiance += lightColor * NdotL;
+	}
+
+	for (BakeLight& light : pointLights)
+	{
+		glm::vec3 toLight = light.position - position;
+		float distance = glm::length(toLight);
+		if (distance >= light.range || distance < 1e-4f)
+		{
+			continue;
+		}
+
+		glm::vec3 direction = toLight / distance;
+		NdotL = glm::dot(normal, direction);
+		if (NdotL <= 0.0f || rayTracer.IsOccluded(origin, direction, distance))
+		{
+			continue;
+		}
+
+		// PBR shaders use a windowed inverse square and ignore intensity, Blinn-Phong a quadratic fade scaled by it
+		float ratio = distance / light.range;
+		if (isPBR)
+		{
+			float window = glm::clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+			irradiance += light.color * (window * window / std::max(distance * distance, 0.0001f)) * NdotL;
+		}
+		else
+		{
+			irradiance += light.color * light.intensity * glm::clamp(1.0f - ratio * ratio, 0.0f, 1.0f) * NdotL;
+		}
+	}
+
+	return irradiance;
+}
+
+glm::vec3 LightmapBaker::IncomingRadiance(glm::vec3 origin, glm::vec3 direction, const RayHit& hit, int bounce, std::mt19937& random)
+{
+	if (hit.triangle < 0)
+	{
+		return SampleEnvironment(direction);
+	}
+
+	// Geometric normal facing back along the ray
+	const RayTriangle& triangle = rayTracer.GetTriangle(hit.triangle);
+	glm::vec3 position = origin + direction * hit.distance;
+	glm::vec3 normal = glm::normalize(glm::cross(triangle.edge1, triangle.edge2));
+	if (glm::dot(normal, direction) > 0.0f)
+	{
+		normal = -normal;
+	}
+
+	glm::vec3 irradiance = DirectIrradiance(position, normal, objects[triangle.object].isPBR);
+
+	// One path per further bounce, the gather rays already average them out
+	if (bounce < bounceCount)
+	{
+		glm::vec3 nextOrigin = position + normal * RAY_OFFSET;
+		glm::vec3 nextDirection = SampleHemisphere(normal, random);
+
+		RayHit nextHit;
+		rayTracer.Intersect(nextOrigin, nextDirection, FLT_MAX, nextHit);
+		irradiance += PI * IncomingRadiance(nextOrigin, nextDirection, nextHit, bounce + 1, random);
+	}
+
+	// Lambertian
+	return objects[triangle.object].albedo / PI * irradiance;
+}
+
+glm::vec3 LightmapBaker::SampleEnvironment(glm::vec3 direction)
+{
+	if (environmentSize == 0)
+	{
+		return glm::vec3(0.0f);
+	}
+
+	// Cube face selection as GL does it, faces in +X, -X, +Y, -Y, +Z, -Z order
+	glm::vec3 absolute = glm::abs(direction);
+	int face;
+	float sc, tc, major;
+	if (absolute.x >= absolute.y && absolute.x >= absolute.z)
+	{
+		face = direction.x > 0.0f ? 0 : 1;
+		sc = direction.x > 0.0f ? -direction.z : direction.z;
+		tc = -direction.y;
+		major = absolute.x;
+	}
+	else if (absolute.y >= absolute.z)
+	{
+		face = direction.y > 0.0f ? 2 : 3;
+		sc = direction.x;
+		tc = direction.y > 0.0f ? direction.z : -direction.z;
+		major = absolute.y;
+	}
+	else
+	{
+		face = direction.z > 0.0f ? 4 : 5;
+		sc = direction.z > 0.0f ? direction.x : -direction.x;
+		tc = -direction.y;
+		major = absolute.z;
+	}
+
+	int x = glm::clamp((int)((sc / major * 0.5f + 0.5f) * environmentSize), 0, environmentSize - 1);
+	int y = glm::clamp((int)((tc / major * 0.5f + 0.5f) * environmentSize), 0, environmentSize - 1);
+
+	return environment[face][y * environmentSize + x];
+}
+
+glm::vec3 LightmapBaker::SampleHemisphere(glm::vec3 normal, std::mt19937& random)
+{
+	// Cosine weighted, a uniform disk projected up onto the hemisphere
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	float phi = 2.0f * PI * uniform(random);
+	float radius2 = uniform(random);
+	float radius = sqrtf(radius2);
+
+	glm::vec3 tangent = glm::normalize(glm::cross(fabsf(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), normal));
+	glm::vec3 bitangent = glm::cross(normal, tangent);
+
+	return glm::normalize(tangent * (radius * cosf(phi)) + bitangent * (radius * sinf(phi)) + normal * sqrtf(std::max(1.0f - radius2, 0.0f)));
+}
+
+glm::vec3 LightmapBaker::SampleSphere(std::mt19937& random)
+{
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	float z = 1.0f - 2.0f * uniform(random);
+	float radius = sqrtf(std::max(1.0f - z * z, 0.0f));
+	float phi = 2.0f * PI * uniform(random);
+
+	return glm::vec3(radius * cosf(phi), radius * sinf(phi), z);
+}
+
+void LightmapBaker::FillInvalidProbes()
+{
+	// Average valid axis neighbours into invalid probes, growing inwards a layer per pass
+	const glm::ivec3 offsets[6] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+
+	for (int pass = 0; pass < DILATE_PASSES; pass++)
+	{
+		std::vector<unsigned char> nextValidity = probeValidity;
+		for (int probe = 0; probe < (int)probes.size(); probe++)
+		{
+			if (probeValidity[probe])
+			{
+				continue;
+			}
+
+			glm::ivec3 cell = glm::ivec3(probe % probeResolution.x, (probe / probeResolution.x) % probeResolution.y, probe / (probeResolution.x * probeResolution.y));
+			SphericalHarmonics sum;
+			int count = 0;
+			for (const glm::ivec3& offset : offsets)
+			{
+				glm::ivec3 neighbour = cell + offset;
+				if (glm::any(glm::lessThan(neighbour, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(neighbour, probeResolution)))
+				{
+					continue;
+				}
+
+				int index = (neighbour.z * probeResolution.y + neighbour.y) * probeResolution.x + neighbour.x;
+				if (probeValidity[index])
+				{
+					sum.Add(probes[index]);
+					count++;
+				}
+			}
+
+			if (count > 0)
+			{
+				sum.Scale(1.0f / count);
+				probes[probe] = sum;
+				nextValidity[probe] = 1;
+			}
+		}
+		probeValidity.swap(nextValidity);
+	}
+}
+
+void LightmapBaker::Dilate(BakeObject& object)
+{
+	// Grow charts outwards so bilinear filtering at their edges doesn't pull in black
+	int resolution = object.resolution;
+	std::vector<unsigned char> coverage = object.coverage;
+
+	for (int pass = 0; pass < DILATE_PASSES; pass++)
+	{
+		std::vector<unsigned char> nextCoverage = coverage;
+		for (int y = 0; y < resolution; y++)
+		{
+			for (int x = 0; x < resolution; x++)
+			{
+				int texel = y * resolution + x;
+				if (coverage[texel])
+				{
+					continue;
+				}
+
+				glm::vec3 sum = glm::vec3(0.0f);
+				int count = 0;
+				for (int dy = -1; dy <= 1; dy++)
+				{
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						int nx = x + dx;
+						int ny = y + dy;
+						if (nx >= 0 && ny >= 0 && nx < resolution && ny < resolution && coverage[ny * resolution + nx])
+						{
+							sum += object.lightmap[ny * resolution + nx];
+							count++;
+						}
+					}
+				}
+
+				if (count > 0)
+				{
+					object.lightmap[texel] = sum / (float)count;
+					nextCoverage[texel] = 1;
+				}
+			}
+		}
+		coverage.swap(nextCoverage);
+	}
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <iostream>
+
+#include <glm/glm.hpp>
+#include <stb/stb_image.h>
+
+#include "Mesh.h"
+#include "RayTracer.h"
+#include "SphericalHarmonics.h"
+
+// Offline CPU path tracer for static geometry
+// Bakes direct and indirect diffuse irradiance from the directional light, point lights and the sky into
+// one lightmap per object, addressed by the second UV set, plus an optional grid of SH irradiance probes for
+// everything that isn't lightmapped. Everything is copied in, so it needs no GPU and the scene can keep
+// rendering while the workers run
+class LightmapBaker
+{
+public:
+	LightmapBaker();
+	~LightmapBaker();
+
+	// Scene input, returns the object's index for GetLightmap
+	// Direct light reaching an object is baked with the falloff its runtime shader uses, PBR or Blinn-Phong
+	int AddObject(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, MeshLOD lod, const glm::mat4& model, glm::vec3 albedo, bool isPBR);
+	void AddPointLight(glm::vec3 position, glm::vec3 color, float intensity, float range);
+	void SetDirectionalLight(glm::vec3 direction, glm::vec3 color, float intensity);
+
+	// Probes sit on the corners of a grid over bounds, resolution is the probe count per axis
+	void SetProbeVolume(AABB bounds, glm::ivec3 resolution);
+
+	// Cube face images in +X, -X, +Y, -Y, +Z, -Z order, rays that escape read it
+	void LoadEnvironment(const std::vector<std::string>& facePaths);
+
+	// Start returns once the workers are running, Finish waits for them and fills gaps between charts
+	// Bake does both for headless use, a thread count of 0 uses every core
+	void Start(unsigned int threadCount = 0);
+	void Finish();
+	void Bake(unsigned int threadCount = 0);
+
+	// Getters
+	bool GetIsFinished() { return finishedRows == (int)rows.size(); }
+	float GetProgress() { return rows.empty() ? 1.0f : (float)finishedRows / rows.size(); }
+	unsigned int GetObjectCount() { return objects.size(); }
+	int GetResolution(int object) { return objects[object].resolution; }
+
+	// Irradiance, row major RGB, bottom row first
+	const std::vector<glm::vec3>& GetLightmap(int object) { return objects[object].lightmap; }
+
+	// Indirect irradiance only, direct light is still evaluated at runtime for probe lit objects, x varies fastest
+	const std::vector<SphericalHarmonics>& GetProbes() { return probes; }
+	AABB GetProbeBounds() { return probeBounds; }
+	glm::ivec3 GetProbeResolution() { return probeResolution; }
+
+	// Settings, read by Start
+	int samplesPerTexel = 64;
+	int samplesPerProbe = 256;
+	int bounceCount = 2;
+	float texelsPerUnit = 16.0f;
+
+private:
+	struct BakeObject
+	{
+		// World space vertices of one LOD, indices are relative to them
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> lightmapCoords;
+		std::vector<GLuint> indices;
+		glm::vec3 albedo;
+		bool isPBR;
+
+		int resolution = 0;
+		std::vector<glm::vec3> lightmap;
+
+		// Surface point under each texel center, coverage is 0 for texels outside every triangle
+		std::vector<glm::vec3> texelPositions;
+		std::vector<glm::vec3> texelNormals;
+		std::vector<unsigned char> coverage;
+	};
+
+	struct BakeLight
+	{
+		glm::vec3 position;
+		glm::vec3 color;
+		float intensity;
+		float range;
+	};
+
+	std::vector<BakeObject> objects;
+	std::vector<BakeLight> pointLights;
+	glm::vec3 lightDirection = glm::vec3(0.0f, -1.0f, 0.0f);
+	glm::vec3 lightColor = glm::vec3(0.0f);
+
+	// Environment faces as linear floats
+	std::vector<glm::vec3> environment[6];
+	int environmentSize = 0;
+
+	// Probes that mostly see back faces are inside geometry, they take their neighbours' values instead
+	AABB probeBounds;
+	glm::ivec3 probeResolution = glm::ivec3(0);
+	std::vector<SphericalHarmonics> probes;
+	std::vector<unsigned char> probeValidity;
+
+	RayTracer rayTracer;
+
+	// Work is handed out a texel row at a time, probe rows have -1 as the object
+	std::vector<std::pair<int, int>> rows;
+	std::atomic<int> nextRow;
+	std::atomic<int> finishedRows;
+	std::atomic<bool> isCancelled;
+	std::vector<std::thread> workers;
+
+	const int MIN_RESOLUTION = 16;
+	const int MAX_RESOLUTION = 256;
+	const int DILATE_PASSES = 4;
+	const float PROBE_BACKFACE_LIMIT = 0.25f;
+	const float RAY_OFFSET = 1e-3f;
+	const float PI = 3.14159265359f;
+
+	void RasterizeTexels(BakeObject& object);
+	void Work();
+	glm::vec3 BakeTexel(glm::vec3 position, glm::vec3 normal, bool isPBR, std::mt19937& random);
+	SphericalHarmonics BakeProbe(glm::vec3 position, unsigned char& isValid, std::mt19937& random);
+	glm::vec3 DirectIrradiance(glm::vec3 position, glm::vec3 normal, bool isPBR);
+	glm::vec3 IncomingRadiance(glm::vec3 origin, glm::vec3 direction, const RayHit& hit, int bounce, std::mt19937& random);
+	glm::vec3 SampleEnvironment(glm::vec3 direction);
+	glm::vec3 SampleHemisphere(glm::vec3 normal, std::mt19937& random);
+	glm::vec3 SampleSphere(std::mt19937& random);
+	void Dilate(BakeObject& object);
+	void FillInvalidProbes();
+};
@@ -30,6 +30,8 @@ bool guiWantsInput;
 double savedMouseX;
 double savedMouseY;
 bool firstClick = true;
+std::string pickedEntity;
+bool isPickPending = false;
 
 // Timing
 float deltaTime = 0.0f;
@@ -50,6 +52,12 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 // Callback for scroll
 void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 
+// Callback for mouse buttons
+void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+
+// Ray cast from the cursor into the scene
+void PickEntity(GLFWwindow* window);
+
 // Update ImGui
 void UpdateImGui(ImGuiIO& io);
 
@@ -87,6 +95,7 @@ int main()
 	glfwSetFramebufferSizeCallback(window, ResizeCallback);
 	glfwSetKeyCallback(window, KeyCallback);
 	glfwSetScrollCallback(window, ScrollCallback);
+	glfwSetMouseButtonCallback(window, MouseButtonCallback);
 
 	// Initialize GLAD to load opengl function pointers
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -296,6 +305,42 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 		renderer->SetIsPostProcess(!renderer->GetIsPostProcess());
 	}
 
+	// Toggle occlusion culling
+	if (key == GLFW_KEY_O && action == GLFW_PRESS)
+	{
+		renderer->SetIsOcclusionCulling(!renderer->GetIsOcclusionCulling());
+	}
+
+	// Toggle software occlusion culling
+	if (key == GLFW_KEY_P && action == GLFW_PRESS)
+	{
+		renderer->SetIsSoftwareOcclusion(!renderer->GetIsSoftwareOcclusion());
+	}
+
+	// Toggle meshlet culling
+	if (key == GLFW_KEY_M && action == GLFW_PRESS)
+	{
+		renderer->SetIsMeshletCulling(!renderer->GetIsMeshletCulling());
+	}
+
+	// Toggle deferred shading
+	if (key == GLFW_KEY_G && action == GLFW_PRESS)
+	{
+		renderer->SetIsDeferred(!renderer->GetIsDeferred());
+	}
+
+	// Toggle forced depth pre-pass
+	if (key == GLFW_KEY_Z && action == GLFW_PRESS)
+	{
+		renderer->SetIsDepthPrepass(!renderer->GetIsDepthPrepass());
+	}
+
+	// Bake lightmaps and irradiance probes in the background
+	if (key == GLFW_KEY_B && action == GLFW_PRESS)
+	{
+		renderer->StartLightmapBake();
+	}
+
 	// Cycle through skyboxes
 	if (key == GLFW_KEY_LEFT && action == GLFW_PRESS)
 	{
@@ -344,6 +389,49 @@ void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 	scene->GetCamera()->SetSpeed(newSpeed);
 }
 
+void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+{
+	// Right click picks, unless ImGui is using the mouse
+	if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS && !ImGui::GetIO().WantCaptureMouse)
+	{
+		PickEntity(window);
+	}
+}
+
+void PickEntity(GLFWwindow* window)
+{
+	Camera* camera = scene->GetCamera();
+
+	// Cursor to normalized device coords
+	double mouseX, mouseY;
+	int windowWidth, windowHeight;
+	glfwGetCursorPos(window, &mouseX, &mouseY);
+	glfwGetWindowSize(window, &windowWidth, &windowHeight);
+
+	float x = (float)(2.0 * mouseX / windowWidth - 1.0);
+	float y = (float)(1.0 - 2.0 * mouseY / windowHeight);
+
+	// Unproject points on the near and far planes
+	glm::mat4 inverseViewProjection = glm::inverse(camera->GetProjectionMatrix() * camera->GetViewMatrix());
+	glm::vec4 nearPoint = inverseViewProjection * glm::vec4(x, y, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverseViewProjection * glm::vec4(x, y, 1.0f, 1.0f);
+	nearPoint /= nearPoint.w;
+	farPoint /= farPoint.w;
+
+	float distance;
+	Entity* hit = scene->GetSpatialIndex()->RayCast(glm::vec3(nearPoint), glm::vec3(farPoint - nearPoint), distance);
+
+	pickedEntity = "";
+	for (std::pair<std::string, Entity*> element : scene->GetEntities())
+	{
+		if (element.second == hit)
+		{
+			pickedEntity = element.first;
+			isPickPending = true;
+		}
+	}
+}
+
 void UpdateImGui(ImGuiIO& io)
 {
 	ImGui_ImplOpenGL3_NewFrame();
@@ -358,19 +446,140 @@ void UpdateImGui(ImGuiIO& io)
 	ImGui::Text("FPS: %f", io.Framerate);
 	ImGui::Text("Window width: %i", width);
 	ImGui::Text("Window height: %i", height);
+	ImGui::Text("Entities drawn: %i / %i", renderer->GetVisibleEntityCount(), renderer->GetTotalEntityCount());
+	ImGui::Text("Software occluded: %i", renderer->GetSoftwareOccludedCount());
+	ImGui::Text("Impostors: %i", renderer->GetImpostorCount());
+
+	float impostorDistance = renderer->GetImpostorDistance();
+	if (ImGui::SliderFloat("Impostor distance", &impostorDistance, 5.0f, 100.0f))
+	{
+		renderer->SetImpostorDistance(impostorDistance);
+	}
+
+	int pointLightCount = scene->GetPointLightCount();
+	if (ImGui::SliderInt("Point lights", &pointLightCount, 0, 4096))
+	{
+		scene->SetPointLightCount(pointLightCount);
+	}
+
+	ImGui::Text("Overdraw: %.2f (pre-pass %s)", renderer->GetOverdraw(), renderer->GetIsDepthPrepassActive() ? "on" : "off");
+
+	bool isAutoDepthPrepass = renderer->GetIsAutoDepthPrepass();
+	if (ImGui::Checkbox("Auto depth pre-pass", &isAutoDepthPrepass))
+	{
+		renderer->SetIsAutoDepthPrepass(isAutoDepthPrepass);
+	}
+
+	float overdrawThreshold = renderer->GetOverdrawThreshold();
+	if (ImGui::SliderFloat("Overdraw threshold", &overdrawThreshold, 1.0f, 4.0f))
+	{
+		renderer->SetOverdrawThreshold(overdrawThreshold);
+	}
+
+	ImGui::Text("Static shadow redraws: %i", renderer->GetStaticShadowDraws());
+	ImGui::Text("Point shadows: %i (faces redrawn %i)", renderer->GetPointShadowCount(), renderer->GetPointShadowFacesDrawn());
+
+	bool isShadowCaching = renderer->GetIsShadowCaching();
+	if (ImGui::Checkbox("Cache static shadows", &isShadowCaching))
+	{
+		renderer->SetIsShadowCaching(isShadowCaching);
+	}
+
+	int shadowKernel = renderer->GetShadowKernel();
+	if (ImGui::Combo("Shadow filter", &shadowKernel, "1 tap\0Tent 3x3\0Poisson 8\0Poisson 16\0EVSM\0"))
+	{
+		renderer->SetShadowKernel(shadowKernel);
+	}
+
+	float shadowFilterRadius = renderer->GetShadowFilterRadius();
+	if (ImGui::SliderFloat("Shadow filter radius", &shadowFilterRadius, 0.5f, 4.0f))
+	{
+		renderer->SetShadowFilterRadius(shadowFilterRadius);
+	}
+
+	float shadowBias = renderer->GetShadowBias();
+	if (ImGui::SliderFloat("Shadow bias", &shadowBias, 0.0f, 0.02f, "%.4f"))
+	{
+		renderer->SetShadowBias(shadowBias);
+	}
+
+	float shadowSlopeBias = renderer->GetShadowSlopeBias();
+	if (ImGui::SliderFloat("Shadow slope bias", &shadowSlopeBias, 0.0f, 0.1f, "%.4f"))
+	{
+		renderer->SetShadowSlopeBias(shadowSlopeBias);
+	}
+
+	float shadowBleedReduction = renderer->GetShadowBleedReduction();
+	if (ImGui::SliderFloat("Shadow bleed reduction", &shadowBleedReduction, 0.0f, 0.9f))
+	{
+		renderer->SetShadowBleedReduction(shadowBleedReduction);
+	}
+
+	if (renderer->GetIsLightmapBaking())
+	{
+		ImGui::Text("Baking lightmaps: %.0f%%", renderer->GetLightmapBakeProgress() * 100.0f);
+	}
+	else
+	{
+		ImGui::Text("Lightmaps: %i", renderer->GetLightmapCount());
+	}
+
+	bool isLightmapping = renderer->GetIsLightmapping();
+	if (ImGui::Checkbox("Use lightmaps", &isLightmapping))
+	{
+		renderer->SetIsLightmapping(isLightmapping);
+	}
+
+	ImGui::Text("Irradiance probes: %i", renderer->GetProbeCount());
+
+	bool isProbeLighting = renderer->GetIsProbeLighting();
+	if (ImGui::Checkbox("Use irradiance probes", &isProbeLighting))
+	{
+		renderer->SetIsProbeLighting(isProbeLighting);
+	}
+
+	ImGui::Text("Lite shaded: %i", renderer->GetLiteShadedCount());
+
+	float shadingLODScreenSize = renderer->GetShadingLODScreenSize();
+	if (ImGui::SliderFloat("Lite shading size", &shadingLODScreenSize, 0.0f, 1.0f))
+	{
+		renderer->SetShadingLODScreenSize(shadingLODScreenSize);
+	}
+
+	float shadingLODFadeTime = renderer->GetShadingLODFadeTime();
+	if (ImGui::SliderFloat("Lite shading fade", &shadingLODFadeTime, 0.0f, 2.0f))
+	{
+		renderer->SetShadingLODFadeTime(shadingLODFadeTime);
+	}
+
+	ImGui::Text("Picked: %s", pickedEntity.c_str());
 	ImGui::Text("Controls:");
 	ImGui::Text("W/A/S/D/Space/LCtrl - Movement");
 	ImGui::Text("LMouseButton/Drag - Look around");
+	ImGui::Text("RMouseButton - Pick entity");
 	ImGui::Text("Scroll - Adjust speed");
 	ImGui::Text("Left/Right - Cycle skyboxes");
 	ImGui::Text("X - Toggle wireframe");
 	ImGui::Text("C - Toggle post-processing **this will cause refractive objects to not draw**");
+	ImGui::Text("O - Toggle occlusion culling (%s)", renderer->GetIsOcclusionCulling() ? "on" : "off");
+	ImGui::Text("P - Toggle software occlusion culling (%s)", renderer->GetIsSoftwareOcclusion() ? "on" : "off");
+	ImGui::Text("M - Toggle meshlet culling (%s)", renderer->GetIsMeshletCulling() ? "on" : "off");
+	ImGui::Text("G - Toggle deferred shading (%s)", renderer->GetIsDeferred() ? "on" : "off");
+	ImGui::Text("Z - Force depth pre-pass (%s)", renderer->GetIsDepthPrepass() ? "on" : "off");
+	ImGui::Text("B - Bake lightmaps and irradiance probes");
 	ImGui::End();
 
 	// Create scene object list
 	ImGui::Begin("Entities");
 	for (std::pair<std::string, Entity*> element : scene->GetEntities())
 	{
+		// Open the node of a freshly picked entity
+		if (isPickPending && element.first == pickedEntity)
+		{
+			ImGui::SetNextItemOpen(true);
+			isPickPending = false;
+		}
+
 		DrawEntityNode(element);
 	}
 	ImGui::End();
@@ -11,8 +11,10 @@ Material::Material(Shader* shader, Texture* albedo, Texture* normal, Texture* me
     this->isRefractive = isRefractive;
 }
 
-void Material::PrepareMaterial(glm::mat4x4 model, glm::mat4x4 view, glm::mat4x4 projection, glm::vec3 position, Sky* sky, GLuint shadowMap)
+void Material::PrepareMaterial(glm::mat4x4 model, glm::mat4x4 view, glm::mat4x4 projection, glm::vec3 position, Sky* sky, GLuint shadowMap, bool isLite)
 {
+	Shader* shader = GetShader(isLite);
+
 	// Activate shader program
 	shader->Use();
 
@@ -39,8 +41,7 @@ void Material::PrepareMaterial(glm::mat4x4 model, glm::mat4x4 view, glm::mat4x4
     {
         glActiveTexture(GL_TEXTURE3);
         glBindTexture(GL_TEXTURE_2D, metallic->ID);
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, sky->GetIrradianceMap());
+        sky->BindIrradiance();
         glActiveTexture(GL_TEXTURE5);
         glBindTexture(GL_TEXTURE_CUBE_MAP, sky->GetConvolvedSpecularMap());
         glActiveTexture(GL_TEXTURE6);
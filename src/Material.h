@@ -13,16 +13,26 @@ public:
 	// For regular entities
 	Material(Shader* shader, Texture* albedo, Texture* normal, Texture* metallic, Texture* roughness, bool isPBR = false, bool isRefractive = false);
 
-	// Set shader uniforms
-	void PrepareMaterial(glm::mat4x4 model, glm::mat4x4 view, glm::mat4x4 projection, glm::vec3 position, Sky* sky, GLuint shadowMap);
+	// Set shader uniforms, lite uses the cheaper variant when there is one
+	void PrepareMaterial(glm::mat4x4 model, glm::mat4x4 view, glm::mat4x4 projection, glm::vec3 position, Sky* sky, GLuint shadowMap, bool isLite = false);
+
+	// Setters
+	void SetLiteShader(Shader* shader) { liteShader = shader; }
 
 	// Getters
-	Shader* GetShader() { return shader; }
+	Shader* GetShader(bool isLite = false) { return isLite && liteShader ? liteShader : shader; }
+	Shader* GetLiteShader() { return liteShader; }
+	Texture* GetAlbedo() { return albedo; }
+	Texture* GetNormal() { return normal; }
+	Texture* GetMetallic() { return metallic; }
+	Texture* GetRoughness() { return roughness; }
+	bool GetIsPBR() { return isPBR; }
 	bool GetIsRefractive() { return isRefractive; }
 
 private:
 
 	Shader* shader;
+	Shader* liteShader = nullptr;
 	Texture* albedo;
 	Texture* normal;
 	Texture* metallic;
@@ -1,9 +1,20 @@
 #include "Mesh.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
 
-Mesh::Mesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+Mesh::Mesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, bool isPacked)
 {
+	this->isPacked = isPacked;
 	this->vertices = vertices;
 	this->indices = indices;
+	CalculateTangents(this->vertices, this->indices);
+
+	// Reorder for the vertex cache and overdraw before anything is uploaded
+	MeshOptimizer(this->vertices, this->indices).Optimize();
+	lods.push_back({ 0, (GLuint)this->indices.size(), 0, (GLuint)this->vertices.size(), FLT_MAX });
+
+	// Bounds are used for culling, calculate once on creation
+	CalculateBounds();
 
 	// Generate VAO, VBO, EBO
 	glGenVertexArrays(1, &VAO);
@@ -13,26 +24,11 @@ Mesh::Mesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
 	// Bind VAO
 	glBindVertexArray(VAO);
 
-	// Bind and set VBO
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-	// Bind and set EBO
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	// Bind and set VBO, EBO
+	UploadBuffers();
 
 	// Set the vertex attribute pointers
-	// Positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-	
-	// Texture coords
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));	
-	
-	// Normals
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+	SetVertexAttributes();
 
 	// Unbind VAO, VBO, EBO
 	glBindVertexArray(0);
@@ -46,17 +42,586 @@ Mesh::~Mesh()
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(1, &EBO);
+
+	// Zero names are ignored if the depth stream or meshlets were never built
+	glDeleteVertexArrays(1, &depthVAO);
+	glDeleteBuffers(1, &depthVBO);
+	glDeleteVertexArrays(1, &meshletVAO);
+	glDeleteBuffers(1, &meshletSSBO);
+	glDeleteBuffers(1, &meshletIndexSSBO);
+}
+
+void Mesh::SetVertexAttributes()
+{
+	// Reads from the VBO bound to GL_ARRAY_BUFFER
+	if (isPacked)
+	{
+		// Positions, unorm16 scaled back to the mesh bounds in the shader
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+
+		// Texture coords
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texCoords));
+
+		// Normals, octahedral decoded in the shader
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+
+		// Tangents
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, tangent));
+
+		// Lightmap coords
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(4, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, lightmapCoords));
+	}
+	else
+	{
+		// Positions
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+
+		// Texture coords
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+
+		// Normals
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+
+		// Tangents
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
+
+		// Lightmap coords
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, lightmapCoords));
+	}
+}
+
+void Mesh::UploadBuffers()
+{
+	// Buffers are respecified, the VAO keeps pointing at the same objects
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+	if (isPacked)
+	{
+		// Quantize against the bounds of every LOD
+		glm::vec3 minPosition = glm::vec3(FLT_MAX);
+		glm::vec3 maxPosition = glm::vec3(-FLT_MAX);
+		for (Vertex& vertex : vertices)
+		{
+			minPosition = glm::min(minPosition, vertex.position);
+			maxPosition = glm::max(maxPosition, vertex.position);
+		}
+
+		positionOffset = minPosition;
+		positionScale = glm::max(maxPosition - minPosition, glm::vec3(1e-6f));
+
+		std::vector<PackedVertex> packedVertices(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			glm::vec3 position = glm::round((vertices[i].position - positionOffset) / positionScale * 65535.0f);
+			packedVertices[i].position[0] = (GLushort)position.x;
+			packedVertices[i].position[1] = (GLushort)position.y;
+			packedVertices[i].position[2] = (GLushort)position.z;
+			packedVertices[i].position[3] = 0;
+
+			// Project onto the octahedron and fold the lower half over
+			glm::vec3 normal = vertices[i].normal / (fabsf(vertices[i].normal.x) + fabsf(vertices[i].normal.y) + fabsf(vertices[i].normal.z));
+			glm::vec2 octahedral = glm::vec2(normal);
+			if (normal.z < 0.0f)
+			{
+				octahedral = (1.0f - glm::abs(glm::vec2(normal.y, normal.x))) * glm::vec2(normal.x >= 0.0f ? 1.0f : -1.0f, normal.y >= 0.0f ? 1.0f : -1.0f);
+			}
+
+			packedVertices[i].normal = glm::packSnorm2x16(octahedral);
+			packedVertices[i].texCoords = glm::packHalf2x16(vertices[i].texCoords);
+			packedVertices[i].tangent = glm::packSnorm3x10_1x2(vertices[i].tangent);
+			packedVertices[i].lightmapCoords = glm::packHalf2x16(vertices[i].lightmapCoords);
+		}
+
+		glBufferData(GL_ARRAY_BUFFER, packedVertices.size() * sizeof(PackedVertex), &packedVertices[0], GL_STATIC_DRAW);
+
+		// Quantized positions padded to 8 bytes
+		if (depthVBO)
+		{
+			std::vector<GLushort> positions(vertices.size() * 4);
+			for (size_t i = 0; i < vertices.size(); i++)
+			{
+				std::copy(packedVertices[i].position, packedVertices[i].position + 4, &positions[i * 4]);
+			}
+			UploadDepthStream(&positions[0], positions.size() * sizeof(GLushort));
+		}
+	}
+	else
+	{
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+
+		if (depthVBO)
+		{
+			std::vector<glm::vec3> positions(vertices.size());
+			for (size_t i = 0; i < vertices.size(); i++)
+			{
+				positions[i] = vertices[i].position;
+			}
+			UploadDepthStream(&positions[0], positions.size() * sizeof(glm::vec3));
+		}
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+	// Indices are relative to each LOD's base vertex so the total count is a safe bound
+	if (vertices.size() <= 65536)
+	{
+		indexType = GL_UNSIGNED_SHORT;
+
+		std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), &shortIndices[0], GL_STATIC_DRAW);
+	}
+	else
+	{
+		indexType = GL_UNSIGNED_INT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	}
+}
+
+void Mesh::BuildMeshlets()
+{
+	MeshLOD lod = lods[0];
+	meshlets.clear();
+	meshletIndices.clear();
+
+	// Greedy in index order, which is already cache optimized so neighbouring triangles share vertices
+	// Stamp holds the meshlet a vertex was last added to
+	std::vector<GLuint> vertexStamps(lod.vertexCount, UINT_MAX);
+	Meshlet meshlet = {};
+
+	for (GLuint i = 0; i + 2 < lod.indexCount; i += 3)
+	{
+		const GLuint* corners = &indices[lod.firstIndex + i];
+
+		GLuint newVertices = 0;
+		for (int v = 0; v < 3; v++)
+		{
+			newVertices += vertexStamps[corners[v]] != meshlets.size() ? 1 : 0;
+		}
+
+		if (meshlet.vertexCount + newVertices > MESHLET_MAX_VERTICES || meshlet.indexCount / 3 + 1 > MESHLET_MAX_TRIANGLES)
+		{
+			FinishMeshlet(meshlet);
+			meshlet = {};
+			meshlet.firstIndex = meshletIndices.size();
+		}
+
+		for (int v = 0; v < 3; v++)
+		{
+			if (vertexStamps[corners[v]] != meshlets.size())
+			{
+				vertexStamps[corners[v]] = meshlets.size();
+				meshlet.vertexCount++;
+			}
+			meshletIndices.push_back(corners[v]);
+		}
+		meshlet.indexCount += 3;
+	}
+
+	if (meshlet.indexCount > 0)
+	{
+		FinishMeshlet(meshlet);
+	}
+
+	// Meshlet and source index buffers are only read by the cull shader
+	glGenBuffers(1, &meshletSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshletSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, meshlets.size() * sizeof(Meshlet), &meshlets[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &meshletIndexSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshletIndexSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, meshletIndices.size() * sizeof(GLuint), &meshletIndices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Same vertices, the element buffer is bound per draw since every entity culls into its own range
+	glGenVertexArrays(1, &meshletVAO);
+	glBindVertexArray(meshletVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	SetVertexAttributes();
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::FinishMeshlet(Meshlet& meshlet)
+{
+	// Sphere around the box center, same as the mesh bounds
+	glm::vec3 minPosition = glm::vec3(FLT_MAX);
+	glm::vec3 maxPosition = glm::vec3(-FLT_MAX);
+	for (GLuint i = 0; i < meshlet.indexCount; i++)
+	{
+		glm::vec3 position = vertices[meshletIndices[meshlet.firstIndex + i]].position;
+		minPosition = glm::min(minPosition, position);
+		maxPosition = glm::max(maxPosition, position);
+	}
+
+	glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+	float radius = 0.0f;
+	for (GLuint i = 0; i < meshlet.indexCount; i++)
+	{
+		radius = std::max(radius, glm::length(vertices[meshletIndices[meshlet.firstIndex + i]].position - center));
+	}
+
+	// Face normals, flipped to agree with the vertex normals so winding doesn't matter
+	std::vector<glm::vec3> faceNormals;
+	glm::vec3 axis = glm::vec3(0.0f);
+	for (GLuint i = 0; i < meshlet.indexCount; i += 3)
+	{
+		const Vertex& v0 = vertices[meshletIndices[meshlet.firstIndex + i]];
+		const Vertex& v1 = vertices[meshletIndices[meshlet.firstIndex + i + 1]];
+		const Vertex& v2 = vertices[meshletIndices[meshlet.firstIndex + i + 2]];
+
+		glm::vec3 normal = glm::cross(v1.position - v0.position, v2.position - v0.position);
+		float length = glm::length(normal);
+		if (length <= 0.0f)
+		{
+			continue;
+		}
+
+		normal /= length;
+		if (glm::dot(normal, v0.normal + v1.normal + v2.normal) < 0.0f)
+		{
+			normal = -normal;
+		}
+
+		faceNormals.push_back(normal);
+		axis += normal;
+	}
+
+	// Cone cutoff is the sine of the widest normal's angle to the axis, only usable under 90 degrees
+	float cutoff = 2.0f;
+	float axisLength = glm::length(axis);
+	if (axisLength > 0.0f)
+	{
+		axis /= axisLength;
+
+		float minDot = 1.0f;
+		for (glm::vec3& normal : faceNormals)
+		{
+			minDot = std::min(minDot, glm::dot(axis, normal));
+		}
+
+		if (minDot > 0.0f)
+		{
+			cutoff = sqrtf(1.0f - minDot * minDot);
+		}
+	}
+
+	meshlet.sphere = glm::vec4(center, radius);
+	meshlet.cone = glm::vec4(axis, cutoff);
+	meshlets.push_back(meshlet);
+}
+
+void Mesh::CullMeshlets(Shader* cullShader)
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, meshletSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, meshletIndexSSBO);
+
+	// One group per meshlet
+	cullShader->SetUInt("meshletCount", meshlets.size());
+	cullShader->Dispatch(meshlets.size(), 1, 1, 1);
+}
+
+void Mesh::DrawMeshlets(GLuint indexBuffer, GLintptr commandOffset)
+{
+	glBindVertexArray(meshletVAO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	SetDecodeAttributes();
+
+	// Compacted indices are always 32 bit and relative to LOD 0
+	glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)commandOffset);
+
+	glBindVertexArray(0);
+}
+
+void Mesh::UploadDepthStream(const void* positions, GLsizeiptr size)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, depthVBO);
+	glBufferData(GL_ARRAY_BUFFER, size, positions, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+}
+
+void Mesh::EnableDepthStream()
+{
+	if (depthVAO)
+	{
+		return;
+	}
+
+	glGenVertexArrays(1, &depthVAO);
+	glGenBuffers(1, &depthVBO);
+
+	// Element buffer is shared, LOD ranges stay the same
+	glBindVertexArray(depthVAO);
+	UploadBuffers();
+
+	// Positions only, same format as the interleaved ones
+	glBindBuffer(GL_ARRAY_BUFFER, depthVBO);
+	glEnableVertexAttribArray(0);
+	if (isPacked)
+	{
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(GLushort), (void*)0);
+	}
+	else
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::DrawDepth(int lod)
+{
+	if (!depthVAO)
+	{
+		Draw(lod);
+		return;
+	}
+
+	glBindVertexArray(depthVAO);
+	SetDecodeAttributes();
+
+	GLsizeiptr indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	glDrawElementsBaseVertex(GL_TRIANGLES, lods[lod].indexCount, indexType, (void*)(lods[lod].firstIndex * indexSize), lods[lod].baseVertex);
+
+	glBindVertexArray(0);
+}
+
+void Mesh::DrawDepthIndirect(GLintptr commandOffset)
+{
+	if (!depthVAO)
+	{
+		DrawIndirect(commandOffset);
+		return;
+	}
+
+	glBindVertexArray(depthVAO);
+	SetDecodeAttributes();
+
+	// Command may have been zeroed on the GPU
+	glDrawElementsIndirect(GL_TRIANGLES, indexType, (void*)commandOffset);
+
+	glBindVertexArray(0);
+}
+
+void Mesh::SetDecodeAttributes()
+{
+	// Constant attributes, not VAO state so they are set before every draw
+	// Unpacked meshes get an identity transform, offset w tells the shader whether the normal is octahedral
+	glVertexAttrib4f(5, positionScale.x, positionScale.y, positionScale.z, 0.0f);
+	glVertexAttrib4f(6, positionOffset.x, positionOffset.y, positionOffset.z, isPacked ? 1.0f : 0.0f);
+}
+
+void Mesh::AddLOD(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, float screenSize)
+{
+	std::vector<Vertex> lodVertices = vertices;
+	std::vector<GLuint> lodIndices = indices;
+	CalculateTangents(lodVertices, lodIndices);
+	MeshOptimizer(lodVertices, lodIndices).Optimize();
+
+	lods.push_back({ (GLuint)this->indices.size(), (GLuint)lodIndices.size(), (GLint)this->vertices.size(), (GLuint)lodVertices.size(), screenSize });
+
+	// Indices stay relative to the LOD, base vertex offsets them at draw time
+	this->vertices.insert(this->vertices.end(), lodVertices.begin(), lodVertices.end());
+	this->indices.insert(this->indices.end(), lodIndices.begin(), lodIndices.end());
+
+	// Element buffer binding is VAO state, keep it from leaking into whatever VAO is bound
+	glBindVertexArray(VAO);
+	UploadBuffers();
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::GenerateLODs(int count, float reduction, float firstScreenSize)
+{
+	MeshLOD last = lods.back();
+	std::vector<Vertex> sourceVertices(vertices.begin() + last.baseVertex, vertices.begin() + last.baseVertex + last.vertexCount);
+	std::vector<GLuint> sourceIndices(indices.begin() + last.firstIndex, indices.begin() + last.firstIndex + last.indexCount);
+
+	MeshSimplifier simplifier(sourceVertices, sourceIndices);
+
+	std::vector<Vertex> lodVertices;
+	std::vector<GLuint> lodIndices;
+	size_t targetIndexCount = sourceIndices.size();
+	float screenSize = firstScreenSize;
+
+	for (int i = 0; i < count; i++)
+	{
+		targetIndexCount = (size_t)(targetIndexCount / 3 * reduction) * 3;
+		simplifier.Simplify(targetIndexCount, lodVertices, lodIndices);
+
+		// Stop once locked vertices keep it from getting any simpler
+		if (lodIndices.empty() || lodIndices.size() >= lods.back().indexCount)
+		{
+			break;
+		}
+
+		AddLOD(lodVertices, lodIndices, screenSize);
+		screenSize *= 0.5f;
+	}
 }
 
-void Mesh::Draw()
+int Mesh::SelectLOD(float screenSize, int currentLOD)
+{
+	int lod = std::min(std::max(currentLOD, 0), (int)lods.size() - 1);
+
+	while (lod + 1 < (int)lods.size() && screenSize < lods[lod + 1].maxScreenSize * (1.0f - LOD_HYSTERESIS))
+	{
+		lod++;
+	}
+
+	while (lod > 0 && screenSize > lods[lod].maxScreenSize * (1.0f + LOD_HYSTERESIS))
+	{
+		lod--;
+	}
+
+	return lod;
+}
+
+void Mesh::CalculateTangents(std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+{
+	// Accumulate per triangle tangents and bitangents weighted by the corner angle, like MikkTSpace,
+	// so the result doesn't depend on how a surface is triangulated
+	std::vector<glm::vec3> tangents(vertices.size(), glm::vec3(0.0f));
+	std::vector<glm::vec3> bitangents(vertices.size(), glm::vec3(0.0f));
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const Vertex& v0 = vertices[indices[i]];
+		const Vertex& v1 = vertices[indices[i + 1]];
+		const Vertex& v2 = vertices[indices[i + 2]];
+
+		glm::vec3 edge1 = v1.position - v0.position;
+		glm::vec3 edge2 = v2.position - v0.position;
+		glm::vec2 deltaUV1 = v1.texCoords - v0.texCoords;
+		glm::vec2 deltaUV2 = v2.texCoords - v0.texCoords;
+
+		// Degenerate in UV space, nothing to add
+		float determinant = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+		if (fabsf(determinant) < 1e-12f)
+		{
+			continue;
+		}
+
+		float inverse = 1.0f / determinant;
+		glm::vec3 tangent = (edge1 * deltaUV2.y - edge2 * deltaUV1.y) * inverse;
+		glm::vec3 bitangent = (edge2 * deltaUV1.x - edge1 * deltaUV2.x) * inverse;
+
+		for (int v = 0; v < 3; v++)
+		{
+			const Vertex& corner = vertices[indices[i + v]];
+			glm::vec3 toNext = vertices[indices[i + (v + 1) % 3]].position - corner.position;
+			glm::vec3 toPrevious = vertices[indices[i + (v + 2) % 3]].position - corner.position;
+			if (glm::length(toNext) < 1e-12f || glm::length(toPrevious) < 1e-12f)
+			{
+				continue;
+			}
+			float angle = acosf(glm::clamp(glm::dot(glm::normalize(toNext), glm::normalize(toPrevious)), -1.0f, 1.0f));
+
+			// Projected into this vertex's tangent plane first so only direction is weighted
+			glm::vec3 normal = corner.normal;
+			glm::vec3 cornerTangent = tangent - normal * glm::dot(normal, tangent);
+			glm::vec3 cornerBitangent = bitangent - normal * glm::dot(normal, bitangent);
+			if (glm::length(cornerTangent) > 1e-12f)
+			{
+				tangents[indices[i + v]] += glm::normalize(cornerTangent) * angle;
+			}
+			if (glm::length(cornerBitangent) > 1e-12f)
+			{
+				bitangents[indices[i + v]] += glm::normalize(cornerBitangent) * angle;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		glm::vec3 normal = vertices[i].normal;
+
+		// Gram-Schmidt against the normal
+		glm::vec3 tangent = tangents[i] - normal * glm::dot(normal, tangents[i]);
+		if (glm::length(tangent) < 1e-6f)
+		{
+			// No usable UVs, any perpendicular will do
+			tangent = glm::cross(normal, fabsf(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+			if (glm::length(tangent) < 1e-6f)
+			{
+				tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+			}
+		}
+		tangent = glm::normalize(tangent);
+
+		// Handedness, the shader rebuilds the bitangent as sign * cross(normal, tangent)
+		float sign = glm::dot(glm::cross(normal, tangent), bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+
+		vertices[i].tangent = glm::vec4(tangent, sign);
+	}
+}
+
+void Mesh::CalculateBounds()
+{
+	aabb.min = glm::vec3(FLT_MAX);
+	aabb.max = glm::vec3(-FLT_MAX);
+
+	for (Vertex& vertex : vertices)
+	{
+		aabb.min = glm::min(aabb.min, vertex.position);
+		aabb.max = glm::max(aabb.max, vertex.position);
+	}
+
+	// Sphere around the box center, radius from furthest vertex so it is tighter than the box corners
+	sphere.center = (aabb.min + aabb.max) * 0.5f;
+	sphere.radius = 0.0f;
+
+	for (Vertex& vertex : vertices)
+	{
+		sphere.radius = std::max(sphere.radius, glm::length(vertex.position - sphere.center));
+	}
+}
+
+void Mesh::Draw(int lod)
 {
 	// Bind the vertex array object
 	glBindVertexArray(VAO);
 
+	SetDecodeAttributes();
+
 	// Ready to draw
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+	GLsizeiptr indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	glDrawElementsBaseVertex(GL_TRIANGLES, lods[lod].indexCount, indexType, (void*)(lods[lod].firstIndex * indexSize), lods[lod].baseVertex);
 
 	// Unbind the vertex array
 	glBindVertexArray(0);
 }
 
+void Mesh::DrawInstanced(GLsizei instanceCount, int lod)
+{
+	glBindVertexArray(VAO);
+
+	SetDecodeAttributes();
+
+	GLsizeiptr indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lods[lod].indexCount, indexType, (void*)(lods[lod].firstIndex * indexSize), instanceCount, lods[lod].baseVertex);
+
+	glBindVertexArray(0);
+}
+
+void Mesh::DrawIndirect(GLintptr commandOffset)
+{
+	glBindVertexArray(VAO);
+	SetDecodeAttributes();
+
+	// Command may have been zeroed on the GPU
+	glDrawElementsIndirect(GL_TRIANGLES, indexType, (void*)commandOffset);
+
+	glBindVertexArray(0);
+}
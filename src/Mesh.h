@@ -1,9 +1,15 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <cfloat>
+#include <climits>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "Shader.h"
 
 // Vertex data
 struct Vertex 
@@ -11,17 +17,134 @@ struct Vertex
 	glm::vec3 position;
 	glm::vec2 texCoords;
 	glm::vec3 normal;
+
+	// Tangent with the bitangent sign in w, generated on creation
+	glm::vec4 tangent;
+
+	// Second UV set for baked lighting, has to be a non overlapping unwrap in [0,1]
+	glm::vec2 lightmapCoords;
+};
+
+// Compressed vertex, 24 bytes instead of 56
+// Position is quantized to the mesh bounds, normal is octahedral snorm16, both tex coord sets are half floats
+// and the tangent is 10 bit snorm with the sign in the 2 bit w
+struct PackedVertex
+{
+	GLushort position[4];
+	GLuint normal;
+	GLuint texCoords;
+	GLuint tangent;
+	GLuint lightmapCoords;
+};
+
+// Matches the layout glDrawElementsIndirect reads
+struct DrawElementsCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Cluster of LOD 0 triangles, bounds are in object space
+struct Meshlet
+{
+	// Center and radius
+	glm::vec4 sphere;
+
+	// Average normal and cone cutoff, a cutoff above one disables the backface test
+	glm::vec4 cone;
+
+	// Range in the meshlet index buffer
+	GLuint firstIndex;
+	GLuint indexCount;
+	GLuint vertexCount;
+	GLuint padding;
+};
+
+// Axis aligned bounding box
+struct AABB
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// Bounding sphere
+struct BoundingSphere
+{
+	glm::vec3 center;
+	float radius;
+};
+
+// Range of the shared buffers used by one level of detail
+struct MeshLOD
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+	GLint baseVertex;
+	GLuint vertexCount;
+
+	// Used while the projected diameter, as a fraction of the viewport height, is below this
+	float maxScreenSize;
 };
 
 class Mesh
 {
 public:
-	Mesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+	Mesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, bool isPacked = false);
 	~Mesh();
 
 	//void CreateSphere(float radius, int sectorCount, int stackCount);
 
-	void Draw();
+	void Draw(int lod = 0);
+
+	// Same LOD drawn instanceCount times, shaders pick per instance data with gl_InstanceID
+	void DrawInstanced(GLsizei instanceCount, int lod = 0);
+
+	// Draw using the command at offset in the bound GL_DRAW_INDIRECT_BUFFER
+	void DrawIndirect(GLintptr commandOffset);
+
+	// Append a coarser level, used once the projected size drops below screenSize
+	void AddLOD(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, float screenSize);
+
+	// Build count levels with the simplifier, each keeping reduction of the previous one's triangles
+	void GenerateLODs(int count, float reduction, float firstScreenSize);
+
+	// Keep a separate position only vertex buffer for depth passes
+	void EnableDepthStream();
+
+	// Draw with the position only stream, falls back to the full vertices without one
+	void DrawDepth(int lod = 0);
+
+	// Indirect draw with the position only stream, falls back to DrawIndirect without one
+	void DrawDepthIndirect(GLintptr commandOffset);
+
+	// Split LOD 0 into meshlets for GPU cluster culling, meant for dense meshes
+	void BuildMeshlets();
+
+	// Cull meshlets into a compacted index buffer, the cull shader is expected to be in use with its uniforms and output buffers set
+	void CullMeshlets(Shader* cullShader);
+
+	// Draw culled indices with a command from the bound indirect buffer, also works with the depth shader
+	void DrawMeshlets(GLuint indexBuffer, GLintptr commandOffset);
+
+	// Pick a level for the projected size, only moves past a threshold by the hysteresis margin to stop popping
+	int SelectLOD(float screenSize, int currentLOD);
+
+	// Getters
+	AABB GetAABB() { return aabb; }
+	BoundingSphere GetBoundingSphere() { return sphere; }
+	GLuint GetIndexCount(int lod = 0) { return lods[lod].indexCount; }
+	MeshLOD GetLOD(int lod) { return lods[lod]; }
+	int GetLODCount() { return lods.size(); }
+	bool GetIsPacked() { return isPacked; }
+	GLenum GetIndexType() { return indexType; }
+	bool GetHasMeshlets() { return !meshlets.empty(); }
+	GLuint GetMeshletCount() { return meshlets.size(); }
+	GLuint GetMeshletIndexCount() { return meshletIndices.size(); }
+	const std::vector<Vertex>& GetVertices() { return vertices; }
+	const std::vector<GLuint>& GetIndices() { return indices; }
 
 private:
 	// Mesh buffers
@@ -29,8 +152,43 @@ private:
 	GLuint VBO;
 	GLuint EBO;
 
-	// Vertex data
+	// Vertex data, every LOD is appended to the same arrays
 	std::vector<Vertex> vertices;
 	std::vector<GLuint> indices;
+	std::vector<MeshLOD> lods;
+
+	const float LOD_HYSTERESIS = 0.15f;
+
+	// GPU side format, indices drop to 16 bits whenever the vertex count allows it
+	bool isPacked;
+	GLenum indexType = GL_UNSIGNED_INT;
+	glm::vec3 positionOffset = glm::vec3(0.0f);
+	glm::vec3 positionScale = glm::vec3(1.0f);
+
+	// Position only stream, shares the element buffer with the main VAO
+	GLuint depthVAO = 0;
+	GLuint depthVBO = 0;
+
+	// Meshlets, the second VAO reads the same vertices with whichever compacted indices the caller culled into
+	std::vector<Meshlet> meshlets;
+	std::vector<GLuint> meshletIndices;
+	GLuint meshletVAO = 0;
+	GLuint meshletSSBO = 0;
+	GLuint meshletIndexSSBO = 0;
+
+	const GLuint MESHLET_MAX_VERTICES = 64;
+	const GLuint MESHLET_MAX_TRIANGLES = 124;
+
+	// Object space bounds
+	AABB aabb;
+	BoundingSphere sphere;
+
+	void CalculateBounds();
+	void CalculateTangents(std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+	void UploadBuffers();
+	void SetDecodeAttributes();
+	void SetVertexAttributes();
+	void UploadDepthStream(const void* positions, GLsizeiptr size);
+	void FinishMeshlet(Meshlet& meshlet);
 };
 
@@ -0,0 +1,319 @@
+#include "MeshOptimizer.h"
+
+MeshOptimizer::MeshOptimizer(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) : vertices(vertices), indices(indices)
+{
+}
+
+void MeshOptimizer::Optimize()
+{
+	if (indices.size() < 3)
+	{
+		return;
+	}
+
+	OptimizeVertexCache();
+	OptimizeOverdraw();
+	OptimizeVertexFetch();
+}
+
+float MeshOptimizer::GetVertexScore(int cachePosition, int remainingTriangles)
+{
+	// Nothing left to draw with this vertex
+	if (remainingTriangles == 0)
+	{
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+
+	if (cachePosition >= 0)
+	{
+		// Last triangle's vertices get a fixed score so the next one isn't forced to reuse all of them
+		if (cachePosition < 3)
+		{
+			score = 0.75f;
+		}
+		else
+		{
+			score = powf(1.0f - (float)(cachePosition - 3) / (SCORE_CACHE_SIZE - 3), 1.5f);
+		}
+	}
+
+	// Boost vertices with few triangles left so they get finished off instead of leaving lone triangles
+	return score + 2.0f * powf((float)remainingTriangles, -0.5f);
+}
+
+void MeshOptimizer::OptimizeVertexCache()
+{
+	size_t triangleCount = indices.size() / 3;
+
+	// Triangle lists per vertex, packed into one array
+	std::vector<int> remaining(vertices.size(), 0);
+	for (GLuint index : indices)
+	{
+		remaining[index]++;
+	}
+
+	std::vector<size_t> offsets(vertices.size() + 1, 0);
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		offsets[i + 1] = offsets[i] + remaining[i];
+	}
+
+	std::vector<GLuint> vertexTriangles(indices.size());
+	std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		vertexTriangles[fill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<int> cachePositions(vertices.size(), -1);
+	std::vector<float> vertexScores(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		vertexScores[i] = GetVertexScore(-1, remaining[i]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> isAdded(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+	}
+
+	std::vector<GLuint> cache;
+	std::vector<GLuint> newCache;
+	std::vector<GLuint> output;
+	output.reserve(indices.size());
+
+	size_t scanPosition = 0;
+	int bestTriangle = -1;
+
+	for (size_t added = 0; added < triangleCount; added++)
+	{
+		// Nothing useful in the cache, take the next triangle in order
+		if (bestTriangle < 0)
+		{
+			while (isAdded[scanPosition])
+			{
+				scanPosition++;
+			}
+			bestTriangle = scanPosition;
+		}
+
+		GLuint* corners = &indices[bestTriangle * 3];
+		isAdded[bestTriangle] = true;
+		output.insert(output.end(), corners, corners + 3);
+
+		// Remove it from its vertices' lists by swapping it past the remaining range
+		for (int v = 0; v < 3; v++)
+		{
+			GLuint vertex = corners[v];
+			GLuint* begin = &vertexTriangles[offsets[vertex]];
+			GLuint* end = begin + remaining[vertex];
+			std::iter_swap(std::find(begin, end, (GLuint)bestTriangle), end - 1);
+			remaining[vertex]--;
+		}
+
+		// New triangle goes to the front of the cache, everything else shifts back
+		newCache.assign(corners, corners + 3);
+		for (GLuint vertex : cache)
+		{
+			if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+			{
+				newCache.push_back(vertex);
+			}
+		}
+
+		cache.swap(newCache);
+
+		// Rescore everything that was touched
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			GLuint vertex = cache[i];
+			cachePositions[vertex] = i < (size_t)SCORE_CACHE_SIZE ? (int)i : -1;
+
+			float score = GetVertexScore(cachePositions[vertex], remaining[vertex]);
+			float delta = score - vertexScores[vertex];
+			vertexScores[vertex] = score;
+
+			for (int j = 0; j < remaining[vertex]; j++)
+			{
+				triangleScores[vertexTriangles[offsets[vertex] + j]] += delta;
+			}
+		}
+
+		// Then pick the best triangle around the cache, a triangle shares up to three cached vertices so this can't run in the loop above
+		float bestScore = -1.0f;
+		bestTriangle = -1;
+
+		for (GLuint vertex : cache)
+		{
+			for (int j = 0; j < remaining[vertex]; j++)
+			{
+				GLuint triangle = vertexTriangles[offsets[vertex] + j];
+				if (triangleScores[triangle] > bestScore)
+				{
+					bestScore = triangleScores[triangle];
+					bestTriangle = triangle;
+				}
+			}
+		}
+
+		// Vertices pushed past the end were just rescored as evicted
+		cache.resize(std::min(cache.size(), (size_t)SCORE_CACHE_SIZE));
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeOverdraw()
+{
+	size_t triangleCount = indices.size() / 3;
+
+	// Split where the cache order jumps, a triangle with three misses starts a new cluster
+	std::vector<size_t> clusterStarts;
+	std::vector<GLuint> cache;
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		int misses = 0;
+		for (int v = 0; v < 3; v++)
+		{
+			GLuint vertex = indices[t * 3 + v];
+			if (std::find(cache.begin(), cache.end(), vertex) == cache.end())
+			{
+				misses++;
+				cache.insert(cache.begin(), vertex);
+				if (cache.size() > (size_t)FIFO_CACHE_SIZE)
+				{
+					cache.pop_back();
+				}
+			}
+		}
+
+		if (t == 0 || misses == 3)
+		{
+			clusterStarts.push_back(t);
+		}
+	}
+	clusterStarts.push_back(triangleCount);
+
+	// Nothing to sort
+	size_t clusterCount = clusterStarts.size() - 1;
+	if (clusterCount < 2)
+	{
+		return;
+	}
+
+	glm::vec3 meshCenter = glm::vec3(0.0f);
+	for (Vertex& vertex : vertices)
+	{
+		meshCenter += vertex.position;
+	}
+	meshCenter /= (float)vertices.size();
+
+	// Clusters facing away from the center tend to occlude the rest, draw them first
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		glm::vec3 center = glm::vec3(0.0f);
+		glm::vec3 normal = glm::vec3(0.0f);
+		float totalArea = 0.0f;
+
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+		{
+			const Vertex& v0 = vertices[indices[t * 3]];
+			const Vertex& v1 = vertices[indices[t * 3 + 1]];
+			const Vertex& v2 = vertices[indices[t * 3 + 2]];
+			glm::vec3 p0 = v0.position;
+			glm::vec3 p1 = v1.position;
+			glm::vec3 p2 = v2.position;
+
+			// Flipped to agree with the vertex normals so winding doesn't matter
+			glm::vec3 areaNormal = glm::cross(p1 - p0, p2 - p0);
+			if (glm::dot(areaNormal, v0.normal + v1.normal + v2.normal) < 0.0f)
+			{
+				areaNormal = -areaNormal;
+			}
+			float area = glm::length(areaNormal);
+
+			center += (p0 + p1 + p2) / 3.0f * area;
+			normal += areaNormal;
+			totalArea += area;
+		}
+
+		center = totalArea > 0.0f ? center / totalArea : vertices[indices[clusterStarts[c] * 3]].position;
+		float length = glm::length(normal);
+
+		// Positive when the cluster faces away from the center
+		sortKeys[c] = length > 0.0f ? glm::dot(center - meshCenter, normal / length) : 0.0f;
+	}
+
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<GLuint> output;
+	output.reserve(indices.size());
+	for (size_t c : order)
+	{
+		output.insert(output.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeVertexFetch()
+{
+	// Number vertices in the order they are first used, unused ones are dropped
+	std::vector<GLuint> remap(vertices.size(), UINT_MAX);
+	std::vector<Vertex> output;
+	output.reserve(vertices.size());
+
+	for (GLuint& index : indices)
+	{
+		if (remap[index] == UINT_MAX)
+		{
+			remap[index] = output.size();
+			output.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(output);
+}
+
+unsigned int MeshOptimizer::CountCacheMisses()
+{
+	std::vector<GLuint> cache;
+	unsigned int misses = 0;
+
+	for (GLuint index : indices)
+	{
+		if (std::find(cache.begin(), cache.end(), index) == cache.end())
+		{
+			misses++;
+			cache.insert(cache.begin(), index);
+			if (cache.size() > (size_t)FIFO_CACHE_SIZE)
+			{
+				cache.pop_back();
+			}
+		}
+	}
+
+	return misses;
+}
+
+float MeshOptimizer::GetACMR()
+{
+	return indices.empty() ? 0.0f : (float)CountCacheMisses() / (indices.size() / 3);
+}
+
+float MeshOptimizer::GetATVR()
+{
+	return vertices.empty() ? 0.0f : (float)CountCacheMisses() / vertices.size();
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <climits>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+// Reorders a mesh in place for the GPU, done once at creation
+// Triangles are sorted for the post transform cache and then for overdraw, vertices are then sorted by first use
+class MeshOptimizer
+{
+public:
+	MeshOptimizer(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+	// Runs every stage, GetACMR and GetATVR report the result
+	void Optimize();
+
+	void OptimizeVertexCache();
+	void OptimizeOverdraw();
+	void OptimizeVertexFetch();
+
+	// Average cache miss ratio per triangle and per vertex, simulated with a FIFO cache
+	float GetACMR();
+	float GetATVR();
+
+private:
+	std::vector<Vertex>& vertices;
+	std::vector<GLuint>& indices;
+
+	// Forsyth's scoring cache, bigger than the hardware one on purpose
+	const int SCORE_CACHE_SIZE = 32;
+
+	// Typical hardware FIFO size used for the stats and cluster splits
+	const int FIFO_CACHE_SIZE = 16;
+
+	float GetVertexScore(int cachePosition, int remainingTriangles);
+	unsigned int CountCacheMisses();
+};
@@ -0,0 +1,272 @@
+#include "MeshSimplifier.h"
+
+MeshSimplifier::MeshSimplifier(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+{
+	this->vertices = vertices;
+	this->indices = indices;
+
+	LockSeamsAndBorders();
+	ComputeQuadrics();
+}
+
+void MeshSimplifier::LockSeamsAndBorders()
+{
+	isLocked.assign(vertices.size(), false);
+
+	// Weld by position so seams and borders can be found on the real surface
+	std::vector<GLuint> order(vertices.size());
+	for (GLuint i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+
+	auto lessPosition = [&](GLuint a, GLuint b)
+	{
+		glm::vec3 pa = vertices[a].position;
+		glm::vec3 pb = vertices[b].position;
+		return pa.x != pb.x ? pa.x < pb.x : (pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z);
+	};
+	std::sort(order.begin(), order.end(), lessPosition);
+
+	std::vector<GLuint> welded(vertices.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		// Vertex split for attributes, lock every copy
+		if (i > 0 && vertices[order[i]].position == vertices[order[i - 1]].position)
+		{
+			welded[order[i]] = welded[order[i - 1]];
+			isLocked[order[i]] = true;
+			isLocked[order[i - 1]] = true;
+		}
+		else
+		{
+			welded[order[i]] = order[i];
+		}
+	}
+
+	// Edges used by a single triangle are borders
+	std::unordered_map<unsigned long long, int> edgeCounts;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			GLuint a = welded[indices[i + e]];
+			GLuint b = welded[indices[i + (e + 1) % 3]];
+			edgeCounts[((unsigned long long)std::min(a, b) << 32) | std::max(a, b)]++;
+		}
+	}
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			GLuint a = indices[i + e];
+			GLuint b = indices[i + (e + 1) % 3];
+			if (edgeCounts[((unsigned long long)std::min(welded[a], welded[b]) << 32) | std::max(welded[a], welded[b])] == 1)
+			{
+				isLocked[a] = true;
+				isLocked[b] = true;
+			}
+		}
+	}
+}
+
+void MeshSimplifier::ComputeQuadrics()
+{
+	quadrics.assign(vertices.size(), glm::mat4(0.0f));
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		glm::vec3 p0 = vertices[indices[i]].position;
+		glm::vec3 p1 = vertices[indices[i + 1]].position;
+		glm::vec3 p2 = vertices[indices[i + 2]].position;
+
+		// Cross product length is twice the area, used as the weight
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float area = glm::length(normal);
+		if (area <= 0.0f)
+		{
+			continue;
+		}
+		normal /= area;
+
+		glm::vec4 plane = glm::vec4(normal, -glm::dot(normal, p0));
+		glm::mat4 quadric = glm::outerProduct(plane, plane) * area;
+
+		for (int v = 0; v < 3; v++)
+		{
+			quadrics[indices[i + v]] += quadric;
+		}
+	}
+}
+
+float MeshSimplifier::GetError(GLuint vertex, const glm::mat4& quadric)
+{
+	glm::vec4 position = glm::vec4(vertices[vertex].position, 1.0f);
+	return std::max(glm::dot(position, quadric * position), 0.0f);
+}
+
+bool MeshSimplifier::IsFlipped(GLuint source, GLuint target, const std::vector<GLuint>& triangles)
+{
+	for (GLuint triangle : triangles)
+	{
+		GLuint* corners = &indices[triangle * 3];
+
+		// Triangles on the collapsed edge disappear
+		if (corners[0] == target || corners[1] == target || corners[2] == target)
+		{
+			continue;
+		}
+
+		glm::vec3 before[3];
+		glm::vec3 after[3];
+		for (int v = 0; v < 3; v++)
+		{
+			before[v] = vertices[corners[v]].position;
+			after[v] = corners[v] == source ? vertices[target].position : before[v];
+		}
+
+		glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+		glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+
+		// Turning sharply counts too, slivers squashed to nothing have noisy normals that only barely keep their sign
+		if (glm::dot(normalBefore, normalAfter) <= FLIP_COSINE * glm::length(normalBefore) * glm::length(normalAfter))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void MeshSimplifier::Simplify(size_t targetIndexCount, std::vector<Vertex>& outVertices, std::vector<GLuint>& outIndices)
+{
+	// Triangles collapsed by an earlier call are still in the index buffer
+	size_t indexCount = 0;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		if (indices[i] != indices[i + 1] && indices[i + 1] != indices[i + 2] && indices[i] != indices[i + 2])
+		{
+			indexCount += 3;
+		}
+	}
+
+	std::vector<std::vector<GLuint>> vertexTriangles(vertices.size());
+	std::vector<Collapse> collapses;
+	std::vector<bool> isTouched(vertices.size());
+
+	// Each pass collapses the cheapest independent edges, neighbours of a collapse wait for the next pass
+	while (indexCount > targetIndexCount)
+	{
+		for (std::vector<GLuint>& triangles : vertexTriangles)
+		{
+			triangles.clear();
+		}
+		collapses.clear();
+
+		for (GLuint t = 0; t < indices.size() / 3; t++)
+		{
+			GLuint* corners = &indices[t * 3];
+			if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2])
+			{
+				continue;
+			}
+
+			for (int e = 0; e < 3; e++)
+			{
+				vertexTriangles[corners[e]].push_back(t);
+
+				// Every edge shows up twice on a closed mesh, only keep one direction
+				GLuint a = corners[e];
+				GLuint b = corners[(e + 1) % 3];
+				if (a > b)
+				{
+					continue;
+				}
+
+				glm::mat4 quadric = quadrics[a] + quadrics[b];
+				float costA = isLocked[b] ? FLT_MAX : GetError(a, quadric);
+				float costB = isLocked[a] ? FLT_MAX : GetError(b, quadric);
+
+				if (costA < costB)
+				{
+					collapses.push_back({ b, a, costA });
+				}
+				else if (costB < FLT_MAX)
+				{
+					collapses.push_back({ a, b, costB });
+				}
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+		std::fill(isTouched.begin(), isTouched.end(), false);
+
+		size_t collapsed = 0;
+		for (Collapse& collapse : collapses)
+		{
+			if (indexCount <= targetIndexCount)
+			{
+				break;
+			}
+
+			if (isTouched[collapse.source] || isTouched[collapse.target] || IsFlipped(collapse.source, collapse.target, vertexTriangles[collapse.source]))
+			{
+				continue;
+			}
+
+			// Move the source's triangles onto the target
+			for (GLuint triangle : vertexTriangles[collapse.source])
+			{
+				GLuint* corners = &indices[triangle * 3];
+				bool isDegenerate = corners[0] == collapse.target || corners[1] == collapse.target || corners[2] == collapse.target;
+
+				for (int v = 0; v < 3; v++)
+				{
+					isTouched[corners[v]] = true;
+					if (corners[v] == collapse.source)
+					{
+						corners[v] = collapse.target;
+					}
+				}
+
+				if (isDegenerate)
+				{
+					indexCount -= 3;
+				}
+			}
+
+			quadrics[collapse.target] += quadrics[collapse.source];
+			collapsed++;
+		}
+
+		if (collapsed == 0)
+		{
+			break;
+		}
+	}
+
+	// Drop collapsed triangles and compact whatever vertices are still used
+	std::vector<GLuint> remap(vertices.size(), UINT_MAX);
+	outVertices.clear();
+	outIndices.clear();
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		if (indices[i] == indices[i + 1] || indices[i + 1] == indices[i + 2] || indices[i] == indices[i + 2])
+		{
+			continue;
+		}
+
+		for (int v = 0; v < 3; v++)
+		{
+			GLuint index = indices[i + v];
+			if (remap[index] == UINT_MAX)
+			{
+				remap[index] = outVertices.size();
+				outVertices.push_back(vertices[index]);
+			}
+			outIndices.push_back(remap[index]);
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <climits>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+// Quadric error metric simplifier, collapses edges onto one of their existing vertices so attributes stay valid
+// Vertices on seams or open borders are locked so UVs and silhouettes don't tear
+class MeshSimplifier
+{
+public:
+	MeshSimplifier(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+
+	// Collapses until at most targetIndexCount indices remain or nothing else can collapse
+	// Can be called again with a lower target to continue a LOD chain from the last result
+	void Simplify(size_t targetIndexCount, std::vector<Vertex>& outVertices, std::vector<GLuint>& outIndices);
+
+private:
+	struct Collapse
+	{
+		GLuint source;
+		GLuint target;
+		float cost;
+	};
+
+	std::vector<Vertex> vertices;
+	std::vector<GLuint> indices;
+
+	// Sum of plane quadrics of the triangles around each vertex
+	std::vector<glm::mat4> quadrics;
+	std::vector<bool> isLocked;
+
+	// Collapses that turn any remaining triangle further than this cosine are rejected
+	const float FLIP_COSINE = 0.25f;
+
+	void LockSeamsAndBorders();
+	void ComputeQuadrics();
+	float GetError(GLuint vertex, const glm::mat4& quadric);
+	bool IsFlipped(GLuint source, GLuint target, const std::vector<GLuint>& triangles);
+};
@@ -0,0 +1,159 @@
+#include "OcclusionCuller.h"
+
+OcclusionCuller::OcclusionCuller(int width, int height, Shader* downsampleShader, Shader* cullShader)
+{
+	this->width = width;
+	this->height = height;
+	this->downsampleShader = downsampleShader;
+	this->cullShader = cullShader;
+
+	// Full mip chain, each texel holds the furthest depth under it
+	hiZLevels = (int)floor(log2(std::max(width, height))) + 1;
+	glGenTextures(1, &hiZTexture);
+	glBindTexture(GL_TEXTURE_2D, hiZTexture);
+	glTexStorage2D(GL_TEXTURE_2D, hiZLevels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenBuffers(1, &instanceSSBO);
+	glGenBuffers(1, &visibilitySSBO);
+	glGenBuffers(2, commandBuffers);
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+	glDeleteTextures(1, &hiZTexture);
+	glDeleteBuffers(1, &instanceSSBO);
+	glDeleteBuffers(1, &visibilitySSBO);
+	glDeleteBuffers(2, commandBuffers);
+}
+
+void OcclusionCuller::Reserve(GLuint count)
+{
+	if (count <= capacity)
+	{
+		return;
+	}
+
+	// Grow buffers
+	capacity = std::max(count, capacity * 2);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(CullInstance), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilitySSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+
+	for (int i = 0; i < 2; i++)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffers[i]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(DrawElementsCommand), nullptr, GL_DYNAMIC_DRAW);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void OcclusionCuller::Cull(std::vector<Entity*>& entities, glm::mat4 viewProjection, bool isSecondPhase)
+{
+	GLuint count = entities.size();
+	currentPhase = isSecondPhase ? 1 : 0;
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	Reserve(count);
+
+	// Bounds only change between frames, upload in the first phase
+	if (!isSecondPhase)
+	{
+		instances.resize(count);
+		for (GLuint i = 0; i < count; i++)
+		{
+			AABB bounds = entities[i]->GetWorldAABB();
+			instances[i].aabbMin = glm::vec4(bounds.min, 1.0f);
+			instances[i].aabbMax = glm::vec4(bounds.max, 1.0f);
+			MeshLOD lod = entities[i]->GetMesh()->GetLOD(entities[i]->GetLOD(false));
+			instances[i].indexCount = lod.indexCount;
+			instances[i].firstIndex = lod.firstIndex;
+			instances[i].baseVertex = lod.baseVertex;
+			instances[i].padding = 0;
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceSSBO);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(CullInstance), &instances[0]);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	cullShader->Use();
+
+	// First phase reprojects into last frame's pyramid, second phase uses the one just built
+	cullShader->SetMat4("viewProjection", isSecondPhase ? viewProjection : previousViewProjection);
+	cullShader->SetUInt("instanceCount", count);
+	cullShader->SetBool("isSecondPhase", isSecondPhase);
+	cullShader->SetBool("hasHistory", hasHistory);
+	cullShader->SetInt("hiZLevels", hiZLevels);
+	cullShader->SetInt("hiZ", 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, hiZTexture);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instanceSSBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffers[currentPhase]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, visibilitySSBO);
+
+	cullShader->Dispatch(count, 1, 1, 64);
+
+	// Commands are consumed by indirect draws
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+	if (isSecondPhase)
+	{
+		previousViewProjection = viewProjection;
+	}
+}
+
+void OcclusionCuller::BindCommands()
+{
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffers[currentPhase]);
+}
+
+void OcclusionCuller::BindCommands(int phase)
+{
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffers[phase]);
+}
+
+void OcclusionCuller::BuildHiZ(GLuint depthTexture)
+{
+	// Level zero reads the scene depth directly
+	downsampleShader->Use();
+	downsampleShader->SetInt("depthTexture", 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+
+	int levelWidth = width;
+	int levelHeight = height;
+
+	for (int level = 0; level < hiZLevels; level++)
+	{
+		// Level zero copies depth, every other level takes the max of the one above
+		downsampleShader->SetInt("level", level);
+
+		if (level > 0)
+		{
+			glBindImageTexture(0, hiZTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		}
+		glBindImageTexture(1, hiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		downsampleShader->Dispatch(levelWidth, levelHeight, 1, 8, 8);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+		levelWidth = std::max(levelWidth / 2, 1);
+		levelHeight = std::max(levelHeight / 2, 1);
+	}
+
+	hasHistory = true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Entity.h"
+#include "Shader.h"
+
+// Per entity data read by the cull shader
+struct CullInstance
+{
+	glm::vec4 aabbMin;
+	glm::vec4 aabbMax;
+
+	// Copied into the draw command when visible
+	GLuint indexCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint padding;
+};
+
+// Two phase hierarchical-Z occlusion culling
+// Phase one tests against last frame's depth pyramid, phase two retests the rejects against this frame's
+class OcclusionCuller
+{
+public:
+	OcclusionCuller(int width, int height, Shader* downsampleShader, Shader* cullShader);
+	~OcclusionCuller();
+
+	// Upload bounds and run a cull phase, commands land in GetCommandOffset(index) of the bound indirect buffer
+	void Cull(std::vector<Entity*>& entities, glm::mat4 viewProjection, bool isSecondPhase);
+
+	// Build the max depth pyramid from the scene depth texture
+	void BuildHiZ(GLuint depthTexture);
+
+	// Binds the command buffer of the phase that was last culled to GL_DRAW_INDIRECT_BUFFER
+	void BindCommands();
+
+	// Binds an earlier phase's commands, both stay valid until the next phase one cull
+	void BindCommands(int phase);
+
+	// Getters
+	GLintptr GetCommandOffset(unsigned int index) { return index * sizeof(DrawElementsCommand); }
+	GLuint GetHiZTexture() { return hiZTexture; }
+	int GetHiZLevels() { return hiZLevels; }
+	glm::mat4 GetPreviousViewProjection() { return previousViewProjection; }
+	bool GetHasHistory() { return hasHistory; }
+
+private:
+	Shader* downsampleShader;
+	Shader* cullShader;
+
+	int width;
+	int height;
+	int hiZLevels;
+
+	GLuint hiZTexture;
+
+	// Buffers
+	GLuint instanceSSBO;
+	GLuint visibilitySSBO;
+	GLuint commandBuffers[2];
+	GLuint capacity = 0;
+	int currentPhase = 0;
+
+	std::vector<CullInstance> instances;
+
+	// Last frame's camera, the pyramid was built with it
+	glm::mat4 previousViewProjection;
+	bool hasHistory = false;
+
+	void Reserve(GLuint count);
+};
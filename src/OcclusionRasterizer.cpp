@@ -0,0 +1,385 @@
+#include "OcclusionRasterizer.h"
+
+OcclusionRasterizer::OcclusionRasterizer(int width, int height, unsigned int threadCount)
+{
+	this->width = (width + 3) & ~3;
+	this->height = height;
+
+	// One band per hardware thread unless told otherwise
+	if (threadCount == 0)
+	{
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	threadCount = std::min(threadCount, (unsigned int)std::max(height, 1));
+
+	// Rounding up can leave trailing bands empty, don't keep threads for those
+	bandHeight = std::max((int)((height + threadCount - 1) / threadCount), 1);
+	this->threadCount = std::max((height + bandHeight - 1) / bandHeight, 1);
+
+	for (unsigned int i = 1; i < this->threadCount; i++)
+	{
+		workers.push_back(std::thread(&OcclusionRasterizer::Work, this, i));
+	}
+
+	depthBuffer.resize(this->width * this->height);
+	Clear();
+}
+
+OcclusionRasterizer::~OcclusionRasterizer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isStopping = true;
+	}
+	workReady.notify_all();
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void OcclusionRasterizer::Clear()
+{
+	std::fill(depthBuffer.begin(), depthBuffer.end(), 1.0f);
+	triangles.clear();
+}
+
+bool OcclusionRasterizer::ProjectToScreen(glm::vec4 clip, glm::vec3& screen)
+{
+	// Anything near or behind the camera is rejected instead of clipped, dropping occluders is always safe
+	if (clip.w < 0.001f)
+	{
+		return false;
+	}
+
+	glm::vec3 ndc = glm::vec3(clip) / clip.w;
+	screen = glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+
+	return true;
+}
+
+std::array<float, 6> OcclusionRasterizer::EdgeKey(glm::vec3 a, glm::vec3 b)
+{
+	// Same key from either direction, positions rather than indices since seams duplicate vertices
+	if (std::make_tuple(b.x, b.y, b.z) < std::make_tuple(a.x, a.y, a.z))
+	{
+		std::swap(a, b);
+	}
+
+	return { a.x, a.y, a.z, b.x, b.y, b.z };
+}
+
+float OcclusionRasterizer::SignedArea(const ScreenTriangle& triangle)
+{
+	const glm::vec3* v = triangle.vertices;
+	return (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+}
+
+glm::vec3 OcclusionRasterizer::DepthPlane(const ScreenTriangle& triangle)
+{
+	const glm::vec3* v = triangle.vertices;
+	float area = SignedArea(triangle);
+	float dzdx = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) / area;
+	float dzdy = ((v[2].z - v[0].z) * (v[1].x - v[0].x) - (v[1].z - v[0].z) * (v[2].x - v[0].x)) / area;
+
+	return glm::vec3(v[0].z - dzdx * v[0].x - dzdy * v[0].y, dzdx, dzdy);
+}
+
+void OcclusionRasterizer::AddOccluder(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, GLuint indexCount, glm::mat4 modelViewProjection)
+{
+	edges.clear();
+
+	for (GLuint i = 0; i + 2 < indexCount; i += 3)
+	{
+		ScreenTriangle triangle = {};
+		bool isValid = true;
+
+		for (int v = 0; v < 3 && isValid; v++)
+		{
+			isValid = ProjectToScreen(modelViewProjection * glm::vec4(vertices[indices[i + v]].position, 1.0f), triangle.vertices[v]);
+		}
+
+		// Dropped and degenerate triangles can't cover for a neighbour
+		if (!isValid || fabsf(SignedArea(triangle)) < 1e-8f)
+		{
+			continue;
+		}
+
+		for (int v = 0; v < 3; v++)
+		{
+			edges[EdgeKey(vertices[indices[i + (v + 1) % 3]].position, vertices[indices[i + (v + 2) % 3]].position)].push_back({ triangles.size(), v });
+		}
+		triangles.push_back(triangle);
+	}
+
+	// Two triangles facing the same way lie on opposite sides of their edge, together they cover the pixels along it
+	// Facing opposite ways the surface folds over and the edge is a silhouette
+	for (auto& edge : edges)
+	{
+		if (edge.second.size() != 2)
+		{
+			continue;
+		}
+
+		ScreenTriangle& first = triangles[edge.second[0].first];
+		ScreenTriangle& second = triangles[edge.second[1].first];
+		if ((SignedArea(first) > 0.0f) == (SignedArea(second) > 0.0f))
+		{
+			first.interiorEdges |= 1 << edge.second[0].second;
+			first.neighbourPlanes[edge.second[0].second] = DepthPlane(second);
+			second.interiorEdges |= 1 << edge.second[1].second;
+			second.neighbourPlanes[edge.second[1].second] = DepthPlane(first);
+		}
+	}
+}
+
+void OcclusionRasterizer::Render()
+{
+	if (workers.empty())
+	{
+		RasterizeBand(0, height);
+		return;
+	}
+
+	// Every thread walks all triangles but only touches its own rows
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingBands = (unsigned int)workers.size();
+		generation++;
+	}
+	workReady.notify_all();
+
+	RasterizeBand(0, std::min(bandHeight, height));
+
+	std::unique_lock<std::mutex> lock(mutex);
+	workDone.wait(lock, [this]() { return pendingBands == 0; });
+}
+
+void OcclusionRasterizer::Work(unsigned int band)
+{
+	int minY = band * bandHeight;
+	int maxY = std::min(minY + bandHeight, height);
+	unsigned int seenGeneration = 0;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		workReady.wait(lock, [&]() { return isStopping || generation != seenGeneration; });
+		if (isStopping)
+		{
+			return;
+		}
+		seenGeneration = generation;
+
+		lock.unlock();
+		RasterizeBand(minY, maxY);
+		lock.lock();
+
+		if (--pendingBands == 0)
+		{
+			workDone.notify_one();
+		}
+	}
+}
+
+void OcclusionRasterizer::RasterizeBand(int minY, int maxY)
+{
+	for (const ScreenTriangle& triangle : triangles)
+	{
+		RasterizeTriangle(triangle, minY, maxY);
+	}
+}
+
+void OcclusionRasterizer::RasterizeTriangle(const ScreenTriangle& triangle, int minY, int maxY)
+{
+	glm::vec3 v0 = triangle.vertices[0];
+	glm::vec3 v1 = triangle.vertices[1];
+	glm::vec3 v2 = triangle.vertices[2];
+	unsigned char interior = triangle.interiorEdges;
+	glm::vec3 planes[3] = { triangle.neighbourPlanes[0], triangle.neighbourPlanes[1], triangle.neighbourPlanes[2] };
+
+	// Make winding consistent so inside is positive, both faces are drawn
+	// Swapping the last two vertices swaps the edges opposite them
+	float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+	if (area < 0.0f)
+	{
+		std::swap(v1, v2);
+		std::swap(planes[1], planes[2]);
+		interior = (interior & 1) | ((interior & 2) << 1) | ((interior & 4) >> 1);
+		area = -area;
+	}
+
+	if (area < 1e-8f)
+	{
+		return;
+	}
+
+	// Pixel bounds clipped to the band
+	int startX = std::max((int)floorf(std::min(v0.x, std::min(v1.x, v2.x))), 0);
+	int endX = std::min((int)ceilf(std::max(v0.x, std::max(v1.x, v2.x))), width);
+	int startY = std::max((int)floorf(std::min(v0.y, std::min(v1.y, v2.y))), minY);
+	int endY = std::min((int)ceilf(std::max(v0.y, std::max(v1.y, v2.y))), maxY);
+
+	if (startX >= endX || startY >= endY)
+	{
+		return;
+	}
+
+	// Align to SSE groups
+	startX &= ~3;
+
+	// Edge function steps, edge i is opposite vertex i and starts at vertex i + 1
+	glm::vec3 corners[3] = { v0, v1, v2 };
+	float a[3] = { v1.y - v2.y, v2.y - v0.y, v0.y - v1.y };
+	float b[3] = { v2.x - v1.x, v0.x - v2.x, v1.x - v0.x };
+
+	// Depth is affine in screen space after the divide
+	float inverseArea = 1.0f / area;
+	float zStepX = (a[0] * v0.z + a[1] * v1.z + a[2] * v2.z) * inverseArea;
+	float zStepY = (b[0] * v0.z + b[1] * v1.z + b[2] * v2.z) * inverseArea;
+
+	// From a pixel center to its farthest corner, an edge function changes by at most half its steps
+	// Silhouette edges need the whole pixel inside, interior edges leave the rest of the pixel to their neighbour
+	// Depth is taken at the farthest corner, and where the pixel straddles an interior edge the neighbour's plane counts too
+	float px = startX + 0.5f;
+	__m128 offsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+	float eColumn[3];
+	float neighbourColumn[3];
+	__m128 eStep[3];
+	__m128 eAdvance[3];
+	__m128 coverThreshold[3];
+	__m128 straddleThreshold[3];
+	__m128 neighbourStep[3];
+	__m128 neighbourAdvance[3];
+	for (int i = 0; i < 3; i++)
+	{
+		glm::vec3 start = corners[(i + 1) % 3];
+		float halfStep = 0.5f * (fabsf(a[i]) + fabsf(b[i]));
+		bool isInterior = interior & (1 << i);
+
+		eColumn[i] = a[i] * (px - start.x);
+		eStep[i] = _mm_mul_ps(_mm_set1_ps(a[i]), offsets);
+		eAdvance[i] = _mm_set1_ps(a[i] * 4.0f);
+		coverThreshold[i] = _mm_set1_ps(isInterior ? 0.0f : halfStep);
+
+		// Never straddling disables the neighbour's plane
+		straddleThreshold[i] = _mm_set1_ps(isInterior ? halfStep : -FLT_MAX);
+		neighbourColumn[i] = planes[i].x + planes[i].y * px + 0.5f * (fabsf(planes[i].y) + fabsf(planes[i].z));
+		neighbourStep[i] = _mm_mul_ps(_mm_set1_ps(planes[i].y), offsets);
+		neighbourAdvance[i] = _mm_set1_ps(planes[i].y * 4.0f);
+	}
+
+	float zSlack = 0.5f * (fabsf(zStepX) + fabsf(zStepY));
+	__m128 zStep = _mm_mul_ps(_mm_set1_ps(zStepX), offsets);
+	__m128 zAdvance = _mm_set1_ps(zStepX * 4.0f);
+
+	for (int y = startY; y < endY; y++)
+	{
+		float* row = &depthBuffer[y * width];
+
+		// Evaluated per row rather than accumulated so the result doesn't depend on where a band starts
+		float py = y + 0.5f;
+		__m128 e[3];
+		__m128 neighbour[3];
+		float eRow[3];
+		for (int i = 0; i < 3; i++)
+		{
+			eRow[i] = eColumn[i] + b[i] * (py - corners[(i + 1) % 3].y);
+			e[i] = _mm_add_ps(_mm_set1_ps(eRow[i]), eStep[i]);
+			neighbour[i] = _mm_add_ps(_mm_set1_ps(neighbourColumn[i] + planes[i].z * py), neighbourStep[i]);
+		}
+		float zRow = (eRow[0] * v0.z + eRow[1] * v1.z + eRow[2] * v2.z) * inverseArea + zSlack;
+		__m128 z = _mm_add_ps(_mm_set1_ps(zRow), zStep);
+
+		for (int x = startX; x < endX; x += 4)
+		{
+			// Covered by all three edges and nearer than what is there
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e[0], coverThreshold[0]), _mm_cmpge_ps(e[1], coverThreshold[1])), _mm_cmpge_ps(e[2], coverThreshold[2]));
+
+			if (_mm_movemask_ps(inside))
+			{
+				__m128 farthest = z;
+				for (int i = 0; i < 3; i++)
+				{
+					__m128 straddles = _mm_cmplt_ps(e[i], straddleThreshold[i]);
+					farthest = _mm_max_ps(farthest, _mm_and_ps(straddles, neighbour[i]));
+				}
+
+				__m128 previous = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_min_ps(previous, farthest);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+			}
+
+			for (int i = 0; i < 3; i++)
+			{
+				e[i] = _mm_add_ps(e[i], eAdvance[i]);
+				neighbour[i] = _mm_add_ps(neighbour[i], neighbourAdvance[i]);
+			}
+			z = _mm_add_ps(z, zAdvance);
+		}
+	}
+}
+
+bool OcclusionRasterizer::IsVisible(AABB bounds, glm::mat4 viewProjection)
+{
+	glm::vec3 minScreen = glm::vec3(FLT_MAX);
+	glm::vec3 maxScreen = glm::vec3(-FLT_MAX);
+
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner = glm::vec3(
+			(i & 1) ? bounds.max.x : bounds.min.x,
+			(i & 2) ? bounds.max.y : bounds.min.y,
+			(i & 4) ? bounds.max.z : bounds.min.z);
+
+		// Crosses the near plane, treat as visible
+		glm::vec3 screen;
+		if (!ProjectToScreen(viewProjection * glm::vec4(corner, 1.0f), screen))
+		{
+			return true;
+		}
+
+		minScreen = glm::min(minScreen, screen);
+		maxScreen = glm::max(maxScreen, screen);
+	}
+
+	int startX = std::max((int)floorf(minScreen.x), 0);
+	int endX = std::min((int)ceilf(maxScreen.x), width);
+	int startY = std::max((int)floorf(minScreen.y), 0);
+	int endY = std::min((int)ceilf(maxScreen.y), height);
+
+	// Off screen is the frustum's call
+	if (startX >= endX || startY >= endY)
+	{
+		return true;
+	}
+
+	// Visible if any covered pixel is further away than the box's nearest point
+	__m128 nearest = _mm_set1_ps(minScreen.z);
+
+	for (int y = startY; y < endY; y++)
+	{
+		const float* row = &depthBuffer[y * width];
+		int x = startX;
+
+		for (; x + 4 <= endX; x += 4)
+		{
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), nearest)))
+			{
+				return true;
+			}
+		}
+
+		for (; x < endX; x++)
+		{
+			if (row[x] >= minScreen.z)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <array>
+#include <tuple>
+
+#include <emmintrin.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+// Occluder triangle after projection, x and y in pixels and z in [0, 1]
+struct ScreenTriangle
+{
+	glm::vec3 vertices[3];
+
+	// Bit i is set when the edge opposite vertex i continues into a triangle facing the same way on screen
+	unsigned char interiorEdges;
+
+	// That triangle's depth as z = x + y * px + z * py, for pixels straddling the edge
+	glm::vec3 neighbourPlanes[3];
+};
+
+// Small depth only software rasterizer for occlusion culling on the CPU
+// Makes no GL calls, the depth buffer is split into horizontal bands with one thread per band so results are deterministic
+// Band threads are started once and woken for each Render, the calling thread does the first band
+// Coverage is conservative, silhouette edges only write pixels they cover completely and depth is the farthest in the pixel
+class OcclusionRasterizer
+{
+public:
+	// Width is rounded up to a multiple of four for SSE
+	OcclusionRasterizer(int width, int height, unsigned int threadCount = 0);
+	~OcclusionRasterizer();
+
+	// Reset depth to the far plane and drop queued occluders
+	void Clear();
+
+	// Queue an occluder, positions are transformed by modelViewProjection when rendered
+	void AddOccluder(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, GLuint indexCount, glm::mat4 modelViewProjection);
+
+	// Rasterize all queued occluders
+	void Render();
+
+	// False if the whole box is behind the rasterized occluders
+	bool IsVisible(AABB bounds, glm::mat4 viewProjection);
+
+	// Getters
+	int GetWidth() { return width; }
+	int GetHeight() { return height; }
+	unsigned int GetThreadCount() { return threadCount; }
+	const std::vector<float>& GetDepthBuffer() { return depthBuffer; }
+
+private:
+	int width;
+	int height;
+	unsigned int threadCount;
+	int bandHeight;
+
+	// Workers wait for the generation to change, the last one to finish wakes Render
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable workReady;
+	std::condition_variable workDone;
+	unsigned int generation = 0;
+	unsigned int pendingBands = 0;
+	bool isStopping = false;
+
+	// Row major, 0 is near and 1 is far
+	std::vector<float> depthBuffer;
+
+	std::vector<ScreenTriangle> triangles;
+
+	// Triangles of the occluder being added on each edge, keyed by its end positions
+	std::map<std::array<float, 6>, std::vector<std::pair<size_t, int>>> edges;
+
+	void Work(unsigned int band);
+	void RasterizeBand(int minY, int maxY);
+	void RasterizeTriangle(const ScreenTriangle& triangle, int minY, int maxY);
+	bool ProjectToScreen(glm::vec4 clip, glm::vec3& screen);
+	std::array<float, 6> EdgeKey(glm::vec3 a, glm::vec3 b);
+	glm::vec3 DepthPlane(const ScreenTriangle& triangle);
+	float SignedArea(const ScreenTriangle& triangle);
+};
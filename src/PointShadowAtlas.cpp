@@ -0,0 +1,249 @@
+#include "PointShadowAtlas.h"
+#include "Scene.h"
+
+PointShadowAtlas::PointShadowAtlas()
+{
+	glGenTextures(1, &atlas);
+	glBindTexture(GL_TEXTURE_2D, atlas);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, ATLAS_SIZE, ATLAS_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenFramebuffers(1, &atlasFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, atlasFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, atlas, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR::FRAMEBUFFER::Point shadow atlas is not complete!" << std::endl;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// Sized for the most shadows there can be, the shaders only read the ones lights point at
+	glGenBuffers(1, &shadowSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadowSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_SHADOWS * sizeof(PointShadow), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+PointShadowAtlas::~PointShadowAtlas()
+{
+	glDeleteFramebuffers(1, &atlasFBO);
+	glDeleteTextures(1, &atlas);
+	glDeleteBuffers(1, &shadowSSBO);
+}
+
+void PointShadowAtlas::Allocate(const std::vector<PointLight*>& pointLights, Camera* camera, Frustum& cameraFrustum, int screenHeight)
+{
+	shadowIndices.assign(pointLights.size(), -1);
+	shadowedLights.clear();
+	shadows.clear();
+	candidates.clear();
+
+	// Importance is the projected radius of the light's range, only casters whose range is on screen compete
+	glm::vec3 cameraPosition = camera->GetTransform()->GetPosition();
+	float projectionScale = camera->GetProjectionMatrix()[1][1];
+	for (size_t i = 0; i < pointLights.size(); i++)
+	{
+		PointLight* light = pointLights[i];
+		if (!light->isShadowCaster || !cameraFrustum.IsSphereVisible({ light->position, light->range }))
+		{
+			continue;
+		}
+
+		float distance = std::max(glm::length(light->position - cameraPosition), light->range);
+		candidates.push_back({ light->range / distance * projectionScale, (int)i });
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first > b.first; });
+
+	// Tiles are handed out largest first, so shelves of descending powers of two pack without gaps
+	int budget = ATLAS_SIZE * ATLAS_SIZE;
+	int cursorX = 0;
+	int cursorY = 0;
+	int shelfHeight = 0;
+	int previousSize = MAX_TILE_SIZE;
+
+	for (const std::pair<float, int>& candidate : candidates)
+	{
+		if (shadows.size() >= MAX_SHADOWS)
+		{
+			break;
+		}
+
+		// A face covers a quarter turn, roughly matching the texels the light covers on screen
+		float screenPixels = candidate.first * screenHeight * 0.5f;
+		int size = MIN_TILE_SIZE;
+		while (size < MAX_TILE_SIZE && size < screenPixels)
+		{
+			size *= 2;
+		}
+
+		// Never bigger than the last light's tiles, keeps the shelves descending
+		size = std::min(size, previousSize);
+		while (size > MIN_TILE_SIZE && size * size * 6 > budget)
+		{
+			size /= 2;
+		}
+		if (size * size * 6 > budget)
+		{
+			break;
+		}
+
+		PointLight* light = pointLights[candidate.second];
+		PointShadow shadow;
+
+		// +X, -X, +Y, -Y, +Z, -Z, the shaders pick the face by major axis in the same order
+		const glm::vec3 directions[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+		const glm::vec3 ups[6] = { glm::vec3(0, 1, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, -1), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0), glm::vec3(0, 1, 0) };
+		glm::mat4 projection = glm::perspectiveLH(glm::radians(90.0f), 1.0f, NEAR_PLANE, light->range);
+
+		bool isPacked = true;
+		for (int face = 0; face < 6; face++)
+		{
+			if (cursorX + size > ATLAS_SIZE)
+			{
+				cursorX = 0;
+				cursorY += shelfHeight;
+				shelfHeight = 0;
+			}
+			if (cursorY + size > ATLAS_SIZE)
+			{
+				isPacked = false;
+				break;
+			}
+
+			shadow.faceMatrices[face] = projection * glm::lookAtLH(light->position, light->position + directions[face], ups[face]);
+			shadow.faceTiles[face] = glm::vec4((float)cursorX / ATLAS_SIZE, (float)cursorY / ATLAS_SIZE, (float)size / ATLAS_SIZE, (float)size);
+
+			cursorX += size;
+			shelfHeight = std::max(shelfHeight, size);
+		}
+
+		if (!isPacked)
+		{
+			break;
+		}
+
+		budget -= size * size * 6;
+		previousSize = size;
+
+		shadowIndices[candidate.second] = shadows.size();
+		shadowedLights.push_back(light);
+		shadows.push_back(shadow);
+	}
+
+	// Lights that lost their tiles start over if they get them back
+	for (auto it = faceCaches.begin(); it != faceCaches.end();)
+	{
+		if (std::find(shadowedLights.begin(), shadowedLights.end(), it->first) == shadowedLights.end())
+		{
+			it = faceCaches.erase(it);
+		}
+		else
+		{
+			it++;
+		}
+	}
+
+	if (!shadows.empty())
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadowSSBO);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, shadows.size() * sizeof(PointShadow), shadows.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+}
+
+void PointShadowAtlas::Render(Scene* scene)
+{
+	facesDrawn = 0;
+
+	Shader* depthShader = scene->GetShader("SimpleDepth");
+	unsigned int staticVersion = scene->GetSpatialIndex()->GetStaticVersion();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, atlasFBO);
+	glEnable(GL_SCISSOR_TEST);
+	glCullFace(GL_BACK);
+	depthShader->Use();
+
+	Frustum faceFrustum;
+	for (size_t i = 0; i < shadows.size(); i++)
+	{
+		PointLight* light = shadowedLights[i];
+		glm::vec4 positionRange = glm::vec4(light->position, light->range);
+		std::array<FaceCache, 6>& caches = faceCaches[light];
+
+		// Everything that can cast for this light, split into faces below
+		casters.clear();
+		scene->GetSpatialIndex()->QuerySphere({ light->position, light->range }, casters);
+
+		for (int face = 0; face < 6; face++)
+		{
+			glm::mat4 faceMatrix = shadows[i].faceMatrices[face];
+			glm::vec4 tile = shadows[i].faceTiles[face];
+			faceFrustum.ExtractPlanes(faceMatrix);
+
+			bool hasDynamicCasters = false;
+			for (Entity* entity : casters)
+			{
+				if (!entity->isStatic && faceFrustum.IsAABBVisible(entity->GetWorldAABB()))
+				{
+					hasDynamicCasters = true;
+					break;
+				}
+			}
+
+			// Dynamic casters that just left still have to be cleared out
+			FaceCache& cache = caches[face];
+			if (cache.tile == tile && cache.positionRange == positionRange && cache.staticVersion == staticVersion && !cache.hadDynamicCasters && !hasDynamicCasters)
+			{
+				continue;
+			}
+
+			cache.tile = tile;
+			cache.positionRange = positionRange;
+			cache.staticVersion = staticVersion;
+			cache.hadDynamicCasters = hasDynamicCasters;
+
+			int x = (int)(tile.x * ATLAS_SIZE);
+			int y = (int)(tile.y * ATLAS_SIZE);
+			int size = (int)tile.w;
+			glViewport(x, y, size, size);
+			glScissor(x, y, size, size);
+			glClear(GL_DEPTH_BUFFER_BIT);
+
+			depthShader->SetMat4("lightSpaceMatrix", faceMatrix);
+			for (Entity* entity : casters)
+			{
+				if (faceFrustum.IsAABBVisible(entity->GetWorldAABB()))
+				{
+					// LOD from this face's projection, a 90 degree field of view scales by one, the entity's shadow LOD belongs to the cascades
+					// Selecting up from LOD 0 keeps it stateless, so cached faces redraw the same
+					BoundingSphere sphere = entity->GetWorldBoundingSphere();
+					float w = (faceMatrix * glm::vec4(sphere.center, 1.0f)).w;
+					int lod = entity->GetMesh()->SelectLOD(sphere.radius / std::max(w, 0.001f), 0);
+
+					depthShader->SetMat4("model", entity->GetTransform()->GetModelMatrix());
+					entity->GetMesh()->DrawDepth(lod);
+				}
+			}
+
+			facesDrawn++;
+		}
+	}
+
+	glDisable(GL_SCISSOR_TEST);
+}
+
+void PointShadowAtlas::Bind(GLuint sampler)
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SHADOW_BINDING, shadowSSBO);
+
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, atlas);
+	glBindSampler(TEXTURE_UNIT, sampler);
+}
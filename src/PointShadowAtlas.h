@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Camera.h"
+#include "Frustum.h"
+#include "Shader.h"
+
+class Scene;
+class Entity;
+struct PointLight;
+
+// Cube shadow as the shaders read it, tiles are atlas uv offset, uv size and size in texels
+struct PointShadow
+{
+	glm::mat4 faceMatrices[6];
+	glm::vec4 faceTiles[6];
+};
+
+// Omnidirectional shadows for point lights
+// Each shadowed light gets six cube face tiles in one depth atlas, sized by how much of the screen the light covers
+// Faces are only redrawn when their tile, the light or a caster under them changes
+class PointShadowAtlas
+{
+public:
+	PointShadowAtlas();
+	~PointShadowAtlas();
+
+	// Pick the shadowed lights and lay out their tiles for this frame
+	void Allocate(const std::vector<PointLight*>& pointLights, Camera* camera, Frustum& cameraFrustum, int screenHeight);
+
+	// Draw stale faces into the atlas
+	void Render(Scene* scene);
+
+	// Bind the shadow buffer and atlas for shading
+	void Bind(GLuint sampler);
+
+	// Getters, shadow indices line up with the light list given to Allocate and are -1 for unshadowed lights
+	const std::vector<int>& GetShadowIndices() { return shadowIndices; }
+	unsigned int GetShadowCount() { return shadows.size(); }
+	unsigned int GetFacesDrawn() { return facesDrawn; }
+	GLuint GetAtlas() { return atlas; }
+
+	// Atlas size is the texel budget, tiles are powers of two between the limits
+	static const int ATLAS_SIZE = 2048;
+	static const int MIN_TILE_SIZE = 64;
+	static const int MAX_TILE_SIZE = 512;
+	static const unsigned int MAX_SHADOWS = 16;
+
+	// Texture unit and buffer binding the shaders expect
+	static const GLuint TEXTURE_UNIT = 9;
+	static const GLuint SHADOW_BINDING = 12;
+
+private:
+	GLuint atlasFBO;
+	GLuint atlas;
+	GLuint shadowSSBO;
+
+	// What a face was last drawn with, compared each frame to decide if it is stale
+	struct FaceCache
+	{
+		glm::vec4 tile = glm::vec4(-1.0f);
+		glm::vec4 positionRange = glm::vec4(0.0f);
+		unsigned int staticVersion = 0;
+		bool hadDynamicCasters = false;
+	};
+	std::unordered_map<PointLight*, std::array<FaceCache, 6>> faceCaches;
+
+	// This frame's shadowed lights, parallel to shadows
+	std::vector<PointLight*> shadowedLights;
+	std::vector<PointShadow> shadows;
+	std::vector<int> shadowIndices;
+
+	// Scratch
+	std::vector<std::pair<float, int>> candidates;
+	std::vector<Entity*> casters;
+	unsigned int facesDrawn = 0;
+
+	const float NEAR_PLANE = 0.05f;
+};
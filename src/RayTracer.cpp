@@ -0,0 +1,392 @@
+#include "RayTracer.h"
+
+namespace
+{
+	// Keeps rays from hitting the surface they start on
+	const float RAY_EPSILON = 1e-4f;
+
+	bool IntersectAABB(const AABB& bounds, glm::vec3 origin, glm::vec3 inverseDirection, float maxDistance)
+	{
+		glm::vec3 t0 = (bounds.min - origin) * inverseDirection;
+		glm::vec3 t1 = (bounds.max - origin) * inverseDirection;
+		glm::vec3 near = glm::min(t0, t1);
+		glm::vec3 far = glm::max(t0, t1);
+
+		float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+		float exit = std::min(std::min(far.x, far.y), std::min(far.z, maxDistance));
+
+		return enter <= exit;
+	}
+
+	// Moller-Trumbore, double sided
+	bool IntersectTriangle(const RayTriangle& triangle, glm::vec3 origin, glm::vec3 direction, float& distance, float& u, float& v)
+	{
+		glm::vec3 p = glm::cross(direction, triangle.edge2);
+		float determinant = glm::dot(triangle.edge1, p);
+		if (fabsf(determinant) < 1e-10f)
+		{
+			return false;
+		}
+
+		float inverseDeterminant = 1.0f / determinant;
+		glm::vec3 s = origin - triangle.v0;
+		float hitU = glm::dot(s, p) * inverseDeterminant;
+		if (hitU < 0.0f || hitU > 1.0f)
+		{
+			return false;
+		}
+
+		glm::vec3 q = glm::cross(s, triangle.edge1);
+		float hitV = glm::dot(direction, q) * inverseDeterminant;
+		if (hitV < 0.0f || hitU + hitV > 1.0f)
+		{
+			return false;
+		}
+
+		float t = glm::dot(triangle.edge2, q) * inverseDeterminant;
+		if (t <= RAY_EPSILON || t >= distance)
+		{
+			return false;
+		}
+
+		distance = t;
+		u = hitU;
+		v = hitV;
+		return true;
+	}
+
+	inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+}
+
+RayTracer::RayTracer()
+{
+}
+
+void RayTracer::AddMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, MeshLOD lod, const glm::mat4& model, int object)
+{
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+
+	for (GLuint i = 0; i + 2 < lod.indexCount; i += 3)
+	{
+		glm::vec3 corners[3];
+		glm::vec3 normal = glm::vec3(0.0f);
+		for (int c = 0; c < 3; c++)
+		{
+			const Vertex& vertex = vertices[lod.baseVertex + indices[lod.firstIndex + i + c]];
+			corners[c] = glm::vec3(model * glm::vec4(vertex.position, 1.0f));
+			normal += vertex.normal;
+		}
+
+		// Winding isn't consistent between meshes or under mirroring, so orient against the normals instead
+		glm::vec3 edge1 = corners[1] - corners[0];
+		glm::vec3 edge2 = corners[2] - corners[0];
+		if (glm::dot(glm::cross(edge1, edge2), normalMatrix * normal) < 0.0f)
+		{
+			std::swap(edge1, edge2);
+		}
+
+		triangles.push_back({ corners[0], edge1, edge2, object });
+	}
+}
+
+void RayTracer::Build()
+{
+	nodes.clear();
+	if (triangles.empty())
+	{
+		return;
+	}
+
+	triangleBounds.resize(triangles.size());
+	centroids.resize(triangles.size());
+	order.resize(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		glm::vec3 v1 = triangles[i].v0 + triangles[i].edge1;
+		glm::vec3 v2 = triangles[i].v0 + triangles[i].edge2;
+		triangleBounds[i] = { glm::min(triangles[i].v0, glm::min(v1, v2)), glm::max(triangles[i].v0, glm::max(v1, v2)) };
+		centroids[i] = (triangles[i].v0 + v1 + v2) / 3.0f;
+		order[i] = i;
+	}
+
+	// A binary tree with n leaves has 2n - 1 nodes
+	nodes.reserve(triangles.size() * 2);
+	nodes.push_back({});
+	Subdivide(0, 0, triangles.size());
+
+	// Leaves index ranges of the sorted order, so reorder the triangles to match
+	std::vector<RayTriangle> sorted(triangles.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		sorted[i] = triangles[order[i]];
+	}
+	triangles.swap(sorted);
+
+	triangleBounds.clear();
+	centroids.clear();
+	order.clear();
+}
+
+void RayTracer::Subdivide(int nodeIndex, int begin, int end)
+{
+	AABB bounds = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+	AABB centroidBounds = bounds;
+	for (int i = begin; i < end; i++)
+	{
+		bounds.min = glm::min(bounds.min, triangleBounds[order[i]].min);
+		bounds.max = glm::max(bounds.max, triangleBounds[order[i]].max);
+		centroidBounds.min = glm::min(centroidBounds.min, centroids[order[i]]);
+		centroidBounds.max = glm::max(centroidBounds.max, centroids[order[i]]);
+	}
+
+	nodes[nodeIndex].bounds = bounds;
+
+	glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+	int axis = extent.x > extent.y && extent.x > extent.z ? 0 : (extent.y > extent.z ? 1 : 2);
+
+	// Small enough, or every centroid is in the same place so no split would separate them
+	if (end - begin <= LEAF_SIZE || extent[axis] <= 0.0f)
+	{
+		nodes[nodeIndex].first = begin;
+		nodes[nodeIndex].count = end - begin;
+		return;
+	}
+
+	int middle = (begin + end) / 2;
+	std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+		[&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+	// Children are allocated together so the second is always first + 1
+	int left = nodes.size();
+	nodes.push_back({});
+	nodes.push_back({});
+	nodes[nodeIndex].first = left;
+	nodes[nodeIndex].count = 0;
+
+	Subdivide(left, begin, middle);
+	Subdivide(left + 1, middle, end);
+}
+
+bool RayTracer::Intersect(glm::vec3 origin, glm::vec3 direction, float maxDistance, RayHit& hit) const
+{
+	hit.distance = maxDistance;
+	hit.triangle = -1;
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	glm::vec3 inverseDirection = 1.0f / direction;
+	int stack[STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const RayNode& node = nodes[stack[--stackSize]];
+		if (!IntersectAABB(node.bounds, origin, inverseDirection, hit.distance))
+		{
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			for (int i = node.first; i < node.first + node.count; i++)
+			{
+				if (IntersectTriangle(triangles[i], origin, direction, hit.distance, hit.u, hit.v))
+				{
+					hit.triangle = i;
+				}
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node.first;
+			stack[stackSize++] = node.first + 1;
+		}
+	}
+
+	return hit.triangle != -1;
+}
+
+bool RayTracer::IsOccluded(glm::vec3 origin, glm::vec3 direction, float maxDistance) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	glm::vec3 inverseDirection = 1.0f / direction;
+	int stack[STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	float u, v;
+	while (stackSize > 0)
+	{
+		const RayNode& node = nodes[stack[--stackSize]];
+		if (!IntersectAABB(node.bounds, origin, inverseDirection, maxDistance))
+		{
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			// Any hit will do
+			for (int i = node.first; i < node.first + node.count; i++)
+			{
+				float distance = maxDistance;
+				if (IntersectTriangle(triangles[i], origin, direction, distance, u, v))
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node.first;
+			stack[stackSize++] = node.first + 1;
+		}
+	}
+
+	return false;
+}
+
+void RayTracer::IntersectPacket(const RayPacket& packet, RayHit hits[4]) const
+{
+	alignas(16) float closestDistance[4];
+	alignas(16) float hitU[4];
+	alignas(16) float hitV[4];
+	for (int lane = 0; lane < 4; lane++)
+	{
+		hits[lane].triangle = -1;
+		hits[lane].distance = packet.maxDistance[lane];
+	}
+
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	__m128 originX = _mm_loadu_ps(packet.originX);
+	__m128 originY = _mm_loadu_ps(packet.originY);
+	__m128 originZ = _mm_loadu_ps(packet.originZ);
+	__m128 directionX = _mm_loadu_ps(packet.directionX);
+	__m128 directionY = _mm_loadu_ps(packet.directionY);
+	__m128 directionZ = _mm_loadu_ps(packet.directionZ);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 zero = _mm_setzero_ps();
+	__m128 inverseX = _mm_div_ps(one, directionX);
+	__m128 inverseY = _mm_div_ps(one, directionY);
+	__m128 inverseZ = _mm_div_ps(one, directionZ);
+	__m128 closest = _mm_loadu_ps(packet.maxDistance);
+	__m128 epsilon = _mm_set1_ps(RAY_EPSILON);
+	__m128 determinantEpsilon = _mm_set1_ps(1e-10f);
+	__m128 signMask = _mm_set1_ps(-0.0f);
+
+	int stack[STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const RayNode& node = nodes[stack[--stackSize]];
+
+		// Slab test for all four rays, the node is visited if any of them enters it
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds.min.x), originX), inverseX);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds.max.x), originX), inverseX);
+		__m128 enter = _mm_min_ps(t0, t1);
+		__m128 exit = _mm_max_ps(t0, t1);
+
+		t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds.min.y), originY), inverseY);
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds.max.y), originY), inverseY);
+		enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+		exit = _mm_min_ps(exit, _mm_max_ps(t0, t1));
+
+		t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds.min.z), originZ), inverseZ);
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bounds.max.z), originZ), inverseZ);
+		enter = _mm_max_ps(_mm_max_ps(enter, _mm_min_ps(t0, t1)), zero);
+		exit = _mm_min_ps(_mm_min_ps(exit, _mm_max_ps(t0, t1)), closest);
+
+		if (_mm_movemask_ps(_mm_cmple_ps(enter, exit)) == 0)
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			stack[stackSize++] = node.first;
+			stack[stackSize++] = node.first + 1;
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++)
+		{
+			const RayTriangle& triangle = triangles[i];
+			__m128 edge1X = _mm_set1_ps(triangle.edge1.x);
+			__m128 edge1Y = _mm_set1_ps(triangle.edge1.y);
+			__m128 edge1Z = _mm_set1_ps(triangle.edge1.z);
+			__m128 edge2X = _mm_set1_ps(triangle.edge2.x);
+			__m128 edge2Y = _mm_set1_ps(triangle.edge2.y);
+			__m128 edge2Z = _mm_set1_ps(triangle.edge2.z);
+
+			// p = direction x edge2
+			__m128 pX = _mm_sub_ps(_mm_mul_ps(directionY, edge2Z), _mm_mul_ps(directionZ, edge2Y));
+			__m128 pY = _mm_sub_ps(_mm_mul_ps(directionZ, edge2X), _mm_mul_ps(directionX, edge2Z));
+			__m128 pZ = _mm_sub_ps(_mm_mul_ps(directionX, edge2Y), _mm_mul_ps(directionY, edge2X));
+
+			__m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1X, pX), _mm_mul_ps(edge1Y, pY)), _mm_mul_ps(edge1Z, pZ));
+			__m128 mask = _mm_cmpgt_ps(_mm_andnot_ps(signMask, determinant), determinantEpsilon);
+			__m128 inverseDeterminant = _mm_div_ps(one, determinant);
+
+			// s = origin - v0
+			__m128 sX = _mm_sub_ps(originX, _mm_set1_ps(triangle.v0.x));
+			__m128 sY = _mm_sub_ps(originY, _mm_set1_ps(triangle.v0.y));
+			__m128 sZ = _mm_sub_ps(originZ, _mm_set1_ps(triangle.v0.z));
+
+			__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sX, pX), _mm_mul_ps(sY, pY)), _mm_mul_ps(sZ, pZ)), inverseDeterminant);
+
+			// q = s x edge1
+			__m128 qX = _mm_sub_ps(_mm_mul_ps(sY, edge1Z), _mm_mul_ps(sZ, edge1Y));
+			__m128 qY = _mm_sub_ps(_mm_mul_ps(sZ, edge1X), _mm_mul_ps(sX, edge1Z));
+			__m128 qZ = _mm_sub_ps(_mm_mul_ps(sX, edge1Y), _mm_mul_ps(sY, edge1X));
+
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, qX), _mm_mul_ps(directionY, qY)), _mm_mul_ps(directionZ, qZ)), inverseDeterminant);
+			__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2X, qX), _mm_mul_ps(edge2Y, qY)), _mm_mul_ps(edge2Z, qZ)), inverseDeterminant);
+
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+			mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+			mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, epsilon));
+			mask = _mm_and_ps(mask, _mm_cmplt_ps(t, closest));
+
+			int lanes = _mm_movemask_ps(mask);
+			if (lanes == 0)
+			{
+				continue;
+			}
+
+			closest = Select(mask, t, closest);
+			_mm_store_ps(hitU, u);
+			_mm_store_ps(hitV, v);
+			for (int lane = 0; lane < 4; lane++)
+			{
+				if (lanes & (1 << lane))
+				{
+					hits[lane].triangle = i;
+					hits[lane].u = hitU[lane];
+					hits[lane].v = hitV[lane];
+				}
+			}
+		}
+	}
+
+	_mm_store_ps(closestDistance, closest);
+	for (int lane = 0; lane < 4; lane++)
+	{
+		hits[lane].distance = closestDistance[lane];
+	}
+}
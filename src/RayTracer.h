@@ -0,0 +1,92 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+
+#include <emmintrin.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+// Closest hit along a ray, triangle is -1 on a miss
+struct RayHit
+{
+	float distance;
+	int triangle;
+
+	// Barycentrics of the second and third corner
+	float u;
+	float v;
+};
+
+// Four rays traced together, each component loads straight into an SSE register
+struct RayPacket
+{
+	float originX[4];
+	float originY[4];
+	float originZ[4];
+	float directionX[4];
+	float directionY[4];
+	float directionZ[4];
+	float maxDistance[4];
+};
+
+// World space triangle, edges are kept for the intersection test
+// Wound so cross(edge1, edge2) points out of the surface, the way the vertex normals do
+struct RayTriangle
+{
+	glm::vec3 v0;
+	glm::vec3 edge1;
+	glm::vec3 edge2;
+
+	// Caller's id for whatever the triangle came from
+	int object;
+};
+
+struct RayNode
+{
+	AABB bounds;
+
+	// Interior nodes point at the first of two adjacent children, leaves at their first triangle
+	int first;
+	int count;
+};
+
+// CPU ray tracer over world space triangles
+// BVH split at the centroid median of the widest axis, traced one ray at a time or four at once with SSE
+// Queries don't modify anything so any number of threads can trace once it is built
+class RayTracer
+{
+public:
+	RayTracer();
+
+	// Append one LOD of a mesh transformed by model
+	void AddMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, MeshLOD lod, const glm::mat4& model, int object);
+
+	// Call once after every mesh has been added
+	void Build();
+
+	// Queries
+	bool Intersect(glm::vec3 origin, glm::vec3 direction, float maxDistance, RayHit& hit) const;
+	bool IsOccluded(glm::vec3 origin, glm::vec3 direction, float maxDistance) const;
+	void IntersectPacket(const RayPacket& packet, RayHit hits[4]) const;
+
+	// Getters
+	const RayTriangle& GetTriangle(int index) const { return triangles[index]; }
+	unsigned int GetTriangleCount() const { return triangles.size(); }
+	unsigned int GetNodeCount() const { return nodes.size(); }
+
+private:
+	std::vector<RayTriangle> triangles;
+	std::vector<RayNode> nodes;
+
+	// Build scratch
+	std::vector<AABB> triangleBounds;
+	std::vector<glm::vec3> centroids;
+	std::vector<int> order;
+
+	static const int LEAF_SIZE = 4;
+	static const int STACK_SIZE = 64;
+
+	void Subdivide(int nodeIndex, int begin, int end);
+};
@@ -16,8 +16,8 @@ Renderer::Renderer(int width, int height, Scene* scene, GLFWwindow* window)
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
 	// Bind texture to FBO
 	glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
@@ -26,6 +26,16 @@ Renderer::Renderer(int width, int height, Scene* scene, GLFWwindow* window)
 	glReadBuffer(GL_NONE);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+	// Shadow map unit compares against the reference depth, linear filtering turns each fetch into 2x2 PCF
+	glGenSamplers(1, &shadowSampler);
+	glSamplerParameteri(shadowSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(shadowSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(shadowSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(shadowSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(shadowSampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glSamplerParameteri(shadowSampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindSampler(7, shadowSampler);
+
 
 	// Generate framebuffer object and bind
 	glGenFramebuffers(1, &FBO);
@@ -43,23 +53,23 @@ Renderer::Renderer(int width, int height, Scene* scene, GLFWwindow* window)
 		std::cout << "ERROR::FRAMEBUFFER::Framebuffer is not complete!" << std::endl;
 	}
 
+	// Sky maps only get baked when their sources or bake settings changed since the last run
+	TextureCache textureCache("Content/Cache/");
+
 	std::vector<Sky*> skies = scene->GetSkies();
 	if (skies.size() > 0)
 	{
 		for (Sky* sky : skies)
 		{
 			// Create sky maps
-			sky->CreateIrradianceMap(FBO, RBO);
-			sky->CreateConvolvedSpecularMap(FBO, RBO);
+			sky->CreateConvolvedSpecularMap(FBO, RBO, &textureCache);
 
 			//glCullFace(GL_FRONT);
-			sky->CreateBRDFLookUpTexture(FBO, RBO);
+			sky->CreateBRDFLookUpTexture(FBO, RBO, &textureCache);
 		}
 	}
-	//glDeleteRenderbuffers(1, &RBO);
-	
-	// Resize renderbuffer
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+	std::cout << "Sky maps cached: " << textureCache.GetHitCount() << ", baked: " << textureCache.GetMissCount() << std::endl;
 
 	// Before rendering, configure the viewport to the original framebuffer's screen dimensions
 	glViewport(0, 0, width, height);
@@ -74,24 +84,27 @@ Renderer::Renderer(int width, int height, Scene* scene, GLFWwindow* window)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
 	
-	// Generate normal buffer texture, bind, attach
+	// Generate normal buffer texture, bind, attach, octahedral so negative components survive
 	glGenTextures(1, &normalTexture);
 	glBindTexture(GL_TEXTURE_2D, normalTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, width, height, 0, GL_RG, GL_UNSIGNED_SHORT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
 
-	// Generate depth buffer texture, bind, attach
+	// Generate depth texture, bind, attach, replaces the renderbuffer the sky bakes used so later passes can sample it
 	glGenTextures(1, &depthTexture);
 	glBindTexture(GL_TEXTURE_2D, depthTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, depthTexture, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	glDeleteRenderbuffers(1, &RBO);
 
-	GLenum DrawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-	glDrawBuffers(3, DrawBuffers); 
+	GLenum DrawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, DrawBuffers); 
 
 	// Check if framebuffer is complete
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
@@ -99,11 +112,112 @@ Renderer::Renderer(int width, int height, Scene* scene, GLFWwindow* window)
 		std::cout << "ERROR::FRAMEBUFFER::Framebuffer is not complete!" << std::endl;
 	}
 
+	// Deferred lighting writes the same color targets without depth attached, depth is one of its inputs
+	glGenFramebuffers(1, &lightingFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, lightingFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+	glDrawBuffers(2, DrawBuffers);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR::FRAMEBUFFER::Lighting framebuffer is not complete!" << std::endl;
+	}
+
+	// G-buffer for deferred shading, albedo and octahedral normal with roughness and metallic, shares the scene depth
+	glGenFramebuffers(1, &gBufferFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, gBufferFBO);
+
+	glGenTextures(1, &gAlbedoTexture);
+	glBindTexture(GL_TEXTURE_2D, gAlbedoTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gAlbedoTexture, 0);
+
+	glGenTextures(1, &gNormalTexture);
+	glBindTexture(GL_TEXTURE_2D, gNormalTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, width, height, 0, GL_RGBA, GL_UNSIGNED_SHORT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormalTexture, 0);
+
+	// Diffuse irradiance from the lightmap, probes or sky, alpha marks lightmapped pixels
+	glGenTextures(1, &gIrradianceTexture);
+	glBindTexture(GL_TEXTURE_2D, gIrradianceTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gIrradianceTexture, 0);
+
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+	GLenum gBufferDrawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, gBufferDrawBuffers);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "ERROR::FRAMEBUFFER::G-buffer is not complete!" << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
 	// Enable seamless cubemap sampling for lower mip levels in the convolved specular map
 	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
 	glEnable(GL_CULL_FACE);
 	glFrontFace(GL_CW);	// Set front faces
+
+	occlusionCuller = new OcclusionCuller(width, height, scene->GetShader("HiZDownsample"), scene->GetShader("HiZCull"));
+	occlusionRasterizer = new OcclusionRasterizer(256, 128);
+	lightClusterer = new LightClusterer(scene->GetShader("LightCluster"));
+	pointShadowAtlas = new PointShadowAtlas();
+	varianceShadowFilter = new VarianceShadowFilter(SHADOW_WIDTH, SHADOW_HEIGHT, scene->GetShader("ShadowMomentBlur"));
+
+	glGenQueries(1, &overdrawQuery);
+
+	glGenBuffers(1, &meshletIndexBuffer);
+	glGenBuffers(1, &meshletCommandBuffer);
+	glGenBuffers(1, &meshletVisibilitySSBO);
+
+	// Bake every opaque mesh and material pair up front
+	impostorRenderer = new ImpostorRenderer(scene->GetShader("ImpostorBake"), scene->GetShader("Impostor"), 16);
+	for (auto& pair : scene->GetEntities())
+	{
+		if (!pair.second->GetMaterial()->GetIsRefractive())
+		{
+			impostorRenderer->Bake(pair.second->GetMesh(), pair.second->GetMaterial());
+		}
+	}
+}
+
+Renderer::~Renderer()
+{
+	delete occlusionCuller;
+	delete occlusionRasterizer;
+	delete impostorRenderer;
+	delete lightClusterer;
+	delete varianceShadowFilter;
+	delete pointShadowAtlas;
+	delete lightmapBaker;
+
+	glDeleteTextures(lightmaps.size(), lightmaps.data());
+	glDeleteTextures(1, &probeVolume);
+
+	glDeleteQueries(1, &overdrawQuery);
+
+	glDeleteBuffers(1, &meshletIndexBuffer);
+	glDeleteBuffers(1, &meshletCommandBuffer);
+	glDeleteBuffers(1, &meshletVisibilitySSBO);
+
+	glDeleteSamplers(1, &shadowSampler);
+	glDeleteFramebuffers(1, &staticDepthFBO);
+	glDeleteTextures(1, &staticDepthMap);
+
+	glDeleteFramebuffers(1, &lightingFBO);
+	glDeleteFramebuffers(1, &gBufferFBO);
+	glDeleteTextures(1, &gAlbedoTexture);
+	glDeleteTextures(1, &gNormalTexture);
+	glDeleteTextures(1, &gIrradianceTexture);
 }
 
 void Renderer::PostResize(int width, int height)
@@ -114,6 +228,8 @@ void Renderer::PostResize(int width, int height)
 
 void Renderer::Render(Camera* camera, float DeltaTime, float currentTime)
 {
+	deltaTime = DeltaTime;
+
 	// Need depth buffer for scene
 	glEnable(GL_DEPTH_TEST);
 
@@ -121,12 +237,77 @@ void Renderer::Render(Camera* camera, float DeltaTime, float currentTime)
 	glClearColor(0.8f, 0.8f, 1.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	// Pick up a finished background bake, baked lighting goes stale as soon as static geometry moves
+	if (lightmapBaker && lightmapBaker->GetIsFinished())
+	{
+		FinishLightmapBake();
+	}
+	if ((!lightmaps.empty() || probeVolume) && scene->GetSpatialIndex()->GetStaticVersion() != lightmapStaticVersion)
+	{
+		ClearBakedLighting();
+	}
+
+	// Matrices and frustums only need to be built once per frame
+	preparedShaders.clear();
+	UpdateLightMatrices(camera);
+	cameraFrustum.ExtractPlanes(camera->GetProjectionMatrix() * camera->GetViewMatrix());
+	pointShadowAtlas->Allocate(scene->GetPointLights(), camera, cameraFrustum, height);
+	lightClusterer->Build(scene->GetPointLights(), pointShadowAtlas->GetShadowIndices(), camera, width, height);
+
+	if (isSoftwareOcclusion)
+	{
+		RasterizeOccluders(camera->GetProjectionMatrix() * camera->GetViewMatrix());
+	}
+
+	// The static cache doesn't depend on the camera, only static entities or the light moving stale it
+	staticShadowDraws = 0;
+	if (isShadowCaching)
+	{
+		unsigned int staticVersion = scene->GetSpatialIndex()->GetStaticVersion();
+		glm::vec3 lightDirection = scene->GetDirectionalLights()[0]->direction;
+		if (!staticDepthMap)
+		{
+			CreateStaticShadowMap();
+		}
+
+		if (!isShadowCacheValid || staticVersion != cachedStaticVersion || lightDirection != cachedLightDirection)
+		{
+			RenderStaticShadows();
+
+			isShadowCacheValid = true;
+			cachedStaticVersion = staticVersion;
+			cachedLightDirection = lightDirection;
+			staticShadowDraws++;
+		}
+	}
+
 	// Setup depth capture
 	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 	glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
-	glClear(GL_DEPTH_BUFFER_BIT);
+	if (isShadowCaching)
+	{
+		// Every texel is written, so this replaces the clear
+		ReprojectStaticShadows();
+	}
+	else
+	{
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
 
-	RenderScene(true); // bool controls if light
+	for (int i = 0; i < CASCADE_COUNT; i++)
+	{
+		RenderShadowCascade(i);
+	}
+
+	// Filtering happens here once instead of per shaded pixel
+	if (shadowKernel == EVSM_KERNEL)
+	{
+		varianceShadowFilter->Filter(depthMap, CASCADE_SIZE, (int)ceil(shadowFilterRadius));
+	}
+
+	// Point light faces after the directional cascades, then bound for the rest of the frame
+	pointShadowAtlas->Render(scene);
+	pointShadowAtlas->Bind(shadowSampler);
 
 	// Use custom framebuffer for post process, default for just drawing to screen
 	if (isPostProcess)
@@ -142,7 +323,14 @@ void Renderer::Render(Camera* camera, float DeltaTime, float currentTime)
 	glViewport(0, 0, width, height);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	RenderScene(false);
+	if (IsDeferredActive())
+	{
+		RenderDeferred(camera);
+	}
+	else
+	{
+		RenderScene(false);
+	}
 
 	// DRAW SKYBOX
 	// Cull front face of skybox
@@ -248,85 +436,1066 @@ void Renderer::RenderScene(bool isLight)
 	// Cull back faces of scene objects
 	glCullFace(GL_BACK);
 	
-	if (!isLight)
+	// Deferred draws these forward once the G-buffer is lit
+	if (!isLight && !IsDeferredActive())
 	{
 		DrawPointLights(scene->GetCamera());
 	}
 
-	// Set light matrix, dont need to do this everytime
-	float near_plane = 1.0f, far_plane = 50.5f;
+	// Drop everything outside of the frustum before setting any uniforms
+	CullEntities(isLight ? lightFrustum : cameraFrustum);
+	meshletEntities.clear();
 
-	glm::vec3 lightPos(0.0f, 0.0f, 10.0f);
+	// With the static cache, shadow passes only draw the casters they are responsible for
+	if (isLight && isShadowCaching)
+	{
+		visibleEntities.erase(std::remove_if(visibleEntities.begin(), visibleEntities.end(),
+			[&](Entity* entity) { return entity->isStatic != isStaticShadowPass; }), visibleEntities.end());
+	}
 
-	lightProjection = glm::orthoLH(-20.0f, 20.0f, -20.0f, 20.0f, near_plane, far_plane);
-	lightView = glm::lookAtLH(lightPos, lightPos + scene->GetDirectionalLights()[0]->direction, glm::vec3(0.0, 0.0, 1.0));
-	lightSpaceMatrix = lightProjection * lightView;
+	if (isLight)
+	{
+		// Level of detail from projected size, the shadow pass uses its own projection
+		// The static cache spans the whole scene and is reused by every cascade, so it keeps full detail
+		if (isStaticShadowPass)
+		{
+			for (Entity* entity : visibleEntities)
+			{
+				entity->SelectLOD(FLT_MAX, true);
+			}
+		}
+		else
+		{
+			SelectLODs(lightSpaceMatrix, lightProjection[1][1], true);
+		}
+	}
+	else
+	{
+		Camera* camera = scene->GetCamera();
+		glm::mat4 viewProjection = camera->GetProjectionMatrix() * camera->GetViewMatrix();
+
+		softwareOccludedCount = 0;
+		liteShadedCount = 0;
+		if (isSoftwareOcclusion)
+		{
+			CullOccludedEntities(viewProjection);
+		}
+
+		SelectLODs(viewProjection, camera->GetProjectionMatrix()[1][1], false);
+
+		visibleEntityCount = visibleEntities.size();
+		totalEntityCount = scene->GetSpatialIndex()->GetEntityCount();
+
+		GatherImpostors();
+
+		if (IsDeferredActive())
+		{
+			GatherForwardEntities();
+		}
+
+		if (isMeshletCulling)
+		{
+			GatherMeshletEntities();
+		}
+	}
+
+	bool isDepthPrepassActive = !isLight && GetIsDepthPrepassActive();
+	if (!isLight)
+	{
+		BeginOverdrawQuery();
+	}
+
+	// Camera pass with occlusion culling, draws are issued for every entity but the GPU zeroes the hidden ones
+	if (!isLight && isOcclusionCulling && isPostProcess)
+	{
+		glm::mat4 viewProjection = scene->GetCamera()->GetProjectionMatrix() * scene->GetCamera()->GetViewMatrix();
+
+		// Phase one, whatever is visible against last frame's depth, clusters included so they occlude too
+		occlusionCuller->Cull(visibleEntities, viewProjection, false);
+		CullMeshletEntities(0, true);
+		DrawEntitiesIndirect(0, isDepthPrepassActive);
+		DrawMeshletEntities(0, isDepthPrepassActive);
+
+		// Phase two, build this frame's pyramid and draw anything that was disoccluded
+		occlusionCuller->BuildHiZ(depthTexture);
+		CullMeshletEntities(1, true);
+		occlusionCuller->Cull(visibleEntities, viewProjection, true);
+		DrawEntitiesIndirect(1, isDepthPrepassActive);
+		DrawMeshletEntities(1, isDepthPrepassActive);
+		EndOverdrawQuery();
+
+		// With a pre-pass both phases only laid down depth, shade them against it
+		if (isDepthPrepassActive)
+		{
+			glDepthFunc(GL_LEQUAL);
+			glDepthMask(GL_FALSE);
+			DrawEntitiesIndirect(0, false);
+			DrawEntitiesIndirect(1, false);
+			DrawMeshletEntities(0, false);
+			DrawMeshletEntities(1, false);
+			glDepthFunc(GL_LESS);
+			glDepthMask(GL_TRUE);
+		}
+
+		if (!IsDeferredActive())
+		{
+			DrawImpostors();
+		}
+
+		return;
+	}
+
+	// Without the pyramid clusters only get the frustum and cone tests, once for both passes
+	if (!isLight)
+	{
+		CullMeshletEntities(0, false);
+	}
+
+	// Depth only first, color then tests equal against it without writing
+	if (isDepthPrepassActive)
+	{
+		for (Entity* entity : visibleEntities)
+		{
+			PrepareDepth(entity);
+			entity->DrawDepth();
+		}
+		DrawMeshletEntities(0, true);
+		EndOverdrawQuery();
+
+		glDepthFunc(GL_LEQUAL);
+		glDepthMask(GL_FALSE);
+	}
 
 	// Draw entities
-	for (std::pair<std::string, Entity*> element : scene->GetEntities())
+	for (Entity* entity : visibleEntities)
 	{
-		if (!element.second->GetMaterial()->GetIsRefractive())
+		if(!isLight)
 		{
-			if(!isLight)
-			{
-				// Using entity shader
-				// Shder is activated in prepare material
-				element.second->GetMaterial()->PrepareMaterial(
-					element.second->GetTransform()->GetModelMatrix(),
-					scene->GetCamera()->GetViewMatrix(),
-					scene->GetCamera()->GetProjectionMatrix(),
-					scene->GetCamera()->GetTransform()->GetPosition(),
-					scene->GetSky(scene->GetSkyIndex()),
-					depthMap);
+			// Using entity shader
+			DrawShadingLODs(entity, [&]() { entity->Draw(scene->GetCamera()); });
+		}
+		else
+		{
+			// Using depth shader, just set model
+			scene->GetShader("SimpleDepth")->Use();
+			scene->GetShader("SimpleDepth")->SetMat4("lightSpaceMatrix", lightSpaceMatrix);
+			scene->GetShader("SimpleDepth")->SetMat4("model", entity->GetTransform()->GetModelMatrix());
 
-				Shader* shader = element.second->GetMaterial()->GetShader();
+			entity->Draw(scene->GetCamera(), isLight);
+		}
+	}
 
-				// Get lights from scene
-				std::vector<DirectionalLight*> directionalLights = scene->GetDirectionalLights();
-				std::vector<PointLight*> pointLights = scene->GetPointLights();
+	if (!isLight)
+	{
+		DrawMeshletEntities(0, false);
 
-				// Directional lights
-				for (size_t i = 0; i < directionalLights.size(); i++)
-				{
-					std::string number = std::to_string(i);
+		if (isDepthPrepassActive)
+		{
+			glDepthFunc(GL_LESS);
+			glDepthMask(GL_TRUE);
+		}
+		else
+		{
+			EndOverdrawQuery();
+		}
 
-					shader->SetVec3("directionalLights[" + number + "].direction", directionalLights[i]->direction);
-					shader->SetVec3("directionalLights[" + number + "].color", directionalLights[i]->color);
-					shader->SetFloat("directionalLights[" + number + "].intensity", directionalLights[i]->intensity);
-				}
+		if (!IsDeferredActive())
+		{
+			DrawImpostors();
+		}
+	}
+}
 
-				// Point lights
-				for (size_t i = 0; i < pointLights.size(); i++)
-				{
-					std::string number = std::to_string(i);
+void Renderer::RenderDeferred(Camera* camera)
+{
+	// Geometry pass, surfaces only
+	glBindFramebuffer(GL_FRAMEBUFFER, gBufferFBO);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-					shader->SetVec3("pointLights[" + number + "].position", pointLights[i]->position);
-					shader->SetVec3("pointLights[" + number + "].color", pointLights[i]->color);
-					shader->SetFloat("pointLights[" + number + "].intensity", pointLights[i]->intensity);
-					shader->SetFloat("pointLights[" + number + "].range", pointLights[i]->range);
-				}
+	RenderScene(false);
 
-				shader->SetMat4("lightSpaceMatrix", lightSpaceMatrix);
-			}
-			else
+	// Lighting pass, once per covered pixel into the post process targets
+	glBindFramebuffer(GL_FRAMEBUFFER, lightingFBO);
+	glDisable(GL_DEPTH_TEST);
+
+	Shader* lightingShader = scene->GetShader("DeferredLighting");
+	Sky* sky = scene->GetSky(scene->GetSkyIndex());
+	lightingShader->Use();
+	lightingShader->SetMat4("inverseViewProjection", glm::inverse(camera->GetProjectionMatrix() * camera->GetViewMatrix()));
+	lightingShader->SetMat4("view", camera->GetViewMatrix());
+	lightingShader->SetVec3("camPos", camera->GetTransform()->GetPosition());
+	lightClusterer->SetUniforms(lightingShader);
+	PrepareShadows(lightingShader);
+	BindShadowMaps();
+
+	std::vector<DirectionalLight*> directionalLights = scene->GetDirectionalLights();
+	for (size_t i = 0; i < directionalLights.size(); i++)
+	{
+		std::string number = std::to_string(i);
+
+		lightingShader->SetVec3("directionalLights[" + number + "].direction", directionalLights[i]->direction);
+		lightingShader->SetVec3("directionalLights[" + number + "].color", directionalLights[i]->color);
+		lightingShader->SetFloat("directionalLights[" + number + "].intensity", directionalLights[i]->intensity);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, gAlbedoTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, gNormalTexture);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, gIrradianceTexture);
+	sky->BindIrradiance();
+	glActiveTexture(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, sky->GetConvolvedSpecularMap());
+	glActiveTexture(GL_TEXTURE6);
+	glBindTexture(GL_TEXTURE_2D, sky->GetBRDFLookUpTexture());
+
+	lightClusterer->Bind();
+	sky->RenderQuad();
+
+	glEnable(GL_DEPTH_TEST);
+
+	// Forward passes after this test against the depth the G-buffer wrote
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+	// Equal depth passes too, the pre-pass may already have written these
+	glDepthFunc(GL_LEQUAL);
+	for (Entity* entity : forwardEntities)
+	{
+		PrepareEntity(entity);
+		entity->Draw(camera);
+	}
+	glDepthFunc(GL_LESS);
+
+	DrawPointLights(camera);
+	DrawImpostors();
+}
+
+void Renderer::PrepareEntity(Entity* entity, bool isLite)
+{
+	// Shder is activated in prepare material
+	entity->GetMaterial()->PrepareMaterial(
+		entity->GetTransform()->GetModelMatrix(),
+		scene->GetCamera()->GetViewMatrix(),
+		scene->GetCamera()->GetProjectionMatrix(),
+		scene->GetCamera()->GetTransform()->GetPosition(),
+		scene->GetSky(scene->GetSkyIndex()),
+		depthMap,
+		isLite);
+
+	Shader* shader = entity->GetMaterial()->GetShader(isLite);
+
+	// Every phase and pass prepares the entity again, only the first use of a program pays for the shared uniforms
+	if (preparedShaders.insert(shader).second)
+	{
+		PrepareFrame(shader);
+	}
+
+	// Lite shader only reads the first few point lights, so pick the brightest at the entity
+	if (isLite)
+	{
+		std::vector<PointLight*> pointLights = scene->GetPointLights();
+		glm::vec3 center = entity->GetWorldBoundingSphere().center;
+		auto contribution = [&](PointLight* light)
+		{
+			glm::vec3 offset = light->position - center;
+			return glm::dot(light->color, glm::vec3(0.2126f, 0.7152f, 0.0722f)) / std::max(glm::dot(offset, offset), 0.001f);
+		};
+
+		size_t count = std::min<size_t>(LITE_POINT_LIGHT_COUNT, pointLights.size());
+		std::partial_sort(pointLights.begin(), pointLights.begin() + count, pointLights.end(), [&](PointLight* a, PointLight* b) { return contribution(a) > contribution(b); });
+		pointLights.resize(count);
+
+		for (size_t i = 0; i < pointLights.size(); i++)
+		{
+			std::string number = std::to_string(i);
+
+			shader->SetVec3("pointLights[" + number + "].position", pointLights[i]->position);
+			shader->SetVec3("pointLights[" + number + "].color", pointLights[i]->color);
+			shader->SetFloat("pointLights[" + number + "].intensity", pointLights[i]->intensity);
+			shader->SetFloat("pointLights[" + number + "].range", pointLights[i]->range);
+		}
+	}
+
+	BindShadowMaps();
+	PrepareBakedLighting(shader, entity, isLite);
+
+	// Full material keeps the fade fraction of pixels, lite keeps the rest
+	shader->SetFloat("ditherFade", entity->GetShadingFade());
+	shader->SetBool("isDitherInverted", isLite);
+}
+
+void Renderer::PrepareFrame(Shader* shader)
+{
+	// Directional lights
+	std::vector<DirectionalLight*> directionalLights = scene->GetDirectionalLights();
+	for (size_t i = 0; i < directionalLights.size(); i++)
+	{
+		std::string number = std::to_string(i);
+
+		shader->SetVec3("directionalLights[" + number + "].direction", directionalLights[i]->direction);
+		shader->SetVec3("directionalLights[" + number + "].color", directionalLights[i]->color);
+		shader->SetFloat("directionalLights[" + number + "].intensity", directionalLights[i]->intensity);
+	}
+
+	// Full shaders read the cluster buffers, lite ones ignore these
+	lightClusterer->SetUniforms(shader);
+	PrepareShadows(shader);
+}
+
+void Renderer::PrepareShadows(Shader* shader)
+{
+	shader->SetMat4("lightSpaceMatrix", lightSpaceMatrix);
+
+	for (int i = 0; i < CASCADE_COUNT; i++)
+	{
+		std::string number = std::to_string(i);
+
+		shader->SetMat4("cascadeMatrices[" + number + "]", cascadeMatrices[i]);
+		shader->SetFloat("cascadeSplits[" + number + "]", cascadeSplits[i]);
+	}
+
+	shader->SetInt("shadowKernel", shadowKernel);
+	shader->SetFloat("shadowFilterRadius", shadowFilterRadius);
+	shader->SetFloat("shadowBias", shadowBias);
+	shader->SetFloat("shadowSlopeBias", shadowSlopeBias);
+
+	if (shadowKernel == EVSM_KERNEL)
+	{
+		shader->SetVec2("shadowExponents", varianceShadowFilter->GetExponents());
+		shader->SetFloat("shadowBleedReduction", shadowBleedReduction);
+	}
+}
+
+void Renderer::BindShadowMaps()
+{
+	// Texture units aren't program state, other passes may have rebound them
+	if (shadowKernel == EVSM_KERNEL)
+	{
+		glActiveTexture(GL_TEXTURE8);
+		glBindTexture(GL_TEXTURE_2D, varianceShadowFilter->GetMomentsTexture());
+	}
+
+	glActiveTexture(GL_TEXTURE7);
+	glBindTexture(GL_TEXTURE_2D, depthMap);
+}
+
+void Renderer::PrepareBakedLighting(Shader* shader, Entity* entity, bool isLite)
+{
+	// Lightmapped entities take diffuse from the bake, the lite shader doesn't read it
+	bool isLightmapped = isLightmapping && !isLite && entity->GetLightmap() != 0;
+	shader->SetBool("isLightmapped", isLightmapped);
+	if (isLightmapped)
+	{
+		glActiveTexture(GL_TEXTURE10);
+		glBindTexture(GL_TEXTURE_2D, entity->GetLightmap());
+	}
+
+	// Everything else takes ambient from the probes instead of the sky SH
+	bool isProbeLit = isProbeLighting && !isLite && !isLightmapped && probeVolume != 0;
+	shader->SetBool("isProbeLit", isProbeLit);
+	if (isProbeLit)
+	{
+		shader->SetVec3("probeVolumeMin", probeBounds.min);
+		shader->SetVec3("probeVolumeSize", probeBounds.max - probeBounds.min);
+		shader->SetVec3("probeResolution", glm::vec3(probeResolution));
+
+		glActiveTexture(GL_TEXTURE11);
+		glBindTexture(GL_TEXTURE_3D, probeVolume);
+	}
+}
+
+void Renderer::PrepareGeometry(Entity* entity)
+{
+	Shader* shader = scene->GetShader("GBuffer");
+	Material* material = entity->GetMaterial();
+
+	shader->Use();
+	shader->SetMat4("model", entity->GetTransform()->GetModelMatrix());
+	shader->SetMat4("view", scene->GetCamera()->GetViewMatrix());
+	shader->SetMat4("projection", scene->GetCamera()->GetProjectionMatrix());
+
+	// Only PBR materials get here, the rest were gathered for the forward pass
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, material->GetAlbedo()->ID);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, material->GetNormal()->ID);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, material->GetRoughness()->ID);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, material->GetMetallic()->ID);
+
+	// Ambient is resolved per entity here, the lighting pass can't tell which lightmap a pixel came from
+	scene->GetSky(scene->GetSkyIndex())->BindIrradiance();
+	PrepareBakedLighting(shader, entity, false);
+}
+
+void Renderer::DrawShadingLODs(Entity* entity, const std::function<void()>& draw)
+{
+	// Lighting cost no longer depends on the surface, so there is nothing to fade
+	if (IsDeferredActive())
+	{
+		PrepareGeometry(entity);
+		draw();
+		return;
+	}
+
+	float fade = entity->GetShadingFade();
+
+	// Both materials are drawn while crossfading, each covering its half of the dither pattern
+	if (fade > 0.0f)
+	{
+		PrepareEntity(entity);
+		draw();
+	}
+	if (fade < 1.0f)
+	{
+		PrepareEntity(entity, true);
+		draw();
+	}
+}
+
+void Renderer::DrawEntitiesIndirect(int phase, bool isDepthOnly)
+{
+	occlusionCuller->BindCommands(phase);
+
+	for (size_t i = 0; i < visibleEntities.size(); i++)
+	{
+		Mesh* mesh = visibleEntities[i]->GetMesh();
+
+		if (isDepthOnly)
+		{
+			PrepareDepth(visibleEntities[i]);
+			mesh->DrawDepthIndirect(occlusionCuller->GetCommandOffset(i));
+		}
+		else
+		{
+			DrawShadingLODs(visibleEntities[i], [&]() { mesh->DrawIndirect(occlusionCuller->GetCommandOffset(i)); });
+		}
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void Renderer::PrepareDepth(Entity* entity)
+{
+	Shader* shader = scene->GetShader("Depth");
+
+	shader->Use();
+	shader->SetMat4("model", entity->GetTransform()->GetModelMatrix());
+	shader->SetMat4("view", scene->GetCamera()->GetViewMatrix());
+	shader->SetMat4("projection", scene->GetCamera()->GetProjectionMatrix());
+}
+
+void Renderer::BeginOverdrawQuery()
+{
+	// Last frame's result, never waits on the GPU
+	if (isOverdrawQueryPending)
+	{
+		GLuint isAvailable = 0;
+		glGetQueryObjectuiv(overdrawQuery, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+		if (!isAvailable)
+		{
+			return;
+		}
+
+		GLuint64 samples = 0;
+		glGetQueryObjectui64v(overdrawQuery, GL_QUERY_RESULT, &samples);
+		overdraw = (float)samples / (float)(width * height);
+		isOverdrawQueryPending = false;
+
+		// Hysteresis so a scene sitting on the threshold doesn't flip every frame
+		if (overdraw > overdrawThreshold)
+		{
+			isOverdrawPrepass = true;
+		}
+		else if (overdraw < overdrawThreshold * 0.8f)
+		{
+			isOverdrawPrepass = false;
+		}
+	}
+
+	glBeginQuery(GL_SAMPLES_PASSED, overdrawQuery);
+	isOverdrawQueryPending = true;
+	isOverdrawQueryActive = true;
+}
+
+void Renderer::EndOverdrawQuery()
+{
+	if (isOverdrawQueryActive)
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		isOverdrawQueryActive = false;
+	}
+}
+
+void Renderer::StartLightmapBake()
+{
+	// Already running
+	if (lightmapBaker)
+	{
+		return;
+	}
+
+	lightmapBaker = new LightmapBaker();
+	lightmapEntities.clear();
+	AABB volumeBounds;
+
+	// Anything that moves or refracts keeps runtime lighting
+	for (auto& pair : scene->GetEntities())
+	{
+		Entity* entity = pair.second;
+		Material* material = entity->GetMaterial();
+		if (!entity->isStatic || material->GetIsRefractive())
+		{
+			continue;
+		}
+
+		// Average texture color stands in for the albedo of whatever a bounce lands on
+		Mesh* mesh = entity->GetMesh();
+		glm::vec3 albedo = glm::pow(material->GetAlbedo()->averageColor, glm::vec3(2.2f));
+		lightmapBaker->AddObject(mesh->GetVertices(), mesh->GetIndices(), mesh->GetLOD(0), entity->GetTransform()->GetModelMatrix(), albedo, material->GetIsPBR());
+		lightmapEntities.push_back(entity);
+
+		AABB bounds = entity->GetWorldAABB();
+		volumeBounds.min = lightmapEntities.size() == 1 ? bounds.min : glm::min(volumeBounds.min, bounds.min);
+		volumeBounds.max = lightmapEntities.size() == 1 ? bounds.max : glm::max(volumeBounds.max, bounds.max);
+	}
+
+	// Probe grid around the static geometry, moving entities outside it clamp to the edge probes
+	if (!lightmapEntities.empty())
+	{
+		volumeBounds.min -= glm::vec3(PROBE_SPACING * 0.5f);
+		volumeBounds.max += glm::vec3(PROBE_SPACING * 0.5f);
+
+		glm::ivec3 resolution = glm::ivec3(glm::ceil((volumeBounds.max - volumeBounds.min) / PROBE_SPACING)) + 1;
+		lightmapBaker->SetProbeVolume(volumeBounds, glm::clamp(resolution, glm::ivec3(2), glm::ivec3(MAX_PROBES_PER_AXIS)));
+	}
+
+	// Same light units as the shaders
+	DirectionalLight* light = scene->GetDirectionalLights()[0];
+	lightmapBaker->SetDirectionalLight(light->direction, light->color, light->intensity);
+
+	for (PointLight* pointLight : scene->GetPointLights())
+	{
+		lightmapBaker->AddPointLight(pointLight->position, pointLight->color, pointLight->intensity, pointLight->range);
+	}
+
+	lightmapBaker->LoadEnvironment(scene->GetSky(scene->GetSkyIndex())->GetFilePaths());
+
+	lightmapStaticVersion = scene->GetSpatialIndex()->GetStaticVersion();
+	lightmapBaker->Start();
+}
+
+void Renderer::FinishLightmapBake()
+{
+	lightmapBaker->Finish();
+	ClearBakedLighting();
+
+	for (size_t i = 0; i < lightmapEntities.size(); i++)
+	{
+		int resolution = lightmapBaker->GetResolution(i);
+
+		GLuint lightmap;
+		glGenTextures(1, &lightmap);
+		glBindTexture(GL_TEXTURE_2D, lightmap);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, resolution, resolution, 0, GL_RGB, GL_FLOAT, lightmapBaker->GetLightmap(i).data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		lightmapEntities[i]->SetLightmap(lightmap);
+		lightmaps.push_back(lightmap);
+	}
+
+	// Coefficient i of every probe goes in the block of x from i * resolution.x
+	const std::vector<SphericalHarmonics>& probes = lightmapBaker->GetProbes();
+	if (!probes.empty())
+	{
+		probeBounds = lightmapBaker->GetProbeBounds();
+		probeResolution = lightmapBaker->GetProbeResolution();
+
+		int volumeWidth = probeResolution.x * SphericalHarmonics::COEFFICIENT_COUNT;
+		std::vector<glm::vec3> texels(volumeWidth * probeResolution.y * probeResolution.z);
+		for (size_t probe = 0; probe < probes.size(); probe++)
+		{
+			int x = probe % probeResolution.x;
+			int row = probe / probeResolution.x;
+			for (int i = 0; i < SphericalHarmonics::COEFFICIENT_COUNT; i++)
 			{
-				// Using depth shader, just set model
-				scene->GetShader("SimpleDepth")->Use();
-				scene->GetShader("SimpleDepth")->SetMat4("lightSpaceMatrix", lightSpaceMatrix);
-				scene->GetShader("SimpleDepth")->SetMat4("model", element.second->GetTransform()->GetModelMatrix());
+				texels[row * volumeWidth + i * probeResolution.x + x] = probes[probe].GetCoefficient(i);
 			}
+		}
+
+		glGenTextures(1, &probeVolume);
+		glBindTexture(GL_TEXTURE_3D, probeVolume);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, volumeWidth, probeResolution.y, probeResolution.z, 0, GL_RGB, GL_FLOAT, texels.data());
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	delete lightmapBaker;
+	lightmapBaker = nullptr;
+}
+
+void Renderer::ClearBakedLighting()
+{
+	for (auto& pair : scene->GetEntities())
+	{
+		pair.second->SetLightmap(0);
+	}
+
+	glDeleteTextures(lightmaps.size(), lightmaps.data());
+	lightmaps.clear();
+
+	glDeleteTextures(1, &probeVolume);
+	probeVolume = 0;
+}
+
+void Renderer::RenderShadowCascade(int cascade)
+{
+	// Each cascade into its own quadrant, culled and LOD selected against its own volume
+	glViewport((cascade % 2) * CASCADE_SIZE, (cascade / 2) * CASCADE_SIZE, CASCADE_SIZE, CASCADE_SIZE);
+
+	lightProjection = cascadeProjections[cascade];
+	lightSpaceMatrix = cascadeMatrices[cascade];
+	lightFrustum.ExtractPlanes(lightSpaceMatrix);
+
+	RenderScene(true); // bool controls if light
+}
+
+void Renderer::CreateStaticShadowMap()
+{
+	// Only allocated once caching is turned on, so the default budget stays at the cascade atlas
+	glGenFramebuffers(1, &staticDepthFBO);
+	glGenTextures(1, &staticDepthMap);
+	glBindTexture(GL_TEXTURE_2D, staticDepthMap);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, STATIC_SHADOW_SIZE, STATIC_SHADOW_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, staticDepthFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, staticDepthMap, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::RenderStaticShadows()
+{
+	glViewport(0, 0, STATIC_SHADOW_SIZE, STATIC_SHADOW_SIZE);
+	glBindFramebuffer(GL_FRAMEBUFFER, staticDepthFBO);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	// Fit to the light space bounds of every static entity, same rotation as the cascades
+	glm::vec3 minBounds(FLT_MAX);
+	glm::vec3 maxBounds(-FLT_MAX);
+	for (auto& pair : scene->GetEntities())
+	{
+		if (!pair.second->isStatic)
+		{
+			continue;
+		}
+
+		AABB bounds = pair.second->GetWorldAABB();
+		for (int i = 0; i < 8; i++)
+		{
+			glm::vec3 corner((i & 1) ? bounds.max.x : bounds.min.x, (i & 2) ? bounds.max.y : bounds.min.y, (i & 4) ? bounds.max.z : bounds.min.z);
+			glm::vec3 lightCorner = glm::vec3(lightView * glm::vec4(corner, 1.0f));
+			minBounds = glm::min(minBounds, lightCorner);
+			maxBounds = glm::max(maxBounds, lightCorner);
+		}
+	}
+
+	// Cleared map reprojects to no shadow
+	if (minBounds.x > maxBounds.x)
+	{
+		return;
+	}
+
+	// Small margin so casters on the bounds aren't clipped
+	minBounds -= glm::vec3(0.1f);
+	maxBounds += glm::vec3(0.1f);
+	staticProjection = glm::orthoLH(minBounds.x, maxBounds.x, minBounds.y, maxBounds.y, minBounds.z, maxBounds.z);
+	staticMatrix = staticProjection * lightView;
+
+	lightProjection = staticProjection;
+	lightSpaceMatrix = staticMatrix;
+	lightFrustum.ExtractPlanes(lightSpaceMatrix);
+
+	isStaticShadowPass = true;
+	RenderScene(true); // bool controls if light
+	isStaticShadowPass = false;
+}
+
+void Renderer::ReprojectStaticShadows()
+{
+	// One quad over the whole atlas, the shader works out which cascade each texel belongs to
+	Shader* reprojectShader = scene->GetShader("ShadowReproject");
+	reprojectShader->Use();
+	reprojectShader->SetInt("cascadeSize", CASCADE_SIZE);
+	for (int i = 0; i < CASCADE_COUNT; i++)
+	{
+		reprojectShader->SetMat4("cascadeToStatic[" + std::to_string(i) + "]", staticMatrix * glm::inverse(cascadeMatrices[i]));
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, staticDepthMap);
+
+	// Overwrite whatever was there, the quad's own depth is ignored
+	glDepthFunc(GL_ALWAYS);
+	glDisable(GL_CULL_FACE);
+	scene->GetSky(0)->RenderQuad();
+	glEnable(GL_CULL_FACE);
+	glDepthFunc(GL_LESS);
+}
+
+void Renderer::UpdateLightMatrices(Camera* camera)
+{
+	// Rotation only, cascades are placed in light space so they can be snapped to texels
+	glm::vec3 lightDirection = glm::normalize(scene->GetDirectionalLights()[0]->direction);
+	glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	lightView = glm::lookAtLH(glm::vec3(0.0f), lightDirection, up);
+
+	// Camera frustum corners on the near and far planes
+	glm::mat4 inverseViewProjection = glm::inverse(camera->GetProjectionMatrix() * camera->GetViewMatrix());
+	glm::vec3 nearCorners[4];
+	glm::vec3 farCorners[4];
+	for (int i = 0; i < 4; i++)
+	{
+		glm::vec2 ndc((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f);
+		glm::vec4 nearCorner = inverseViewProjection * glm::vec4(ndc, -1.0f, 1.0f);
+		glm::vec4 farCorner = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+		nearCorners[i] = glm::vec3(nearCorner) / nearCorner.w;
+		farCorners[i] = glm::vec3(farCorner) / farCorner.w;
+	}
+
+	float cameraNear = camera->GetNear();
+	float cameraFar = camera->GetFar();
+	float far = std::min(cameraFar, shadowDistance);
+	float previousSplit = cameraNear;
+
+	for (int i = 0; i < CASCADE_COUNT; i++)
+	{
+		// Blend of logarithmic and uniform splits
+		float ratio = (float)(i + 1) / CASCADE_COUNT;
+		float split = glm::mix(cameraNear + (far - cameraNear) * ratio, cameraNear * glm::pow(far / cameraNear, ratio), cascadeSplitLambda);
+
+		// Corners of this slice, view depth is linear along each corner ray
+		float start = (previousSplit - cameraNear) / (cameraFar - cameraNear);
+		float end = (split - cameraNear) / (cameraFar - cameraNear);
+		glm::vec3 corners[8];
+		glm::vec3 center(0.0f);
+		for (int j = 0; j < 4; j++)
+		{
+			corners[j] = glm::mix(nearCorners[j], farCorners[j], start);
+			corners[j + 4] = glm::mix(nearCorners[j], farCorners[j], end);
+			center += corners[j] + corners[j + 4];
+		}
+		center /= 8.0f;
+
+		// Bounding sphere keeps the cascade size fixed as the camera turns
+		float radius = 0.0f;
+		for (glm::vec3& corner : corners)
+		{
+			radius = std::max(radius, glm::length(corner - center));
+		}
+		radius = ceil(radius * 16.0f) / 16.0f;
+
+		// Move in whole texels so edges don't shimmer as the camera moves
+		float texelSize = 2.0f * radius / CASCADE_SIZE;
+		glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+		lightCenter.x = floor(lightCenter.x / texelSize) * texelSize;
+		lightCenter.y = floor(lightCenter.y / texelSize) * texelSize;
+
+		cascadeProjections[i] = glm::orthoLH(
+			lightCenter.x - radius, lightCenter.x + radius,
+			lightCenter.y - radius, lightCenter.y + radius,
+			lightCenter.z - radius - SHADOW_CASTER_DISTANCE, lightCenter.z + radius);
+		cascadeMatrices[i] = cascadeProjections[i] * lightView;
+		cascadeSplits[i] = split;
+
+		previousSplit = split;
+	}
+
+	lightProjection = cascadeProjections[0];
+	lightSpaceMatrix = cascadeMatrices[0];
+}
+
+void Renderer::CullEntities(Frustum& frustum)
+{
+	cullCandidates.clear();
+	cullSpheres.clear();
+	visibleEntities.clear();
+
+	// Spatial index rejects whole branches, then gather opaque candidates and their world bounds
+	scene->GetSpatialIndex()->QueryFrustum(frustum, cullCandidates);
+	cullCandidates.erase(std::remove_if(cullCandidates.begin(), cullCandidates.end(),
+		[](Entity* entity) { return entity->GetMaterial()->GetIsRefractive(); }), cullCandidates.end());
+
+	for (Entity* entity : cullCandidates)
+	{
+		cullSpheres.push_back(entity->GetWorldBoundingSphere());
+	}
+
+	// Leaves already passed the world box test, but a rotated entity's box pokes past its sphere at the corners
+	frustum.CullSpheres(cullSpheres, cullResults);
+
+	for (size_t i = 0; i < cullCandidates.size(); i++)
+	{
+		if (cullResults[i])
+		{
+			visibleEntities.push_back(cullCandidates[i]);
+		}
+	}
+}
+
+void Renderer::RasterizeOccluders(glm::mat4 viewProjection)
+{
+	occlusionRasterizer->Clear();
+
+	// Occluders outside of the frustum can't hide anything
+	for (auto& pair : scene->GetEntities())
+	{
+		Entity* entity = pair.second;
+		if (entity->isOccluder && cameraFrustum.IsAABBVisible(entity->GetWorldAABB()))
+		{
+			Mesh* mesh = entity->GetMesh();
+			occlusionRasterizer->AddOccluder(mesh->GetVertices(), mesh->GetIndices(), mesh->GetIndexCount(), viewProjection * entity->GetTransform()->GetModelMatrix());
+		}
+	}
+
+	occlusionRasterizer->Render();
+}
+
+void Renderer::CullOccludedEntities(glm::mat4 viewProjection)
+{
+	size_t count = visibleEntities.size();
+
+	// Occluders pass their own test since their nearest point is never behind themselves
+	visibleEntities.erase(std::remove_if(visibleEntities.begin(), visibleEntities.end(),
+		[&](Entity* entity) { return !occlusionRasterizer->IsVisible(entity->GetWorldAABB(), viewProjection); }), visibleEntities.end());
+
+	softwareOccludedCount = count - visibleEntities.size();
+}
+
+void Renderer::SelectLODs(glm::mat4 viewProjection, float projectionScale, bool isLight)
+{
+	for (Entity* entity : visibleEntities)
+	{
+		BoundingSphere sphere = entity->GetWorldBoundingSphere();
+
+		// Clip w is view depth for perspective and 1 for ortho, so this covers both passes
+		float w = (viewProjection * glm::vec4(sphere.center, 1.0f)).w;
+		float screenSize = sphere.radius * projectionScale / std::max(w, 0.001f);
+
+		entity->SelectLOD(screenSize, isLight);
+
+		if (!isLight)
+		{
+			entity->SelectShadingLOD(screenSize, shadingLODScreenSize, shadingLODFadeTime > 0.0f ? deltaTime / shadingLODFadeTime : 1.0f);
+			liteShadedCount += entity->GetShadingFade() < 1.0f;
+		}
+	}
+}
+
+void Renderer::GatherMeshletEntities()
+{
+	for (Entity* entity : visibleEntities)
+	{
+		if (entity->GetLOD(false) == 0 && entity->GetMesh()->GetHasMeshlets())
+		{
+			meshletEntities.push_back(entity);
+		}
+	}
+
+	visibleEntities.erase(std::remove_if(visibleEntities.begin(), visibleEntities.end(),
+		[](Entity* entity) { return entity->GetLOD(false) == 0 && entity->GetMesh()->GetHasMeshlets(); }), visibleEntities.end());
+
+	// Entities sharing a mesh still get their own ranges, results have to survive until the shading pass
+	meshletIndexOffsets.clear();
+	meshletVisibilityOffsets.clear();
+	GLuint indexCount = 0;
+	GLuint visibilityCount = 0;
+	for (Entity* entity : meshletEntities)
+	{
+		meshletIndexOffsets.push_back(indexCount);
+		meshletVisibilityOffsets.push_back(visibilityCount);
+		indexCount += entity->GetMesh()->GetMeshletIndexCount();
+		visibilityCount += entity->GetMesh()->GetMeshletCount();
+	}
 
-			element.second->Draw(scene->GetCamera());
+	ReserveMeshletBuffers(indexCount, meshletEntities.size() * 2, visibilityCount);
+}
+
+void Renderer::ReserveMeshletBuffers(GLuint indexCount, GLuint commandCount, GLuint visibilityCount)
+{
+	// Grow buffers
+	if (indexCount > meshletIndexCapacity)
+	{
+		meshletIndexCapacity = std::max(indexCount, meshletIndexCapacity * 2);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshletIndexBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, meshletIndexCapacity * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+	}
+
+	if (commandCount > meshletCommandCapacity)
+	{
+		meshletCommandCapacity = std::max(commandCount, meshletCommandCapacity * 2);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshletCommandBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, meshletCommandCapacity * sizeof(DrawElementsCommand), nullptr, GL_DYNAMIC_COPY);
+	}
+
+	if (visibilityCount > meshletVisibilityCapacity)
+	{
+		meshletVisibilityCapacity = std::max(visibilityCount, meshletVisibilityCapacity * 2);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshletVisibilitySSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, meshletVisibilityCapacity * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void Renderer::CullMeshletEntities(int phase, bool isHiZ)
+{
+	if (meshletEntities.empty())
+	{
+		return;
+	}
+
+	// Shader appends to count, commands are slot 2 * entity + phase
+	// Only this phase's are reset, phase two appends after phase one's results
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshletCommandBuffer);
+	for (size_t i = 0; i < meshletEntities.size(); i++)
+	{
+		DrawElementsCommand command = { 0, 1, meshletIndexOffsets[i], 0, 0 };
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, (i * 2 + phase) * sizeof(DrawElementsCommand), sizeof(DrawElementsCommand), &command);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	Shader* cullShader = scene->GetShader("MeshletCull");
+	Camera* camera = scene->GetCamera();
+	glm::mat4 viewProjection = camera->GetProjectionMatrix() * camera->GetViewMatrix();
+
+	// Per frame uniforms, the program keeps them between entities
+	cullShader->Use();
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		cullShader->SetVec4("frustumPlanes[" + std::to_string(i) + "]", cameraFrustum.GetPlane(i));
+	}
+	cullShader->SetVec3("cameraPosition", camera->GetTransform()->GetPosition());
+	cullShader->SetMat4("viewProjection", phase == 0 ? occlusionCuller->GetPreviousViewProjection() : viewProjection);
+	cullShader->SetBool("isHiZ", isHiZ);
+	cullShader->SetBool("hasHistory", occlusionCuller->GetHasHistory());
+	cullShader->SetBool("isSecondPhase", phase == 1);
+	cullShader->SetInt("hiZ", 0);
+	cullShader->SetInt("hiZLevels", occlusionCuller->GetHiZLevels());
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, occlusionCuller->GetHiZTexture());
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, meshletIndexBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, meshletCommandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, meshletVisibilitySSBO);
+
+	for (size_t i = 0; i < meshletEntities.size(); i++)
+	{
+		glm::mat4 model = meshletEntities[i]->GetTransform()->GetModelMatrix();
+		glm::vec3 axisScales = glm::vec3(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])));
+		float scale = std::max(axisScales.x, std::max(axisScales.y, axisScales.z));
+		float minScale = std::min(axisScales.x, std::min(axisScales.y, axisScales.z));
+
+		cullShader->SetMat4("model", model);
+		cullShader->SetMat3("normalMatrix", glm::transpose(glm::inverse(glm::mat3(model))));
+		cullShader->SetFloat("modelScale", scale);
+		cullShader->SetUInt("commandSlot", i * 2);
+		cullShader->SetUInt("indexOffset", meshletIndexOffsets[i]);
+		cullShader->SetUInt("visibilityOffset", meshletVisibilityOffsets[i]);
+
+		// Cone cutoffs are in object space, non-uniform scale spreads the normals so they no longer hold
+		cullShader->SetBool("isConeCulling", minScale > scale * CONE_SCALE_TOLERANCE);
+
+		meshletEntities[i]->GetMesh()->CullMeshlets(cullShader);
+	}
+
+	// Ranges are read as indices and commands, phase two also reads phase one's counts and flags
+	glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Renderer::DrawMeshletEntities(int phase, bool isDepthOnly)
+{
+	if (meshletEntities.empty())
+	{
+		return;
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, meshletCommandBuffer);
+
+	for (size_t i = 0; i < meshletEntities.size(); i++)
+	{
+		Entity* entity = meshletEntities[i];
+		GLintptr commandOffset = (i * 2 + phase) * sizeof(DrawElementsCommand);
+
+		if (isDepthOnly)
+		{
+			PrepareDepth(entity);
+			entity->GetMesh()->DrawMeshlets(meshletIndexBuffer, commandOffset);
+		}
+		else
+		{
+			DrawShadingLODs(entity, [&]() { entity->GetMesh()->DrawMeshlets(meshletIndexBuffer, commandOffset); });
+		}
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void Renderer::GatherForwardEntities()
+{
+	forwardEntities.clear();
+	for (Entity* entity : visibleEntities)
+	{
+		if (!entity->GetMaterial()->GetIsPBR())
+		{
+			forwardEntities.push_back(entity);
 		}
 	}
+
+	visibleEntities.erase(std::remove_if(visibleEntities.begin(), visibleEntities.end(),
+		[](Entity* entity) { return !entity->GetMaterial()->GetIsPBR(); }), visibleEntities.end());
+}
+
+void Renderer::GatherImpostors()
+{
+	glm::vec3 cameraPosition = scene->GetCamera()->GetTransform()->GetPosition();
+
+	// Anything without a baked atlas keeps drawing normally
+	visibleEntities.erase(std::remove_if(visibleEntities.begin(), visibleEntities.end(),
+		[&](Entity* entity)
+		{
+			BoundingSphere sphere = entity->GetWorldBoundingSphere();
+			return glm::length(sphere.center - cameraPosition) - sphere.radius > impostorDistance && impostorRenderer->Add(entity);
+		}), visibleEntities.end());
 }
 
+void Renderer::DrawImpostors()
+{
+	DirectionalLight* light = scene->GetDirectionalLights()[0];
+
+	impostorRenderer->Draw(scene->GetCamera(), scene->GetSky(scene->GetSkyIndex()), light->direction, light->color * light->intensity);
+}
 
 void Renderer::DrawPointLights(Camera* camera)
 {
 	// Get resources
 	Shader* lightShader = scene->GetShader("Light");
-	std::vector<PointLight*> pointLights = scene->GetPointLights();
 
 	// Set shader program
 	lightShader->Use();
@@ -335,28 +1504,10 @@ void Renderer::DrawPointLights(Camera* camera)
 	lightShader->SetMat4("view", camera->GetViewMatrix());
 	lightShader->SetMat4("projection", camera->GetProjectionMatrix());
 
-	for (PointLight* light : pointLights)
+	// Positions, ranges and colors come from the cluster light buffer, one instance per light
+	lightClusterer->Bind();
+	if (lightClusterer->GetLightCount() > 0)
 	{
-		// Set scale based on range
-		float scale = light->range / 10.0f;
-
-		// Build model Matrix
-		glm::mat4 model = glm::mat4(1.0f);
-
-		model = glm::translate(model, light->position);	
-		// No rotation
-		model = glm::scale(model, glm::vec3(scale));
-
-		lightShader->SetMat4("model", model);
-
-		// Set up the pixel shader data
-		glm::vec3 color = light->color;
-		color.x *= light->intensity;
-		color.y *= light->intensity;
-		color.z *= light->intensity;
-		lightShader->SetVec3("color", color);
-
-		// Draw mesh
-		scene->GetMesh("Sphere")->Draw();
+		scene->GetMesh("Sphere")->DrawInstanced(lightClusterer->GetLightCount());
 	}
 }
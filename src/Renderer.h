@@ -4,30 +4,94 @@
 #include "imgui/imgui_impl_opengl3.h"
 #include <glad/glad.h>
 #include "GLFW/glfw3.h"
+#include <functional>
+#include <unordered_set>
 
 #include "Scene.h"
+#include "Frustum.h"
+#include "OcclusionCuller.h"
+#include "OcclusionRasterizer.h"
+#include "ImpostorRenderer.h"
+#include "LightClusterer.h"
+#include "VarianceShadowFilter.h"
+#include "PointShadowAtlas.h"
+#include "LightmapBaker.h"
 
 class Renderer
 {
 public:
 	// Add sky later
 	Renderer(int width, int height, Scene* scene, GLFWwindow* window);
+	~Renderer();
 
 	void PostResize(int width, int height);
 	void Render(Camera* camera, float DeltaTime, float currentTime);
 
 	void RenderScene(bool isLight);
 
+	// Bake lightmaps for the static entities and a probe volume around them on background threads, they are picked up once finished
+	void StartLightmapBake();
+
 	// Setters
 	void SetIsPostProcess(bool isActive) { isPostProcess = isActive; }
+	void SetIsOcclusionCulling(bool isActive) { isOcclusionCulling = isActive; }
+	void SetIsSoftwareOcclusion(bool isActive) { isSoftwareOcclusion = isActive; }
+	void SetIsMeshletCulling(bool isActive) { isMeshletCulling = isActive; }
+	void SetIsDeferred(bool isActive) { isDeferred = isActive; }
+	void SetIsDepthPrepass(bool isActive) { isDepthPrepass = isActive; }
+	void SetIsAutoDepthPrepass(bool isActive) { isAutoDepthPrepass = isActive; }
+	void SetOverdrawThreshold(float threshold) { overdrawThreshold = threshold; }
+	void SetImpostorDistance(float distance) { impostorDistance = distance; }
+	void SetShadingLODScreenSize(float screenSize) { shadingLODScreenSize = screenSize; }
+	void SetShadingLODFadeTime(float time) { shadingLODFadeTime = time; }
+	void SetIsShadowCaching(bool isActive) { isShadowCaching = isActive; isShadowCacheValid = false; }
+	void SetShadowKernel(int kernel) { shadowKernel = kernel; }
+	void SetShadowFilterRadius(float radius) { shadowFilterRadius = radius; }
+	void SetShadowBias(float bias) { shadowBias = bias; }
+	void SetShadowSlopeBias(float bias) { shadowSlopeBias = bias; }
+	void SetShadowBleedReduction(float reduction) { shadowBleedReduction = reduction; }
+	void SetIsLightmapping(bool isActive) { isLightmapping = isActive; }
+	void SetIsProbeLighting(bool isActive) { isProbeLighting = isActive; }
 
 	// Getters
 	bool GetIsPostProcess() { return isPostProcess; }
+	bool GetIsOcclusionCulling() { return isOcclusionCulling; }
+	bool GetIsSoftwareOcclusion() { return isSoftwareOcclusion; }
+	bool GetIsMeshletCulling() { return isMeshletCulling; }
+	bool GetIsDeferred() { return isDeferred; }
+	bool GetIsDepthPrepass() { return isDepthPrepass; }
+	bool GetIsAutoDepthPrepass() { return isAutoDepthPrepass; }
+	bool GetIsDepthPrepassActive() { return isDepthPrepass || (isAutoDepthPrepass && isOverdrawPrepass); }
+	float GetOverdrawThreshold() { return overdrawThreshold; }
+	float GetOverdraw() { return overdraw; }
+	float GetImpostorDistance() { return impostorDistance; }
+	float GetShadingLODScreenSize() { return shadingLODScreenSize; }
+	float GetShadingLODFadeTime() { return shadingLODFadeTime; }
+	bool GetIsShadowCaching() { return isShadowCaching; }
+	unsigned int GetStaticShadowDraws() { return staticShadowDraws; }
+	unsigned int GetPointShadowCount() { return pointShadowAtlas->GetShadowCount(); }
+	unsigned int GetPointShadowFacesDrawn() { return pointShadowAtlas->GetFacesDrawn(); }
+	int GetShadowKernel() { return shadowKernel; }
+	float GetShadowFilterRadius() { return shadowFilterRadius; }
+	float GetShadowBias() { return shadowBias; }
+	float GetShadowSlopeBias() { return shadowSlopeBias; }
+	float GetShadowBleedReduction() { return shadowBleedReduction; }
+	bool GetIsLightmapping() { return isLightmapping; }
+	bool GetIsLightmapBaking() { return lightmapBaker != nullptr; }
+	float GetLightmapBakeProgress() { return lightmapBaker ? lightmapBaker->GetProgress() : 1.0f; }
+	unsigned int GetLightmapCount() { return lightmaps.size(); }
+	bool GetIsProbeLighting() { return isProbeLighting; }
+	unsigned int GetProbeCount() { return probeVolume ? probeResolution.x * probeResolution.y * probeResolution.z : 0; }
+	unsigned int GetLiteShadedCount() { return liteShadedCount; }
+	unsigned int GetImpostorCount() { return impostorRenderer->GetInstanceCount(); }
 	GLuint GetColorTexture() { return colorTexture; }
 	GLuint GetNormalTexture() { return normalTexture; }
 	GLuint GetDepthTexture() { return depthTexture; }
 
 	GLuint GetDepthMap() { return depthMap; }
+	unsigned int GetVisibleEntityCount() { return visibleEntityCount; }
+	unsigned int GetTotalEntityCount() { return totalEntityCount; }
+	unsigned int GetSoftwareOccludedCount() { return softwareOccludedCount; }
 	glm::vec2 refractionScale = glm::vec2(1,1);
 
 private:
@@ -35,26 +99,195 @@ private:
 	GLFWwindow* window;
 
 	GLuint FBO;
-	GLuint RBO;
+	GLuint RBO; // Only used while baking sky maps
 	GLuint colorTexture;
 	GLuint normalTexture;
 	GLuint depthTexture;
 
+	// Deferred G-buffer, lit into the post process targets so it needs post processing on
+	GLuint gBufferFBO;
+	GLuint gAlbedoTexture;
+	GLuint gNormalTexture;
+	GLuint gIrradianceTexture;
+	GLuint lightingFBO;
+	bool isDeferred = false;
+
+	// Blinn-Phong materials have no G-buffer encoding, they are drawn forward after the lighting pass
+	std::vector<Entity*> forwardEntities;
+
 	// For shadow maps
 	GLuint depthFBO;
 	GLuint depthMap;
 	const unsigned int SHADOW_WIDTH = 1024;
 	const unsigned int SHADOW_HEIGHT = 1024;
 
+	// Cascades share the map as a 2x2 atlas, each fitted to a slice of the camera frustum
+	static const int CASCADE_COUNT = 4;
+	const unsigned int CASCADE_SIZE = 512;
+	glm::mat4 cascadeProjections[CASCADE_COUNT];
+	glm::mat4 cascadeMatrices[CASCADE_COUNT];
+	float cascadeSplits[CASCADE_COUNT];
+	float shadowDistance = 60.0f;
+	float cascadeSplitLambda = 0.75f;
+
+	// How far toward the light casters are still captured in front of a cascade
+	const float SHADOW_CASTER_DISTANCE = 50.0f;
+
+	// Bound to the shadow map unit so lit shaders get hardware compares and bilinear PCF,
+	// the texture itself stays a plain depth texture for the debug view
+	GLuint shadowSampler;
+
+	// 0 single tap, 1 four gathers, 2 Poisson 8, 3 Poisson 16, 4 EVSM
+	// Radius is in texels, it sizes the Poisson disk or the EVSM blur
+	int shadowKernel = 2;
+	float shadowFilterRadius = 1.5f;
+	float shadowBias = 0.005f;
+	float shadowSlopeBias = 0.05f;
+
+	// Cube shadows for the most important point lights
+	PointShadowAtlas* pointShadowAtlas;
+
+	// Moments are blurred once per frame when EVSM is selected
+	VarianceShadowFilter* varianceShadowFilter;
+	float shadowBleedReduction = 0.2f;
+	const int EVSM_KERNEL = 4;
+
+	// Static casters are kept in one map fitted to the static scene, so it doesn't follow the camera
+	// and is only redrawn when a static entity or the light moves, each frame it is reprojected into
+	// the cascades and dynamic casters are drawn over it
+	// Off by default, near cascades get coarser static casters than drawing them directly
+	GLuint staticDepthFBO = 0;
+	GLuint staticDepthMap = 0;
+	glm::mat4 staticProjection;
+	glm::mat4 staticMatrix;
+	glm::vec3 cachedLightDirection;
+	unsigned int cachedStaticVersion = 0;
+	bool isShadowCacheValid = false;
+	bool isShadowCaching = false;
+	bool isStaticShadowPass = false;
+	unsigned int staticShadowDraws = 0;
+	const int STATIC_SHADOW_SIZE = 1024;
+
+	// Baked diffuse for static entities, dropped again once static geometry moves
+	LightmapBaker* lightmapBaker = nullptr;
+	std::vector<Entity*> lightmapEntities;
+	std::vector<GLuint> lightmaps;
+	unsigned int lightmapStaticVersion = 0;
+	bool isLightmapping = true;
+
+	// L2 SH irradiance probes for entities without a lightmap, the nine coefficients sit side by side along x
+	GLuint probeVolume = 0;
+	AABB probeBounds;
+	glm::ivec3 probeResolution = glm::ivec3(0);
+	bool isProbeLighting = true;
+	const float PROBE_SPACING = 2.0f;
+	const int MAX_PROBES_PER_AXIS = 16;
+
+	// Cascade currently being rendered
 	glm::mat4 lightProjection;
 	glm::mat4 lightView;
 	glm::mat4 lightSpaceMatrix;
+
+	// Culling, frustums are extracted once per frame
+	Frustum cameraFrustum;
+	Frustum lightFrustum;
+	std::vector<Entity*> cullCandidates;
+	std::vector<BoundingSphere> cullSpheres;
+	std::vector<unsigned char> cullResults;
+	std::vector<Entity*> visibleEntities;
+	unsigned int visibleEntityCount = 0;
+	unsigned int totalEntityCount = 0;
+
+	// GPU occlusion culling, needs the post process framebuffer for depth
+	OcclusionCuller* occlusionCuller;
+	bool isOcclusionCulling = true;
+
+	// CPU occlusion culling against a low resolution depth buffer of flagged occluders
+	OcclusionRasterizer* occlusionRasterizer;
+	bool isSoftwareOcclusion = false;
+	unsigned int softwareOccludedCount = 0;
+
+	// Camera pass entities at LOD 0 with meshlets skip per entity Hi-Z and are culled per cluster instead
+	std::vector<Entity*> meshletEntities;
+	bool isMeshletCulling = true;
+	const float CONE_SCALE_TOLERANCE = 0.99f;
+
+	// Cluster cull output, each meshlet entity owns an index range, a command per phase and a flag per meshlet
+	GLuint meshletIndexBuffer;
+	GLuint meshletCommandBuffer;
+	GLuint meshletVisibilitySSBO;
+	GLuint meshletIndexCapacity = 0;
+	GLuint meshletCommandCapacity = 0;
+	GLuint meshletVisibilityCapacity = 0;
+	std::vector<GLuint> meshletIndexOffsets;
+	std::vector<GLuint> meshletVisibilityOffsets;
+
+	// Entities further than this from the camera are drawn as billboards
+	ImpostorRenderer* impostorRenderer;
+	float impostorDistance = 30.0f;
+
+	// PBR entities below this projected radius use the lite material, crossfading over the fade time in seconds
+	float shadingLODScreenSize = 0.1f;
+	float shadingLODFadeTime = 0.5f;
+	unsigned int liteShadedCount = 0;
+	float deltaTime = 0.0f;
 	
+	// Point lights are binned into view space clusters once per frame, shaders only loop over their cluster
+	LightClusterer* lightClusterer;
+
+	// Programs that already have this frame's lights and shadow settings, uniforms stay in the program between entities
+	std::unordered_set<Shader*> preparedShaders;
+
+	// Lite materials skip the clusters and take the strongest few lights as uniforms
+	const unsigned int LITE_POINT_LIGHT_COUNT = 2;
+
+	// Depth only pass before color so expensive shading runs once per pixel
+	// Overdraw is opaque samples passed per screen pixel, measured on whichever pass tests GL_LESS first
+	bool isDepthPrepass = false;
+	bool isAutoDepthPrepass = true;
+	bool isOverdrawPrepass = false;
+	float overdrawThreshold = 1.5f;
+	float overdraw = 0.0f;
+	GLuint overdrawQuery;
+	bool isOverdrawQueryPending = false;
+	bool isOverdrawQueryActive = false;
+
 	bool isPostProcess = true;
 
 	int width;
 	int height;
 
 	void DrawPointLights(Camera* camera);
+	void UpdateLightMatrices(Camera* camera);
+	void RenderShadowCascade(int cascade);
+	void CreateStaticShadowMap();
+	void RenderStaticShadows();
+	void ReprojectStaticShadows();
+	void FinishLightmapBake();
+	void ClearBakedLighting();
+	void CullEntities(Frustum& frustum);
+	void RasterizeOccluders(glm::mat4 viewProjection);
+	void CullOccludedEntities(glm::mat4 viewProjection);
+	void SelectLODs(glm::mat4 viewProjection, float projectionScale, bool isLight);
+	void GatherMeshletEntities();
+	void GatherImpostors();
+	void DrawImpostors();
+	void ReserveMeshletBuffers(GLuint indexCount, GLuint commandCount, GLuint visibilityCount);
+	void CullMeshletEntities(int phase, bool isHiZ);
+	void DrawMeshletEntities(int phase, bool isDepthOnly);
+	void PrepareEntity(Entity* entity, bool isLite = false);
+	void PrepareFrame(Shader* shader);
+	void PrepareShadows(Shader* shader);
+	void BindShadowMaps();
+	void PrepareBakedLighting(Shader* shader, Entity* entity, bool isLite);
+	void GatherForwardEntities();
+	void DrawShadingLODs(Entity* entity, const std::function<void()>& draw);
+	void PrepareGeometry(Entity* entity);
+	void RenderDeferred(Camera* camera);
+	bool IsDeferredActive() { return isDeferred && isPostProcess; }
+	void DrawEntitiesIndirect(int phase, bool isDepthOnly);
+	void PrepareDepth(Entity* entity);
+	void BeginOverdrawQuery();
+	void EndOverdrawQuery();
 };
 
@@ -3,6 +3,10 @@
 Scene::Scene(int width, int height, GLFWwindow* window)
 { 
     this->window = window;
+    screenHeight = height;
+
+    // Entities are added to the spatial index as they are created
+    spatialIndex = new SpatialIndex();
 
     // Add camera
     camera = new Camera(glm::vec3(-20, 9, 1), (float)width / (float)height);
@@ -16,28 +20,19 @@ Scene::Scene(int width, int height, GLFWwindow* window)
     AddDirectionalLight(dir);
 
     // Add Point light(s)
-    for (size_t i = 0; i < PointLightCount; i++)
-    {
-        PointLight* point = new PointLight;
-
-        point->position = glm::vec3(RandomRange(-5.0f, 5.0f), RandomRange(0.0f, 18.0f), RandomRange(-5.0f, 5.0f));
-        point->color = glm::vec3(RandomRange(0.0f, 1.0f), RandomRange(0.0f, 1.0f), RandomRange(0.0f, 1.0f));
-
-        point->intensity = 1.0f;
-        point->range = 4.0f;
-
-        AddPointLight(point);
-    }
+    SetPointLightCount(PointLightCount);
 
     // Add shaders
     AddShader("Default", new Shader("Default.vert", "Default.frag"));
     AddShader("DefaultPBR", new Shader("Default.vert", "DefaultPBR.frag"));
+    AddShader("DefaultPBRLite", new Shader("Default.vert", "DefaultPBRLite.frag"));
     AddShader("Refractive", new Shader("Default.vert", "Refractive.frag"));
+    AddShader("GBuffer", new Shader("Default.vert", "GBuffer.frag"));
+    AddShader("DeferredLighting", new Shader("BRDF.vert", "DeferredLighting.frag"));
 
     AddShader("Light", new Shader("Light.vert", "Light.frag"));
 
     AddShader("Sky", new Shader("Sky.vert", "Sky.frag"));
-    AddShader("Irradiance", new Shader("Fullscreen.vert", "Irradiance.frag"));
     AddShader("Specular", new Shader("Sky.vert", "SpecularConvolution.frag"));
     AddShader("BRDF", new Shader("BRDF.vert", "BRDFLookUp.frag"));
 
@@ -46,6 +41,18 @@ Scene::Scene(int width, int height, GLFWwindow* window)
     AddShader("Particle", new Shader("Particle.vert", "Particle.frag"));
 
     AddShader("SimpleDepth", new Shader("Simple.vert", "Empty.frag"));
+    AddShader("Depth", new Shader("Depth.vert", "Depth.frag"));
+    AddShader("ShadowReproject", new Shader("BRDF.vert", "ShadowReproject.frag"));
+
+    // Compute
+    AddShader("HiZDownsample", new Shader("HiZDownsample.comp"));
+    AddShader("HiZCull", new Shader("HiZCull.comp"));
+    AddShader("MeshletCull", new Shader("MeshletCull.comp"));
+    AddShader("LightCluster", new Shader("LightCluster.comp"));
+    AddShader("ShadowMomentBlur", new Shader("ShadowMomentBlur.comp"));
+
+    AddShader("ImpostorBake", new Shader("Default.vert", "ImpostorBake.frag"));
+    AddShader("Impostor", new Shader("Impostor.vert", "Impostor.frag"));
     
     // Set shader texture units
     GetShader("Default")->Use();
@@ -53,26 +60,68 @@ Scene::Scene(int width, int height, GLFWwindow* window)
     GetShader("Default")->SetInt("normalMap", 1);
     GetShader("Default")->SetInt("roughnessMap", 2);
     GetShader("Default")->SetInt("shadowMap", 7);
+    GetShader("Default")->SetInt("shadowMoments", 8);
+    GetShader("Default")->SetInt("pointShadowAtlas", 9);
+    GetShader("Default")->SetInt("lightmap", 10);
 
     GetShader("DefaultPBR")->Use();
     GetShader("DefaultPBR")->SetInt("albedoMap", 0);
     GetShader("DefaultPBR")->SetInt("normalMap", 1);
     GetShader("DefaultPBR")->SetInt("roughnessMap", 2);
     GetShader("DefaultPBR")->SetInt("metallicMap", 3);
-    GetShader("DefaultPBR")->SetInt("irradianceMap", 4);
     GetShader("DefaultPBR")->SetInt("specularMap", 5);
     GetShader("DefaultPBR")->SetInt("BRDFLUT", 6);
     GetShader("DefaultPBR")->SetInt("shadowMap", 7);
+    GetShader("DefaultPBR")->SetInt("shadowMoments", 8);
+    GetShader("DefaultPBR")->SetInt("pointShadowAtlas", 9);
+    GetShader("DefaultPBR")->SetInt("lightmap", 10);
+    GetShader("DefaultPBR")->SetInt("probeVolume", 11);
+    GetShader("DefaultPBR")->SetUniformBlockBinding("SkyLight", Sky::IRRADIANCE_BINDING);
+
+    GetShader("DefaultPBRLite")->Use();
+    GetShader("DefaultPBRLite")->SetInt("albedoMap", 0);
+    GetShader("DefaultPBRLite")->SetInt("roughnessMap", 2);
+    GetShader("DefaultPBRLite")->SetInt("metallicMap", 3);
+    GetShader("DefaultPBRLite")->SetUniformBlockBinding("SkyLight", Sky::IRRADIANCE_BINDING);
+
+    GetShader("GBuffer")->Use();
+    GetShader("GBuffer")->SetInt("albedoMap", 0);
+    GetShader("GBuffer")->SetInt("normalMap", 1);
+    GetShader("GBuffer")->SetInt("roughnessMap", 2);
+    GetShader("GBuffer")->SetInt("metallicMap", 3);
+    GetShader("GBuffer")->SetInt("lightmap", 10);
+    GetShader("GBuffer")->SetInt("probeVolume", 11);
+    GetShader("GBuffer")->SetUniformBlockBinding("SkyLight", Sky::IRRADIANCE_BINDING);
+
+    GetShader("DeferredLighting")->Use();
+    GetShader("DeferredLighting")->SetInt("gAlbedo", 0);
+    GetShader("DeferredLighting")->SetInt("gNormal", 1);
+    GetShader("DeferredLighting")->SetInt("gDepth", 2);
+    GetShader("DeferredLighting")->SetInt("gIrradiance", 3);
+    GetShader("DeferredLighting")->SetInt("specularMap", 5);
+    GetShader("DeferredLighting")->SetInt("BRDFLUT", 6);
+    GetShader("DeferredLighting")->SetInt("shadowMap", 7);
+    GetShader("DeferredLighting")->SetInt("shadowMoments", 8);
+    GetShader("DeferredLighting")->SetInt("pointShadowAtlas", 9);
 
     GetShader("Refractive")->Use();
     GetShader("Refractive")->SetInt("screenColors", 0);
     GetShader("Refractive")->SetInt("normalMap", 1);
 
+    GetShader("ShadowReproject")->Use();
+    GetShader("ShadowReproject")->SetInt("staticDepthMap", 0);
+
+    GetShader("ImpostorBake")->Use();
+    GetShader("ImpostorBake")->SetInt("albedoMap", 0);
+    GetShader("ImpostorBake")->SetInt("normalMap", 1);
+
+    GetShader("Impostor")->Use();
+    GetShader("Impostor")->SetInt("atlas", 0);
+    GetShader("Impostor")->SetUniformBlockBinding("SkyLight", Sky::IRRADIANCE_BINDING);
+
     //GetShader("Sky")->Use();
     //GetShader("Sky")->SetInt("environmentMap", 0);
 
-    //GetShader("Irradiance")->Use();
-    //GetShader("Irradiance")->SetInt("environmentMap", 0);
 
     //GetShader("Specular")->Use();
     //GetShader("Specular")->SetInt("environmentMap", 0);
@@ -143,6 +192,15 @@ Scene::Scene(int width, int height, GLFWwindow* window)
     
     AddMaterial("Glass", new Material(GetShader("Refractive"), nullptr, GetTexture("GlassNormal"), nullptr, nullptr, false, true));
 
+    // PBR materials switch to the cheaper variant when small on screen
+    for (std::pair<std::string, Material*> material : materials)
+    {
+        if (material.second->GetIsPBR())
+        {
+            material.second->SetLiteShader(GetShader("DefaultPBRLite"));
+        }
+    }
+
     // Add emitters
     AddEmmiter("EmitterOne", new Emitter(50, 1, 4, 0, GetShader("Particle"), GetTexture("ParticleDirt")));
     //AddEmmiter("EmitterTwo", new Emitter(50, 2, 4, 1, GetShader("Particle"), GetTexture("ParticleDot")));
@@ -151,9 +209,16 @@ Scene::Scene(int width, int height, GLFWwindow* window)
     //AddEmmiter("EmitterFive", new Emitter(50, 5, 4, 4, GetShader("Particle"), GetTexture("ParticleWindow")));
 
     // Add meshes
-    AddMesh("Sphere", CreateSphere(1, 20, 20));
+    AddMesh("Sphere", CreateSphere(1, 20, 20, 4));
     AddMesh("Cube", CreateCube());
 
+    // Cluster culled when drawn at full detail
+    GetMesh("Sphere")->BuildMeshlets();
+
+    // Shadow casters
+    GetMesh("Sphere")->EnableDepthStream();
+    GetMesh("Cube")->EnableDepthStream();
+
     std::vector<std::string> blueCloudsTexturePaths =
     {
         "Content/Textures/Skyboxes/BlueClouds/right.png",
@@ -178,7 +243,6 @@ Scene::Scene(int width, int height, GLFWwindow* window)
     skies.push_back(new Sky(
         GetMesh("Cube"),
         GetShader("Sky"),
-        GetShader("Irradiance"),
         GetShader("Specular"),
         GetShader("BRDF"),
         blueCloudsTexturePaths));
@@ -186,7 +250,6 @@ Scene::Scene(int width, int height, GLFWwindow* window)
     //skies.push_back(new Sky(
     //    GetMesh("Cube"),
     //    GetShader("Sky"),
-    //    GetShader("Irradiance"),
     //    GetShader("Specular"),
     //    GetShader("BRDF"),
     //    pinkCloudsTexturePaths));
@@ -233,10 +296,15 @@ Scene::Scene(int width, int height, GLFWwindow* window)
 
     GetEntity("FloorWoodSphere")->GetTransform()->Move(glm::vec3(0.0f, 10.0f, -3.0f));
     GetEntity("FloorWoodSphere")->GetTransform()->SetScale(glm::vec3(25, 25, 1));
+    GetEntity("FloorWoodSphere")->isOccluder = true;
 
     // Parent entities
     GetEntity("BronzeSphere")->GetTransform()->AddChild(GetEntity("CobbleSphere")->GetTransform());
 
+    // Moved every frame in Update
+    GetEntity("BronzeSphere")->isStatic = false;
+    GetEntity("CobbleSphere")->isStatic = false;
+
     GetEmitter("EmitterOne")->transform->Move(glm::vec3(0, 0, 6));
     //GetEmitter("EmitterTwo")->transform->Move(glm::vec3(0, 3, 6));
     //GetEmitter("EmitterThree")->transform->Move(glm::vec3(0, 6, 6));
@@ -244,6 +312,37 @@ Scene::Scene(int width, int height, GLFWwindow* window)
     //GetEmitter("EmitterFive")->transform->Move(glm::vec3(0, 12, 6));
 }
  
+void Scene::SetPointLightCount(size_t count)
+{
+    while (pointLights.size() > count)
+    {
+        delete pointLights.back();
+        pointLights.pop_back();
+    }
+
+    while (pointLights.size() < count)
+    {
+        PointLight* point = new PointLight;
+
+        point->position = glm::vec3(RandomRange(-5.0f, 5.0f), RandomRange(0.0f, 18.0f), RandomRange(-5.0f, 5.0f));
+        point->color = glm::vec3(RandomRange(0.0f, 1.0f), RandomRange(0.0f, 1.0f), RandomRange(0.0f, 1.0f));
+
+        point->intensity = 1.0f;
+        point->range = 4.0f;
+        point->isShadowCaster = true;
+
+        // Anything past the default set is smaller and spread over the whole floor
+        if (pointLights.size() >= PointLightCount)
+        {
+            point->position = glm::vec3(RandomRange(-12.0f, 12.0f), RandomRange(-2.0f, 22.0f), RandomRange(-2.5f, 6.0f));
+            point->range = 1.5f;
+            point->isShadowCaster = false;
+        }
+
+        AddPointLight(point);
+    }
+}
+
 void Scene::Update(float deltaTime, float currentTime)
 {
     camera->Update(window, deltaTime);
@@ -258,6 +357,9 @@ void Scene::Update(float deltaTime, float currentTime)
     // Do scene stuff
     GetEntity("BronzeSphere")->GetTransform()->SetPosition(glm::vec3(sin(totalTime) * 2, 0.0f, 0.0f));
     GetEntity("BronzeSphere")->GetTransform()->Rotate(glm::vec3(0.0f, 0.0f, 20 * deltaTime));
+
+    // Refit bounds of anything that moved this frame
+    spatialIndex->Update();
 }
 
 Scene::~Scene()
@@ -309,14 +411,42 @@ Scene::~Scene()
     }
 
     delete camera;
+    delete spatialIndex;
 }
 
 
-Mesh* Scene::CreateSphere(float radius, int sectorCount, int stackCount)
+Mesh* Scene::CreateSphere(float radius, int sectorCount, int stackCount, int lodCount)
 {
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
 
+    BuildSphere(radius, sectorCount, stackCount, vertices, indices);
+    Mesh* mesh = new Mesh(vertices, indices, true);
+
+    // Halve the tessellation for each level
+    float PI = 3.14159265359f;
+    for (int i = 1; i < lodCount; i++)
+    {
+        vertices.clear();
+        indices.clear();
+
+        int sectors = std::max(sectorCount >> i, 4);
+        int stacks = std::max(stackCount >> i, 3);
+        BuildSphere(radius, sectors, stacks, vertices, indices);
+
+        // Chord error of the widest angular step as a fraction of the radius
+        float step = std::max(2 * PI / sectors, PI / stacks);
+        float error = 1.0f - cosf(step * 0.5f);
+
+        // Screen size is the projected radius in NDC, one unit is half the screen height in pixels
+        mesh->AddLOD(vertices, indices, LOD_ERROR_PIXELS * 2.0f / (screenHeight * error));
+    }
+
+    return mesh;
+}
+
+void Scene::BuildSphere(float radius, int sectorCount, int stackCount, std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
     float x, y, z, xy;                              // vertex position
     float nx, ny, nz, lengthInv = 1.0f / radius;    // vertex normal
     float s, t;                                     // vertex texCoord
@@ -355,12 +485,21 @@ Mesh* Scene::CreateSphere(float radius, int sectorCount, int stackCount)
             s = (float)j / sectorCount;
             t = (float)i / stackCount;
 
+            // Tex coords don't tile, so they double as the lightmap unwrap
             vertices.push_back({
                 glm::vec3(x, y, z),
                 glm::vec2(s, t),
-                glm::vec3(nx, ny, nz)
+                glm::vec3(nx, ny, nz),
+                glm::vec4(0.0f),
+                glm::vec2(s, t)
             });
 
+            // The seam column and the last stack only close the quads before them
+            if (i == stackCount || j == sectorCount)
+            {
+                continue;
+            }
+
             // 2 triangles per sector excluding first and last stacks
             // k1 => k2 => k1+1
             if (i != 0)
@@ -379,8 +518,6 @@ Mesh* Scene::CreateSphere(float radius, int sectorCount, int stackCount)
             }
         }
     }
-
-    return new Mesh(vertices, indices);
 }
 
 Mesh* Scene::CreateCube()
@@ -5,6 +5,7 @@
 #include "Entity.h"
 #include "Sky.h"
 #include "Emitter.h"
+#include "SpatialIndex.h"
 
 // Light count
 #define DirectionalLightCount 1
@@ -26,6 +27,9 @@ struct PointLight
 
 	float range;
 	float intensity;
+
+	// Can get a cube shadow from the point shadow atlas
+	bool isShadowCaster = false;
 };
 
 class Scene
@@ -48,6 +52,7 @@ public:
 	unsigned int GetSkyIndex() { return skyIndex; }
 	unsigned int GetSkyCount() { return skies.size(); }
 	Camera* GetCamera() { return camera; }
+	SpatialIndex* GetSpatialIndex() { return spatialIndex; }
 	std::unordered_map<std::string, Entity*> GetEntities() { return entities; }
 	std::unordered_map<std::string, Emitter*> GetEmitters() { return emitters; }
 	std::vector<PointLight*> GetPointLights() { return pointLights; }
@@ -62,9 +67,12 @@ public:
 	void AddShader(std::string shaderName, Shader* shader) { shaders.insert({ shaderName, shader }); }
 	void AddMaterial(std::string materialName, Material* material) { materials.insert({ materialName, material }); }
 	void AddMesh(std::string meshName, Mesh* mesh) { meshes.insert({ meshName, mesh }); }
-	void AddEntity(std::string entityName, Entity* entity) { entities.insert({ entityName, entity }); }
+	void AddEntity(std::string entityName, Entity* entity) { entities.insert({ entityName, entity }); spatialIndex->Insert(entity); }
 	void AddEmmiter(std::string emitterName, Emitter* emitter) { emitters.insert({ emitterName, emitter }); }
 	void AddPointLight(PointLight* light) { pointLights.push_back(light); }
+
+	// Adds random lights or removes the newest ones until count are left
+	void SetPointLightCount(size_t count);
 	void AddDirectionalLight(DirectionalLight* light) { directionalLights.push_back(light); }
 
 private:
@@ -81,14 +89,23 @@ private:
 	Camera* camera;
 	GLFWwindow* window;
 
+	// For culling, light range and picking queries
+	SpatialIndex* spatialIndex;
+
 	unsigned int skyIndex;
 
 	float totalTime = 0;
 
+	// Generated LODs switch once their silhouette error projects under this many pixels of the starting height
+	int screenHeight;
+	const float LOD_ERROR_PIXELS = 1.0f;
+
 	// Helper for random value in range for point light init
 	float RandomRange(float min, float max) { return (float)std::rand() / RAND_MAX * (max - min) + min; }
 
-	Mesh* CreateSphere(float radius, int sectorCount, int stackCount);
+	// Coarser LODs are regenerated with fewer sectors and stacks, each used once its chord error is under LOD_ERROR_PIXELS
+	Mesh* CreateSphere(float radius, int sectorCount, int stackCount, int lodCount = 1);
+	void BuildSphere(float radius, int sectorCount, int stackCount, std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
 	Mesh* CreateCube();
 };
 
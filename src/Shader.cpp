@@ -33,6 +33,7 @@ Shader::Shader(std::string vertexPath, std::string fragmentPath)
         // Convert stream into string
         vertexCode = vShaderStream.str();
         fragmentCode = fShaderStream.str();
+        source = vertexCode + fragmentCode;
     }
     catch (std::ifstream::failure& e)
     {
@@ -69,6 +70,46 @@ Shader::Shader(std::string vertexPath, std::string fragmentPath)
     glDeleteShader(fragmentID);
 }
 
+Shader::Shader(std::string computePath)
+{
+    std::cout << "Loading " << computePath << std::endl;
+
+    // Get source code from path
+    std::string computeCode;
+    std::ifstream cShaderFile;
+    cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+
+    try
+    {
+        cShaderFile.open(("Content/Shaders/" + computePath).c_str());
+        std::stringstream cShaderStream;
+        cShaderStream << cShaderFile.rdbuf();
+        cShaderFile.close();
+        computeCode = cShaderStream.str();
+        source = computeCode;
+    }
+    catch (std::ifstream::failure& e)
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+    }
+
+    const char* cShaderCode = computeCode.c_str();
+
+    // Create compute shader
+    GLuint computeID = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(computeID, 1, &cShaderCode, NULL);
+    glCompileShader(computeID);
+    CheckCompileErrors(computeID, "COMPUTE");
+
+    // Create shader program
+    ID = glCreateProgram();
+    glAttachShader(ID, computeID);
+    glLinkProgram(ID);
+    CheckCompileErrors(ID, "PROGRAM");
+
+    glDeleteShader(computeID);
+}
+
 void Shader::CheckCompileErrors(GLuint shader, std::string type)
 {
     GLint success;
@@ -98,6 +139,11 @@ void Shader::Use()
     glUseProgram(ID);
 }
 
+void Shader::Dispatch(GLuint sizeX, GLuint sizeY, GLuint sizeZ, GLuint groupX, GLuint groupY, GLuint groupZ)
+{
+    glDispatchCompute((sizeX + groupX - 1) / groupX, (sizeY + groupY - 1) / groupY, (sizeZ + groupZ - 1) / groupZ);
+}
+
 void Shader::SetBool(const std::string& name, bool value) const
 {
     glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
@@ -108,6 +154,11 @@ void Shader::SetInt(const std::string& name, int value) const
     glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
 }
 
+void Shader::SetUInt(const std::string& name, unsigned int value) const
+{
+    glUniform1ui(glGetUniformLocation(ID, name.c_str()), value);
+}
+
 void Shader::SetFloat(const std::string& name, float value) const
 {
     glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
@@ -157,3 +208,12 @@ void Shader::SetMat4(const std::string& name, const glm::mat4& mat) const
 {
     glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
 }
+
+void Shader::SetUniformBlockBinding(const std::string& name, GLuint binding) const
+{
+    GLuint index = glGetUniformBlockIndex(ID, name.c_str());
+    if (index != GL_INVALID_INDEX)
+    {
+        glUniformBlockBinding(ID, index, binding);
+    }
+}
@@ -15,12 +15,19 @@ public:
     // Load shaders from path to create program
     Shader(std::string vertexPath, std::string fragmentPath);
 
+    // Load a compute shader from path to create program
+    Shader(std::string computePath);
+
     // Activate the shader program
     void Use();
 
+    // Dispatch a compute program, rounds up to cover the requested size
+    void Dispatch(GLuint sizeX, GLuint sizeY, GLuint sizeZ, GLuint groupX, GLuint groupY = 1, GLuint groupZ = 1);
+
     // Utility uniform functions
     void SetBool(const std::string& name, bool value) const;
     void SetInt(const std::string& name, int value) const;
+    void SetUInt(const std::string& name, unsigned int value) const;
     void SetFloat(const std::string& name, float value) const;
     void SetVec2(const std::string& name, const glm::vec2& value) const;
     void SetVec2(const std::string& name, float x, float y) const;
@@ -32,7 +39,15 @@ public:
     void SetMat3(const std::string& name, const glm::mat3& mat) const;
     void SetMat4(const std::string& name, const glm::mat4& mat) const;
 
+    // Point a uniform block at a buffer binding, for shaders too old to set it in GLSL
+    void SetUniformBlockBinding(const std::string& name, GLuint binding) const;
+
+    // Every stage's source, keys anything cached from this shader's output
+    const std::string& GetSource() { return source; }
+
 private:
+    std::string source;
+
     // Print compile errors for shaders
     void CheckCompileErrors(GLuint shader, std::string type);
 };
\ No newline at end of file
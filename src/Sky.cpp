@@ -1,19 +1,29 @@
 #include "Sky.h"
 
-Sky::Sky(Mesh* mesh, Shader* shader, Shader* irradianceShader, Shader* specularShader, Shader* BRDFShader, std::vector<std::string> filePaths)
+Sky::Sky(Mesh* mesh, Shader* shader, Shader* specularShader, Shader* BRDFShader, std::vector<std::string> filePaths)
 {
 	this->mesh = mesh;
 	this->shader = shader;
-    this->irradianceShader = irradianceShader;
     this->specularShader = specularShader;
     this->BRDFShader = BRDFShader;
+    this->filePaths = filePaths;
 
     std::cout << "Loading sky at: " << filePaths[0] << std::endl;
 
+    environmentHash = TextureCache::FNV_OFFSET;
+    for (const std::string& filePath : filePaths)
+    {
+        environmentHash = TextureCache::HashFile(filePath, environmentHash);
+    }
+
     // Generate cubemap
     glGenTextures(1, &environmentMap);
     glBindTexture(GL_TEXTURE_CUBE_MAP, environmentMap);
 
+    // Diffuse irradiance is projected from the faces while they're in memory
+    SphericalHarmonics irradiance;
+    float totalWeight = 0.0f;
+
     int width, height, nrComponents;
     for (unsigned int i = 0; i < filePaths.size(); i++)
     {
@@ -21,6 +31,7 @@ Sky::Sky(Mesh* mesh, Shader* shader, Shader* irradianceShader, Shader* specularS
         if (data)
         {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+            ProjectFace(data, width, height, nrComponents, i, irradiance, totalWeight);
             stbi_image_free(data);
             cubeMapRes = width; // Store cubemap res
         }
@@ -35,6 +46,70 @@ Sky::Sky(Mesh* mesh, Shader* shader, Shader* irradianceShader, Shader* specularS
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    // Texel solid angles only approximately cover the sphere, normalize to exactly 4 pi
+    // Stored as irradiance over pi, which is what the shaders multiply the albedo by
+    irradiance.Scale(totalWeight > 0.0f ? 4.0f * PI / totalWeight : 0.0f);
+    irradiance.ConvolveCosine();
+    irradiance.Scale(1.0f / PI);
+
+    glm::vec4 coefficients[SphericalHarmonics::COEFFICIENT_COUNT];
+    for (int i = 0; i < SphericalHarmonics::COEFFICIENT_COUNT; i++)
+    {
+        coefficients[i] = glm::vec4(irradiance.GetCoefficient(i), 0.0f);
+    }
+
+    glGenBuffers(1, &irradianceBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, irradianceBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(coefficients), coefficients, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void Sky::BindIrradiance()
+{
+    glBindBufferBase(GL_UNIFORM_BUFFER, IRRADIANCE_BINDING, irradianceBuffer);
+}
+
+void Sky::ProjectFace(unsigned char* data, int width, int height, int nrComponents, int face, SphericalHarmonics& irradiance, float& totalWeight)
+{
+    // Texels are summed in blocks and each block is projected once from its center, plenty for 9 coefficients
+    int blockSize = std::max(width / SH_PROJECTION_RES, 1);
+    float texelSize = 2.0f / width;
+
+    for (int blockY = 0; blockY < height; blockY += blockSize)
+    {
+        for (int blockX = 0; blockX < width; blockX += blockSize)
+        {
+            glm::vec3 sum = glm::vec3(0.0f);
+            int count = 0;
+            for (int y = blockY; y < std::min(blockY + blockSize, height); y++)
+            {
+                for (int x = blockX; x < std::min(blockX + blockSize, width); x++)
+                {
+                    unsigned char* texel = data + (y * width + x) * nrComponents;
+                    sum += nrComponents >= 3 ? glm::vec3(texel[0], texel[1], texel[2]) : glm::vec3(texel[0]);
+                    count++;
+                }
+            }
+
+            // Face coordinates of the block center, mapped to a direction the way GL picks cube faces
+            float sc = (blockX + 0.5f * std::min(blockSize, width - blockX)) * texelSize - 1.0f;
+            float tc = (blockY + 0.5f * std::min(blockSize, height - blockY)) * texelSize - 1.0f;
+            glm::vec3 directions[6] =
+            {
+                glm::vec3(1.0f, -tc, -sc),
+                glm::vec3(-1.0f, -tc, sc),
+                glm::vec3(sc, 1.0f, tc),
+                glm::vec3(sc, -1.0f, -tc),
+                glm::vec3(sc, -tc, 1.0f),
+                glm::vec3(-sc, -tc, -1.0f)
+            };
+
+            float weight = texelSize * texelSize * count / powf(1.0f + sc * sc + tc * tc, 1.5f);
+            irradiance.AddSample(glm::normalize(directions[face]), sum / (255.0f * count), weight);
+            totalWeight += weight;
+        }
+    }
 }
 
 void Sky::Draw(Camera* camera)
@@ -51,70 +126,23 @@ void Sky::Draw(Camera* camera)
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, environmentMap);
 
-    // Debug irradiance map
-    //glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
-
     // Debug specular map
     //glBindTexture(GL_TEXTURE_CUBE_MAP, convolvedSpecularMap);
 
 	mesh->Draw();
 }
 
-void Sky::CreateIrradianceMap(GLuint FBO, GLuint RBO)
+void Sky::CreateConvolvedSpecularMap(GLuint FBO, GLuint RBO, TextureCache* cache)
 {
-    std::cout << "Computing sky irradiance" << std::endl;
-
-    // Generate irradiance map
-    glGenTextures(1, &irradianceMap);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
-    for (unsigned int i = 0; i < 6; ++i)
+    unsigned long long key = TextureCache::Hash(specularShader->GetSource(), environmentHash);
+    key = TextureCache::Hash(&IBLMapRes, sizeof(IBLMapRes), key);
+    key = TextureCache::Hash(&specularMipLevels, sizeof(specularMipLevels), key);
+    if (cache && cache->Load("Specular", key, GL_TEXTURE_CUBE_MAP, convolvedSpecularMap))
     {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, IBLMapRes, IBLMapRes, 0, GL_RGB, GL_FLOAT, nullptr);
+        std::cout << "Loaded cached sky specular" << std::endl;
+        return;
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Bind FBO and RBO
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-    glBindRenderbuffer(GL_RENDERBUFFER, RBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, IBLMapRes, IBLMapRes);
-    glViewport(0, 0, IBLMapRes, IBLMapRes);    // Set viewport to the capture dimensions
 
-    // Get rid of this by calculating in shader
-    glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-    glm::mat4 captureViews[] =
-    {
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
-    };
-
-    irradianceShader->Use();
-    irradianceShader->SetMat4("projection", captureProjection);
-
-    // Cubemap is at slot 0
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, environmentMap);
-
-    for (unsigned int i = 0; i < 6; ++i)
-    {
-        irradianceShader->SetMat4("view", captureViews[i]);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, irradianceMap, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        mesh->Draw();
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
-
-void Sky::CreateConvolvedSpecularMap(GLuint FBO, GLuint RBO)
-{
     std::cout << "Computing sky specular" << std::endl;
 
     glGenTextures(1, &convolvedSpecularMap);
@@ -156,9 +184,7 @@ void Sky::CreateConvolvedSpecularMap(GLuint FBO, GLuint RBO)
     // Bind FBO
     glBindFramebuffer(GL_FRAMEBUFFER, FBO);
 
-    int totalMipLevels = 5;// std::max((int)(log2(IBLMapRes)) + 1 - mipLevelsToSkip, 1);
-
-    for (unsigned int mip = 0; mip < totalMipLevels; ++mip)
+    for (unsigned int mip = 0; mip < specularMipLevels; ++mip)
     {
         // reisze framebuffer according to mip-level size.
         unsigned int mipRes = IBLMapRes * std::pow(0.5, mip);
@@ -166,7 +192,7 @@ void Sky::CreateConvolvedSpecularMap(GLuint FBO, GLuint RBO)
         glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipRes, mipRes);
         glViewport(0, 0, mipRes, mipRes);
 
-        float roughness = (float)mip / (float)(totalMipLevels - 1);
+        float roughness = (float)mip / (float)(specularMipLevels - 1);
         specularShader->SetFloat("roughness", roughness);
         for (unsigned int i = 0; i < 6; ++i)
         {
@@ -178,10 +204,24 @@ void Sky::CreateConvolvedSpecularMap(GLuint FBO, GLuint RBO)
         }
     }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (cache)
+    {
+        cache->Save("Specular", key, GL_TEXTURE_CUBE_MAP, convolvedSpecularMap, GL_RGB16F, GL_RGB, specularMipLevels);
+    }
 }
 
-void Sky::CreateBRDFLookUpTexture(GLuint FBO, GLuint RBO)
+void Sky::CreateBRDFLookUpTexture(GLuint FBO, GLuint RBO, TextureCache* cache)
 {
+    // Doesn't depend on the environment, so every sky shares one cache entry
+    unsigned long long key = TextureCache::Hash(BRDFShader->GetSource());
+    key = TextureCache::Hash(&lookUpRes, sizeof(lookUpRes), key);
+    if (cache && cache->Load("BRDFLookUp", key, GL_TEXTURE_2D, BRDFLookUpMap))
+    {
+        std::cout << "Loaded cached BRDF Lookup Texture" << std::endl;
+        return;
+    }
+
     std::cout << "Computing BRDF Lookup Texture" << std::endl;
 
     glGenTextures(1, &BRDFLookUpMap);
@@ -207,6 +247,11 @@ void Sky::CreateBRDFLookUpTexture(GLuint FBO, GLuint RBO)
     RenderQuad();
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (cache)
+    {
+        cache->Save("BRDFLookUp", key, GL_TEXTURE_2D, BRDFLookUpMap, GL_RG16F, GL_RG, 1);
+    }
 }
 
 void Sky::RenderQuad()
@@ -6,42 +6,61 @@
 #include "Mesh.h"
 #include "Shader.h"
 #include "Camera.h"
+#include "TextureCache.h"
+#include "SphericalHarmonics.h"
 
 class Sky
 {
 public:
-	Sky(Mesh* mesh, Shader* shader, Shader* irradianceShader, Shader* specularShader, Shader* BRDFShader, std::vector<std::string> filePaths);
+	Sky(Mesh* mesh, Shader* shader, Shader* specularShader, Shader* BRDFShader, std::vector<std::string> filePaths);
 
 	void Draw(Camera* camera);
 
-	GLuint GetIrradianceMap() { return irradianceMap; }
+	GLuint GetIrradianceBuffer() { return irradianceBuffer; }
 	GLuint GetConvolvedSpecularMap() { return convolvedSpecularMap; }
 	GLuint GetBRDFLookUpTexture() { return BRDFLookUpMap; }
 	//unsigned int GetTotalMipLevels() { return totalMipLevels; }
 
-	void CreateIrradianceMap(GLuint FBO, GLuint RBO);
-	void CreateConvolvedSpecularMap(GLuint FBO, GLuint RBO);
-	void CreateBRDFLookUpTexture(GLuint FBO, GLuint RBO);
+	// Each map is loaded from the cache when one is given and has it, and written to it after a bake otherwise
+	void CreateConvolvedSpecularMap(GLuint FBO, GLuint RBO, TextureCache* cache = nullptr);
+	void CreateBRDFLookUpTexture(GLuint FBO, GLuint RBO, TextureCache* cache = nullptr);
 
 	void RenderQuad();
 
+	// Diffuse irradiance as L2 SH in a std140 block of 9 vec4s, shaders read it from this binding
+	void BindIrradiance();
+	static const GLuint IRRADIANCE_BINDING = 0;
+
+	// Face images in +X, -X, +Y, -Y, +Z, -Z order
+	const std::vector<std::string>& GetFilePaths() { return filePaths; }
+
 private:
 	Mesh* mesh;
 	Shader* shader;
-	Shader* irradianceShader;
 	Shader* specularShader;
 	Shader* BRDFShader;
+	std::vector<std::string> filePaths;
+
+	// Face files, part of the cache key for everything baked from them
+	unsigned long long environmentHash;
 
 	// Textures
 	GLuint environmentMap;
-	GLuint irradianceMap;
 	GLuint convolvedSpecularMap;
 	GLuint BRDFLookUpMap;
 
+	// Uniform buffer holding the SH irradiance
+	GLuint irradianceBuffer;
+
 	int cubeMapRes; // store cubemap res
 	//int totalMipLevels = 0;
 	//const GLuint mipLevelsToSkip = 3;
 	const GLuint IBLMapRes = 32;
 	const GLuint lookUpRes = 128;
+	const GLuint specularMipLevels = 5;
+	const int SH_PROJECTION_RES = 64;
+	const float PI = 3.14159265359f;
+
+	void ProjectFace(unsigned char* data, int width, int height, int nrComponents, int face, SphericalHarmonics& irradiance, float& totalWeight);
 };
 
@@ -0,0 +1,300 @@
+#include "SpatialIndex.h"
+
+SpatialIndex::SpatialIndex()
+{
+}
+
+void SpatialIndex::Insert(Entity* entity)
+{
+	entities.push_back(entity);
+	isRebuildNeeded = true;
+}
+
+void SpatialIndex::Remove(Entity* entity)
+{
+	std::vector<Entity*>::iterator it = std::find(entities.begin(), entities.end(), entity);
+	if (it != entities.end())
+	{
+		entities.erase(it);
+		isRebuildNeeded = true;
+
+		// Leaves past the erased entity now point one slot too far, rebuild before a query can use them
+		Rebuild();
+	}
+}
+
+void SpatialIndex::Update()
+{
+	// Rebuild after inserts, or once the refits add up to the whole scene moving since the tree was made
+	if (isRebuildNeeded || refitsSinceBuild > entities.size())
+	{
+		Rebuild();
+		return;
+	}
+
+	for (size_t i = 0; i < entities.size(); i++)
+	{
+		Transform* transform = entities[i]->GetTransform();
+		if (transform->GetHasMoved())
+		{
+			entityBounds[i] = entities[i]->GetWorldAABB();
+			transform->SetHasMoved(false);
+
+			if (entities[i]->isStatic)
+			{
+				staticVersion++;
+			}
+
+			Refit(entityLeaves[i]);
+			refitsSinceBuild++;
+		}
+	}
+}
+
+void SpatialIndex::Rebuild()
+{
+	nodes.clear();
+	entityBounds.resize(entities.size());
+	entityLeaves.resize(entities.size());
+	buildIndices.resize(entities.size());
+
+	// New entities or moved static ones invalidate static caches
+	bool hasStaticChanged = isRebuildNeeded;
+
+	for (size_t i = 0; i < entities.size(); i++)
+	{
+		entityBounds[i] = entities[i]->GetWorldAABB();
+		hasStaticChanged = hasStaticChanged || (entities[i]->isStatic && entities[i]->GetTransform()->GetHasMoved());
+		entities[i]->GetTransform()->SetHasMoved(false);
+		buildIndices[i] = i;
+	}
+
+	// A binary tree with n leaves has 2n - 1 nodes
+	nodes.reserve(entities.size() * 2);
+	root = entities.empty() ? -1 : BuildRecursive(0, entities.size(), -1);
+
+	isRebuildNeeded = false;
+	refitsSinceBuild = 0;
+	if (hasStaticChanged)
+	{
+		staticVersion++;
+	}
+}
+
+int SpatialIndex::BuildRecursive(int begin, int end, int parent)
+{
+	int nodeIndex = nodes.size();
+	nodes.push_back({ entityBounds[buildIndices[begin]], parent, -1, -1, -1 });
+
+	// Leaf
+	if (end - begin == 1)
+	{
+		nodes[nodeIndex].entity = buildIndices[begin];
+		entityLeaves[buildIndices[begin]] = nodeIndex;
+		return nodeIndex;
+	}
+
+	// Split on the longest axis of the centroid bounds
+	AABB centroidBounds = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+	for (int i = begin; i < end; i++)
+	{
+		AABB& box = entityBounds[buildIndices[i]];
+		glm::vec3 centroid = (box.min + box.max) * 0.5f;
+		centroidBounds.min = glm::min(centroidBounds.min, centroid);
+		centroidBounds.max = glm::max(centroidBounds.max, centroid);
+	}
+
+	glm::vec3 extents = centroidBounds.max - centroidBounds.min;
+	int axis = 0;
+	if (extents.y > extents.x) axis = 1;
+	if (extents.z > extents[axis]) axis = 2;
+
+	// Median split keeps the tree balanced
+	int middle = (begin + end) / 2;
+	std::nth_element(buildIndices.begin() + begin, buildIndices.begin() + middle, buildIndices.begin() + end,
+		[this, axis](int a, int b)
+		{
+			return entityBounds[a].min[axis] + entityBounds[a].max[axis] < entityBounds[b].min[axis] + entityBounds[b].max[axis];
+		});
+
+	int left = BuildRecursive(begin, middle, nodeIndex);
+	int right = BuildRecursive(middle, end, nodeIndex);
+
+	nodes[nodeIndex].left = left;
+	nodes[nodeIndex].right = right;
+	nodes[nodeIndex].bounds = Merge(nodes[left].bounds, nodes[right].bounds);
+
+	return nodeIndex;
+}
+
+void SpatialIndex::Refit(int leaf)
+{
+	nodes[leaf].bounds = entityBounds[nodes[leaf].entity];
+
+	// Walk up until a parent does not change
+	int node = nodes[leaf].parent;
+	while (node != -1)
+	{
+		AABB merged = Merge(nodes[nodes[node].left].bounds, nodes[nodes[node].right].bounds);
+		if (merged.min == nodes[node].bounds.min && merged.max == nodes[node].bounds.max)
+		{
+			break;
+		}
+
+		nodes[node].bounds = merged;
+		node = nodes[node].parent;
+	}
+}
+
+void SpatialIndex::QueryFrustum(Frustum& frustum, std::vector<Entity*>& results)
+{
+	if (root == -1)
+	{
+		return;
+	}
+
+	stack.clear();
+	stack.push_back(root);
+
+	while (!stack.empty())
+	{
+		int node = stack.back();
+		stack.pop_back();
+
+		if (!frustum.IsAABBVisible(nodes[node].bounds))
+		{
+			continue;
+		}
+
+		if (nodes[node].entity != -1)
+		{
+			results.push_back(entities[nodes[node].entity]);
+		}
+		else
+		{
+			stack.push_back(nodes[node].left);
+			stack.push_back(nodes[node].right);
+		}
+	}
+}
+
+void SpatialIndex::QuerySphere(BoundingSphere sphere, std::vector<Entity*>& results)
+{
+	if (root == -1)
+	{
+		return;
+	}
+
+	stack.clear();
+	stack.push_back(root);
+
+	while (!stack.empty())
+	{
+		int node = stack.back();
+		stack.pop_back();
+
+		if (!Overlaps(nodes[node].bounds, sphere))
+		{
+			continue;
+		}
+
+		if (nodes[node].entity != -1)
+		{
+			results.push_back(entities[nodes[node].entity]);
+		}
+		else
+		{
+			stack.push_back(nodes[node].left);
+			stack.push_back(nodes[node].right);
+		}
+	}
+}
+
+Entity* SpatialIndex::RayCast(glm::vec3 origin, glm::vec3 direction, float& distance)
+{
+	Entity* closest = nullptr;
+	distance = FLT_MAX;
+
+	if (root == -1)
+	{
+		return closest;
+	}
+
+	// Sphere refinement below assumes a unit direction
+	direction = glm::normalize(direction);
+	glm::vec3 inverseDirection = 1.0f / direction;
+
+	stack.clear();
+	stack.push_back(root);
+
+	while (!stack.empty())
+	{
+		int node = stack.back();
+		stack.pop_back();
+
+		// Skip anything that starts further than the closest hit so far
+		float entry;
+		if (!RayIntersects(nodes[node].bounds, origin, inverseDirection, distance, entry))
+		{
+			continue;
+		}
+
+		if (nodes[node].entity != -1)
+		{
+			// Refine with the bounding sphere, boxes of rotated or scaled entities are loose
+			Entity* entity = entities[nodes[node].entity];
+			BoundingSphere sphere = entity->GetWorldBoundingSphere();
+
+			glm::vec3 offset = origin - sphere.center;
+			float b = glm::dot(offset, direction);
+			float c = glm::dot(offset, offset) - sphere.radius * sphere.radius;
+			float discriminant = b * b - c;
+
+			if (discriminant >= 0)
+			{
+				float hit = std::max(-b - sqrtf(discriminant), 0.0f);
+				if (hit < distance)
+				{
+					distance = hit;
+					closest = entity;
+				}
+			}
+		}
+		else
+		{
+			stack.push_back(nodes[node].left);
+			stack.push_back(nodes[node].right);
+		}
+	}
+
+	return closest;
+}
+
+AABB SpatialIndex::Merge(AABB a, AABB b)
+{
+	return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+}
+
+bool SpatialIndex::Overlaps(AABB box, BoundingSphere sphere)
+{
+	// Closest point on the box to the sphere center
+	glm::vec3 closest = glm::clamp(sphere.center, box.min, box.max);
+	glm::vec3 offset = closest - sphere.center;
+
+	return glm::dot(offset, offset) <= sphere.radius * sphere.radius;
+}
+
+bool SpatialIndex::RayIntersects(AABB box, glm::vec3 origin, glm::vec3 inverseDirection, float maxDistance, float& entry)
+{
+	// Slab test
+	glm::vec3 t0 = (box.min - origin) * inverseDirection;
+	glm::vec3 t1 = (box.max - origin) * inverseDirection;
+
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+
+	entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+
+	return entry <= exit;
+}
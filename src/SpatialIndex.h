@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+
+#include "Entity.h"
+#include "Frustum.h"
+
+// Node in the bounding volume hierarchy, leaves hold a single entity
+struct SpatialNode
+{
+	AABB bounds;
+
+	int parent;
+	int left;
+	int right;
+
+	// Index into entities for leaves, -1 for internal nodes
+	int entity;
+};
+
+// Dynamic BVH over scene entities, refit when transforms move and rebuilt when refits pile up
+class SpatialIndex
+{
+public:
+	SpatialIndex();
+
+	// Adding entities marks the tree for a rebuild on the next update, removing rebuilds it right away
+	void Insert(Entity* entity);
+	void Remove(Entity* entity);
+
+	// Refit leaves of moved entities, call once per frame after the scene has moved things
+	void Update();
+
+	// Queries
+	void QueryFrustum(Frustum& frustum, std::vector<Entity*>& results);
+	void QuerySphere(BoundingSphere sphere, std::vector<Entity*>& results);
+	Entity* RayCast(glm::vec3 origin, glm::vec3 direction, float& distance);
+
+	// Getters
+	unsigned int GetNodeCount() { return nodes.size(); }
+	unsigned int GetEntityCount() { return entities.size(); }
+
+	// Bumped whenever a static entity moves or the entity set changes, so caches can tell they are stale
+	unsigned int GetStaticVersion() { return staticVersion; }
+
+private:
+	std::vector<SpatialNode> nodes;
+	std::vector<Entity*> entities;
+	std::vector<AABB> entityBounds;
+
+	// Leaf node for each entity
+	std::vector<int> entityLeaves;
+
+	// Scratch for builds and traversal
+	std::vector<int> buildIndices;
+	std::vector<int> stack;
+
+	int root = -1;
+	bool isRebuildNeeded = false;
+	unsigned int refitsSinceBuild = 0;
+	unsigned int staticVersion = 0;
+
+	void Rebuild();
+	int BuildRecursive(int begin, int end, int parent);
+	void Refit(int leaf);
+
+	// Helpers
+	static AABB Merge(AABB a, AABB b);
+	static bool Overlaps(AABB box, BoundingSphere sphere);
+	static bool RayIntersects(AABB box, glm::vec3 origin, glm::vec3 inverseDirection, float maxDistance, float& entry);
+};
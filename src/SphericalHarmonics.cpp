@@ -0,0 +1,80 @@
+#include "SphericalHarmonics.h"
+
+SphericalHarmonics::SphericalHarmonics()
+{
+	for (int i = 0; i < COEFFICIENT_COUNT; i++)
+	{
+		coefficients[i] = glm::vec3(0.0f);
+	}
+}
+
+void SphericalHarmonics::AddSample(glm::vec3 direction, glm::vec3 radiance, float weight)
+{
+	float basis[COEFFICIENT_COUNT];
+	EvaluateBasis(direction, basis);
+
+	for (int i = 0; i < COEFFICIENT_COUNT; i++)
+	{
+		coefficients[i] += radiance * (basis[i] * weight);
+	}
+}
+
+void SphericalHarmonics::ConvolveCosine()
+{
+	// Ramamoorthi and Hanrahan, pi, 2pi/3 and pi/4 for bands 0, 1 and 2
+	const float bands[COEFFICIENT_COUNT] = { 3.14159265f, 2.09439510f, 2.09439510f, 2.09439510f, 0.78539816f, 0.78539816f, 0.78539816f, 0.78539816f, 0.78539816f };
+
+	for (int i = 0; i < COEFFICIENT_COUNT; i++)
+	{
+		coefficients[i] *= bands[i];
+	}
+}
+
+void SphericalHarmonics::Scale(float scale)
+{
+	for (int i = 0; i < COEFFICIENT_COUNT; i++)
+	{
+		coefficients[i] *= scale;
+	}
+}
+
+void SphericalHarmonics::Add(const SphericalHarmonics& other)
+{
+	for (int i = 0; i < COEFFICIENT_COUNT; i++)
+	{
+		coefficients[i] += other.coefficients[i];
+	}
+}
+
+glm::vec3 SphericalHarmonics::Evaluate(glm::vec3 direction) const
+{
+	float basis[COEFFICIENT_COUNT];
+	EvaluateBasis(direction, basis);
+
+	glm::vec3 result = glm::vec3(0.0f);
+	for (int i = 0; i < COEFFICIENT_COUNT; i++)
+	{
+		result += coefficients[i] * basis[i];
+	}
+
+	return result;
+}
+
+void SphericalHarmonics::EvaluateBasis(glm::vec3 direction, float basis[9])
+{
+	float x = direction.x;
+	float y = direction.y;
+	float z = direction.z;
+
+	basis[0] = 0.282095f;
+
+	basis[1] = 0.488603f * y;
+	basis[2] = 0.488603f * z;
+	basis[3] = 0.488603f * x;
+
+	basis[4] = 1.092548f * x * y;
+	basis[5] = 1.092548f * y * z;
+	basis[6] = 0.315392f * (3.0f * z * z - 1.0f);
+	basis[7] = 1.092548f * x * z;
+	basis[8] = 0.546274f * (x * x - y * y);
+}
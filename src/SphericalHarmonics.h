@@ -0,0 +1,32 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// RGB L2 spherical harmonics, 9 coefficients per channel
+// The basis constants are the real orthonormal ones, shaders evaluating these must use the same order
+class SphericalHarmonics
+{
+public:
+	SphericalHarmonics();
+
+	// Monte Carlo projection, weight is the sample's solid angle
+	void AddSample(glm::vec3 direction, glm::vec3 radiance, float weight);
+
+	// Radiance to irradiance, each band is scaled by the clamped cosine lobe
+	void ConvolveCosine();
+
+	void Scale(float scale);
+	void Add(const SphericalHarmonics& other);
+
+	// Reconstruct along a unit direction
+	glm::vec3 Evaluate(glm::vec3 direction) const;
+
+	// Getters
+	glm::vec3 GetCoefficient(int index) const { return coefficients[index]; }
+
+	static void EvaluateBasis(glm::vec3 direction, float basis[9]);
+
+	static const int COEFFICIENT_COUNT = 9;
+
+private:
+	glm::vec3 coefficients[COEFFICIENT_COUNT];
+};
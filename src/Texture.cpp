@@ -44,6 +44,15 @@ Texture::Texture(const char* filePath)
         // Copy data and generate mipmaps
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+
+        // Mean color, stands in for the texture in CPU side lighting
+        glm::dvec3 sum(0.0);
+        for (int i = 0; i < width * height; i++)
+        {
+            unsigned char* texel = data + i * nrComponents;
+            sum += nrComponents >= 3 ? glm::dvec3(texel[0], texel[1], texel[2]) : glm::dvec3(texel[0]);
+        }
+        averageColor = glm::vec3(sum / (255.0 * width * height));
         
         stbi_image_free(data);
     }
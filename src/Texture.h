@@ -2,6 +2,7 @@
 #include <iostream>
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 #include<stb/stb_image.h>
 
 class Texture
@@ -10,6 +11,9 @@ public:
 
 	GLuint ID; // OpenGL texture reference
 
+	// Mean texel in [0,1], lets CPU bakers approximate the surface without the image
+	glm::vec3 averageColor = glm::vec3(0.5f);
+
 	// Load texture from path
 	Texture(const char* filePath);
 	~Texture();
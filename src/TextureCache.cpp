@@ -0,0 +1,183 @@
+#include "TextureCache.h"
+
+namespace
+{
+	const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+}
+
+TextureCache::TextureCache(std::string directory)
+{
+	this->directory = directory;
+}
+
+bool TextureCache::Load(std::string name, unsigned long long key, GLenum target, GLuint& texture)
+{
+	std::string path = GetPath(name, key);
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		missCount++;
+		return false;
+	}
+
+	GLuint faceCount = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+
+	KTXHeader header;
+	file.read((char*)&header, sizeof(header));
+	if (!file || memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0 || header.endianness != KTX_ENDIANNESS ||
+		header.glType != GL_HALF_FLOAT || header.numberOfFaces != faceCount || header.numberOfMipmapLevels == 0)
+	{
+		std::cout << "ERROR::TEXTURE_CACHE::Unsupported or corrupt file: " << path << std::endl;
+		missCount++;
+		return false;
+	}
+	file.seekg(header.bytesOfKeyValueData, std::ios::cur);
+
+	// Read everything before touching GL so a truncated file doesn't leave half a texture
+	std::vector<std::vector<char>> images;
+	for (GLuint level = 0; level < header.numberOfMipmapLevels; level++)
+	{
+		GLuint imageSize;
+		file.read((char*)&imageSize, sizeof(imageSize));
+
+		if (imageSize != GetImageSize(header.glFormat, std::max(header.pixelWidth >> level, 1u), std::max(header.pixelHeight >> level, 1u)))
+		{
+			file.setstate(std::ios::failbit);
+			break;
+		}
+
+		// Image sizes are already multiples of 4, so there's no face or level padding
+		for (GLuint face = 0; face < faceCount; face++)
+		{
+			images.push_back(std::vector<char>(imageSize));
+			file.read(images.back().data(), imageSize);
+		}
+	}
+
+	if (!file)
+	{
+		std::cout << "ERROR::TEXTURE_CACHE::Truncated file: " << path << std::endl;
+		missCount++;
+		return false;
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glGenTextures(1, &texture);
+	glBindTexture(target, texture);
+	for (GLuint level = 0; level < header.numberOfMipmapLevels; level++)
+	{
+		for (GLuint face = 0; face < faceCount; face++)
+		{
+			GLenum imageTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+			glTexImage2D(imageTarget, level, header.glInternalFormat, std::max(header.pixelWidth >> level, 1u), std::max(header.pixelHeight >> level, 1u), 0,
+				header.glFormat, header.glType, images[level * faceCount + face].data());
+		}
+	}
+
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, header.numberOfMipmapLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, header.numberOfMipmapLevels - 1);
+
+	hitCount++;
+	return true;
+}
+
+void TextureCache::Save(std::string name, unsigned long long key, GLenum target, GLuint texture, GLenum internalFormat, GLenum format, GLuint levels)
+{
+	std::string path = GetPath(name, key);
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cout << "ERROR::TEXTURE_CACHE::Could not write: " << path << std::endl;
+		return;
+	}
+
+	GLuint faceCount = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+
+	GLint width, height;
+	glBindTexture(target, texture);
+	glGetTexLevelParameteriv(target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target, 0, GL_TEXTURE_HEIGHT, &height);
+
+	KTXHeader header;
+	memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+	header.endianness = KTX_ENDIANNESS;
+	header.glType = GL_HALF_FLOAT;
+	header.glTypeSize = 2;
+	header.glFormat = format;
+	header.glInternalFormat = internalFormat;
+	header.glBaseInternalFormat = format;
+	header.pixelWidth = width;
+	header.pixelHeight = height;
+	header.pixelDepth = 0;
+	header.numberOfArrayElements = 0;
+	header.numberOfFaces = faceCount;
+	header.numberOfMipmapLevels = levels;
+	header.bytesOfKeyValueData = 0;
+	file.write((const char*)&header, sizeof(header));
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	std::vector<char> image;
+	for (GLuint level = 0; level < levels; level++)
+	{
+		GLuint imageSize = GetImageSize(format, std::max(width >> level, 1), std::max(height >> level, 1));
+		file.write((const char*)&imageSize, sizeof(imageSize));
+
+		image.resize(imageSize);
+		for (GLuint face = 0; face < faceCount; face++)
+		{
+			glGetTexImage(target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target, level, format, GL_HALF_FLOAT, image.data());
+			file.write(image.data(), imageSize);
+		}
+	}
+}
+
+unsigned long long TextureCache::Hash(const void* data, size_t size, unsigned long long hash)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+unsigned long long TextureCache::Hash(const std::string& data, unsigned long long hash)
+{
+	return Hash(data.data(), data.size(), hash);
+}
+
+unsigned long long TextureCache::HashFile(const std::string& path, unsigned long long hash)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::vector<char> buffer(1 << 16);
+	while (file)
+	{
+		file.read(buffer.data(), buffer.size());
+		hash = Hash(buffer.data(), file.gcount(), hash);
+	}
+
+	// Missing files still change the key
+	return Hash(path, hash);
+}
+
+std::string TextureCache::GetPath(std::string name, unsigned long long key)
+{
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", key);
+	return directory + name + "_" + hex + ".ktx";
+}
+
+GLuint TextureCache::GetImageSize(GLenum format, GLuint width, GLuint height)
+{
+	GLuint components = format == GL_RED ? 1 : format == GL_RG ? 2 : format == GL_RGB ? 3 : 4;
+	GLuint rowSize = (width * components * 2 + 3) & ~3u;
+	return rowSize * height;
+}
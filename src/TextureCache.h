@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+// Keeps baked textures on disk as KTX 1.1 files named after a hash of everything that went into them
+// Handles uncompressed half float 2D and cube textures, anything else is baked as usual
+class TextureCache
+{
+public:
+	TextureCache(std::string directory);
+
+	// Creates the texture from the cache, clamped and linearly filtered, false on a miss
+	bool Load(std::string name, unsigned long long key, GLenum target, GLuint& texture);
+
+	// Reads levels back from the GPU and writes them out, format is the client format the data is stored in
+	void Save(std::string name, unsigned long long key, GLenum target, GLuint texture, GLenum internalFormat, GLenum format, GLuint levels);
+
+	// FNV-1a, chain hashes by passing the previous result in
+	static unsigned long long Hash(const void* data, size_t size, unsigned long long hash = FNV_OFFSET);
+	static unsigned long long Hash(const std::string& data, unsigned long long hash = FNV_OFFSET);
+	static unsigned long long HashFile(const std::string& path, unsigned long long hash = FNV_OFFSET);
+
+	static const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+	static const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+	// Getters
+	unsigned int GetHitCount() { return hitCount; }
+	unsigned int GetMissCount() { return missCount; }
+
+private:
+	struct KTXHeader
+	{
+		unsigned char identifier[12];
+		GLuint endianness;
+		GLuint glType;
+		GLuint glTypeSize;
+		GLuint glFormat;
+		GLuint glInternalFormat;
+		GLuint glBaseInternalFormat;
+		GLuint pixelWidth;
+		GLuint pixelHeight;
+		GLuint pixelDepth;
+		GLuint numberOfArrayElements;
+		GLuint numberOfFaces;
+		GLuint numberOfMipmapLevels;
+		GLuint bytesOfKeyValueData;
+	};
+
+	std::string directory;
+
+	unsigned int hitCount = 0;
+	unsigned int missCount = 0;
+
+	const GLuint KTX_ENDIANNESS = 0x04030201;
+
+	std::string GetPath(std::string name, unsigned long long key);
+
+	// Bytes in one image of a level, rows are padded to 4 bytes like GL's default pack alignment
+	GLuint GetImageSize(GLenum format, GLuint width, GLuint height);
+};
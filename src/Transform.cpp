@@ -15,6 +15,7 @@ Transform::Transform()
 
 	parent = nullptr;
 	areMatricesDirty = false;
+	hasMoved = true;
 }
 
 void Transform::UpdateMatrices()
@@ -50,18 +51,21 @@ void Transform::SetPosition(glm::vec3 newPosition)
 { 
 	position = newPosition; 
 	areMatricesDirty = true; 
+	hasMoved = true;
 	SetChildrenMatricesDirty(); 
 }
 void Transform::SetRotation(glm::vec3 newRotation) 
 { 
 	rotation = newRotation; 
 	areMatricesDirty = true;
+	hasMoved = true;
 	SetChildrenMatricesDirty();
 }
 void Transform::SetScale(glm::vec3 newScale) 
 { 
 	scale = newScale; 
 	areMatricesDirty = true; 
+	hasMoved = true;
 	SetChildrenMatricesDirty(); 
 }
 
@@ -73,6 +77,7 @@ void Transform::Move(glm::vec3 vectorToAdd)
 
 	// Update matrices
 	areMatricesDirty = true;
+	hasMoved = true;
 	SetChildrenMatricesDirty();
 }
 
@@ -82,6 +87,7 @@ void Transform::Rotate(glm::vec3 rotationToAdd)
 
 	// Update matrices
 	areMatricesDirty = true;
+	hasMoved = true;
 	SetChildrenMatricesDirty();
 }
 
@@ -145,6 +151,7 @@ void Transform::AddChild(Transform* child, bool isRelative)
 
 	// Set transforms as dirty
 	child->areMatricesDirty = true;
+	child->hasMoved = true;
 	child->SetChildrenMatricesDirty();
 } 
 void Transform::RemoveChild(Transform* child, bool isRelative) 
@@ -183,6 +190,7 @@ void Transform::SetChildrenMatricesDirty()
 	for (Transform* c : children)
 	{
 		c->areMatricesDirty = true;
+		c->hasMoved = true;
 		c->SetChildrenMatricesDirty();
 	}
 }
\ No newline at end of file
@@ -16,7 +16,8 @@ public:
 	void SetRotation(glm::vec3 newRotation);
 	void SetScale(glm::vec3 newScale);
 	void SetParent(Transform* newParent);
-	void SetMatricesDirty(bool isDirty) { areMatricesDirty = isDirty; }
+	void SetMatricesDirty(bool isDirty) { areMatricesDirty = isDirty; hasMoved = hasMoved || isDirty; }
+	void SetHasMoved(bool moved) { hasMoved = moved; }
 
 	// Getters
 	glm::vec3& GetPosition() { return position; }
@@ -30,6 +31,7 @@ public:
 	Transform* GetChild(unsigned int index) { return children[index]; }
 	int GetChildIndex(Transform* child);
 	unsigned int GetChildCount() { return children.size(); }
+	bool GetHasMoved() { return hasMoved; }
 
 	// Movement
 	void Rotate(glm::vec3 rotationToAdd);
@@ -59,5 +61,8 @@ private:
 	std::vector<Transform*> children;
 
 	bool areMatricesDirty;
+
+	// Stays set until whoever tracks movement (spatial index) clears it
+	bool hasMoved;
 };
 
@@ -0,0 +1,60 @@
+#include "VarianceShadowFilter.h"
+
+VarianceShadowFilter::VarianceShadowFilter(int width, int height, Shader* blurShader)
+{
+	this->width = width;
+	this->height = height;
+	this->blurShader = blurShader;
+
+	glGenTextures(1, &blurTexture);
+	glBindTexture(GL_TEXTURE_2D, blurTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	// Moments filter linearly, unlike depth
+	glGenTextures(1, &momentsTexture);
+	glBindTexture(GL_TEXTURE_2D, momentsTexture);
+	glTexStorage2D(GL_TEXTURE_2D, MIP_LEVELS, GL_RGBA16F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+VarianceShadowFilter::~VarianceShadowFilter()
+{
+	glDeleteTextures(1, &blurTexture);
+	glDeleteTextures(1, &momentsTexture);
+}
+
+void VarianceShadowFilter::Filter(GLuint depthMap, int tileSize, int radius)
+{
+	blurShader->Use();
+	blurShader->SetInt("depthMap", 0);
+	blurShader->SetInt("tileSize", tileSize);
+	blurShader->SetInt("radius", std::max(radius, 0));
+	blurShader->SetVec2("exponents", exponents);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, depthMap);
+
+	// Horizontal, warps depth on the way in
+	blurShader->SetBool("isVertical", false);
+	glBindImageTexture(0, momentsTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA16F);
+	glBindImageTexture(1, blurTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	blurShader->Dispatch(width, height, 1, 8, 8);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+	// Vertical
+	blurShader->SetBool("isVertical", true);
+	glBindImageTexture(0, blurTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA16F);
+	glBindImageTexture(1, momentsTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	blurShader->Dispatch(width, height, 1, 8, 8);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	glBindTexture(GL_TEXTURE_2D, momentsTexture);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
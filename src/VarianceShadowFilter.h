@@ -0,0 +1,39 @@
+#pragma once
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+
+// Exponential variance shadows
+// The depth atlas is warped into moments and blurred once per frame, so lookups are a single filtered fetch
+class VarianceShadowFilter
+{
+public:
+	VarianceShadowFilter(int width, int height, Shader* blurShader);
+	~VarianceShadowFilter();
+
+	// Warp and blur the depth atlas, taps never leave their tile, radius is in texels
+	void Filter(GLuint depthMap, int tileSize, int radius);
+
+	// Getters
+	GLuint GetMomentsTexture() { return momentsTexture; }
+	glm::vec2 GetExponents() { return exponents; }
+
+	// Few enough levels that the smallest still keeps cascade tiles apart
+	static const int MIP_LEVELS = 4;
+
+private:
+	Shader* blurShader;
+
+	int width;
+	int height;
+
+	// Positive and negative warp, capped so the squared moments stay inside half float range
+	glm::vec2 exponents = glm::vec2(5.0f, 5.0f);
+
+	// Horizontal pass target, the vertical pass writes the mipmapped moments
+	GLuint blurTexture;
+	GLuint momentsTexture;
+};